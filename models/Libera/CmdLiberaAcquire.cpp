@@ -37,21 +37,44 @@ uint8_t own::CmdLiberaAcquire::implementedHandler() {
 #define LIBERA_IOP_MODE_DECIMATED 0x200
 #define LIBERA_IOP_MODE_CONTINUOUS 0x400
 #define LIBERA_IOP_MODE_SINGLEPASS 0x800
+#define LIBERA_IOP_MODE_SOA 0x1000 // with DD, "DD" holds COUNT atoms column major
+#define LIBERA_IOP_MODE_PACKED 0x2000 // "DD","SA","ADC_CW","ADC_SP" hold the atoms packed (libera_unpack)
 */
 
 // command syntax enable, mode, samples, loops
-// {"acquire","enable:1","mode:<bit ored>","samples:XX","loops:YY","offset:HH","duration:SS"}
-// mode: <> is required
+// {"acquire","enable:1","mode:<bit ored>","samples:XX","loops:YY","offset:HH","duration:SS","sa_samples:ZZ","sp_separation:NN","sw_decimation:RR","sw_filter:FF"}
+// mode: <> is required, SA can be ored with one of the other modes and is streamed concurrently
+// samples: atoms per acquisition, when not given the driver keeps the ones of the previous acquire
+// sa_samples: max SA atoms published per loop (default samples when SA alone, 16 otherwise)
+// sp_separation: single pass, min ADC atoms between two shots, one ADC_SP atom per shot (COUNT); 0 first shot only
+// sw_decimation: DD, samples*sw_decimation atoms are read and decimated to samples (default 1, no decimation)
+// sw_filter: DD decimation filter [1=boxcar (default),2=CIC,3=FIR], see LIBERA_DEC_xx
+// mode PACKED: the waveform attributes hold a self describing packed buffer, not with SOA
 // loops:<0 means loop forever
 
 driver::daq::libera::CmdLiberaAcquire::CmdLiberaAcquire():CmdLiberaDefault(){
+    acquire_buffer = NULL;
+    acquire_buffer_size = 0;
+    sa_buffer = NULL;
+    sa_buffer_size = 0;
+    plat_hist = NULL;
+    lat_traced = 0;
+    pack_layout = NULL;
+    px_wmean = NULL;
+    py_wmean = NULL;
+    for(int field=0;field<LIBERA_STATS_FIELDS;field++){
+        pstat_mean[field] = pstat_rms[field] = NULL;
+        pstat_min[field] = pstat_max[field] = pstat_p2p[field] = NULL;
+    }
 }
 driver::daq::libera::CmdLiberaAcquire::~CmdLiberaAcquire(){
 }
 void driver::daq::libera::CmdLiberaAcquire::setHandler(c_data::CDataWrapper *data) {
 	CMDCUDBG_ << "Executing acquire set handler:"<<data->getJSONString();
-        int tsamples=-1,toffset=-1,tmode=-1;
-	int ret;
+        int tsamples=-1,toffset=-1,tmode=-1,tsa_samples=-1;
+	int ret,stop_mode;
+        const char* buffer_attr=NULL;
+        size_t atom_size=0;
         mode =0;
         offset =0;
         loops=1;
@@ -59,7 +82,13 @@ void driver::daq::libera::CmdLiberaAcquire::setHandler(c_data::CDataWrapper *dat
         CmdLiberaDefault::setHandler(data);
         perr=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "error");
         *perr=0;
-        if((ret=driver->iop(LIBERA_IOP_CMD_STOP,0,0))!=0){
+        // the SA stream keeps running if the new acquisition streams SA too
+        stop_mode=LIBERA_IOP_MODE_SA;
+        if(data->hasKey("mode") && (data->getInt32Value("mode")&LIBERA_IOP_MODE_SA) &&
+           !(data->hasKey("enable") && (data->getInt32Value("enable")==0))){
+            stop_mode=0;
+        }
+        if((ret=driver->iop(LIBERA_IOP_CMD_STOP,(void*)&stop_mode,sizeof(stop_mode)))!=0){
             *perr|=LIBERA_ERROR_STOP_ACQUIRE;
            
             getAttributeCache()->setOutputDomainAsChanged();
@@ -93,21 +122,70 @@ void driver::daq::libera::CmdLiberaAcquire::setHandler(c_data::CDataWrapper *dat
             tmode = data->getInt32Value("mode");
         }
         
-        if(mode&LIBERA_IOP_MODE_SA){
+        if(tmode&LIBERA_IOP_MODE_SA){
             loops=-1;
         }
-        if(data->hasKey("samples")) {
+        if((tmode&LIBERA_IOP_MODE_PACKED) && (tmode&LIBERA_IOP_MODE_SOA)){
+            // the packed buffer is already column major
+            *perr|=LIBERA_ERROR_SWCONFIG;
+            getAttributeCache()->setOutputDomainAsChanged();
+            BC_END_RUNNIG_PROPERTY
+            throw chaos::CException(1, "Packed and column major DD are exclusive", __FUNCTION__);
+        }
+        const bool set_samples=data->hasKey("samples");
+        if(set_samples) {
             tsamples = std::min(data->getInt32Value("samples"),64000); 
-	}
+	} else {
+            // keep the samples the driver already has, the read target is sized on them
+            driver->iop(LIBERA_IOP_CMD_GET_SAMPLES,(void*)&tsamples,sizeof(tsamples));
+        }
+        if((tsamples<=0) && (tmode&LIBERA_IOP_PRIMARY_MODES)){
+            *perr|=LIBERA_ERROR_SWCONFIG;
+            getAttributeCache()->setOutputDomainAsChanged();
+            BC_END_RUNNIG_PROPERTY
+            throw chaos::CException(1, "Invalid number of samples", __FUNCTION__);
+        }
         
          if(data->hasKey("offset")) {
             toffset = data->getInt32Value("offset");
          }
+
+        if(tmode&LIBERA_IOP_MODE_SINGLEPASS) {
+            // not sticky: an acquire without it returns the first shot only
+            int separation = data->hasKey("sp_separation")?data->getInt32Value("sp_separation"):0;
+            if(driver->iop(LIBERA_IOP_CMD_SET_SP_SEPARATION,(void*)&separation,sizeof(separation))!=0){
+                *perr|=LIBERA_ERROR_SWCONFIG;
+                getAttributeCache()->setOutputDomainAsChanged();
+                BC_END_RUNNIG_PROPERTY
+                throw chaos::CException(1, "Invalid single pass separation", __FUNCTION__);
+            }
+        }
+
+        if(tmode&LIBERA_IOP_MODE_DD) {
+            // not sticky: an acquire without it publishes every atom
+            libera_decimation_t dec;
+            dec.factor = data->hasKey("sw_decimation")?data->getInt32Value("sw_decimation"):1;
+            dec.filter = data->hasKey("sw_filter")?data->getInt32Value("sw_filter"):LIBERA_DEC_BOXCAR;
+            if(((int64_t)tsamples*dec.factor>LIBERA_DEC_MAX_INPUT) ||
+               (driver->iop(LIBERA_IOP_CMD_SET_DECIMATION,(void*)&dec,sizeof(dec))!=0)){
+                *perr|=LIBERA_ERROR_SWCONFIG;
+                getAttributeCache()->setOutputDomainAsChanged();
+                BC_END_RUNNIG_PROPERTY
+                throw chaos::CException(1, "Invalid DD software decimation", __FUNCTION__);
+            }
+        }
 	
         if(data->hasKey("loops")) {
             loops = data->getInt32Value("loops");
          }	
 
+        if(data->hasKey("sa_samples")) {
+            tsa_samples = std::min(data->getInt32Value("sa_samples"),LIBERA_SA_RING_SIZE);
+        }
+        if(tsa_samples<=0){
+            tsa_samples=(tmode&LIBERA_IOP_PRIMARY_MODES)?16:std::min(tsamples,LIBERA_SA_RING_SIZE);
+        }
+
          getAttributeCache()->setOutputAttributeNewSize("SA", 0);
          getAttributeCache()->setOutputAttributeNewSize("DD", 0);
          getAttributeCache()->setOutputAttributeNewSize("ADC_CW", 0);
@@ -116,39 +194,40 @@ void driver::daq::libera::CmdLiberaAcquire::setHandler(c_data::CDataWrapper *dat
          if(tmode&LIBERA_IOP_MODE_DD){
              if(tsamples>0){
                 getAttributeCache()->setOutputAttributeNewSize("DD", tsamples*sizeof(libera_dd_t));
+                buffer_attr="DD";
+                atom_size=sizeof(libera_dd_t);
 
-                driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
+                if(set_samples) driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
                 samples=tsamples;
 
              }
-            } else if (tmode&LIBERA_IOP_MODE_SA){
-                if(tsamples>0){
-                    getAttributeCache()->setOutputAttributeNewSize("SA", tsamples*sizeof(libera_sa_t));
-                    driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
-                    samples=tsamples;
-
-                }
             } else if (tmode&LIBERA_IOP_MODE_CONTINUOUS){
                 if(tsamples>0){
                     getAttributeCache()->setOutputAttributeNewSize("ADC_CW", tsamples*sizeof(libera_cw_t));
-                    driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
+                buffer_attr="ADC_CW";
+                atom_size=sizeof(libera_cw_t);
+                    if(set_samples) driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
                     samples=tsamples;
 
                 }
             } else if (tmode&LIBERA_IOP_MODE_SINGLEPASS){
                 if(tsamples>0){
                     getAttributeCache()->setOutputAttributeNewSize("ADC_SP", tsamples*sizeof(libera_sp_t));
-                    driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
+                buffer_attr="ADC_SP";
+                atom_size=sizeof(libera_sp_t);
+                    if(set_samples) driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
                     samples=tsamples;
 
                 }
             } else if (tmode&LIBERA_IOP_MODE_AVG){
                   if(tsamples>0){
-                        getAttributeCache()->setOutputAttributeNewSize("ADC_AVG", tsamples*sizeof(libera_avg_t));
-                       driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
+                        getAttributeCache()->setOutputAttributeNewSize("AVG", tsamples*sizeof(libera_avg_t));
+                        buffer_attr="AVG";
+                        atom_size=sizeof(libera_avg_t);
+                       if(set_samples) driver->iop(LIBERA_IOP_CMD_SET_SAMPLES,(void*)&tsamples,0);
                        samples=tsamples;
                }
-            } else {
+            } else if(!(tmode&LIBERA_IOP_MODE_SA)){
               *perr|=LIBERA_ERROR_SWCONFIG;
               getAttributeCache()->setOutputDomainAsChanged();
               BC_END_RUNNIG_PROPERTY
@@ -162,6 +241,55 @@ void driver::daq::libera::CmdLiberaAcquire::setHandler(c_data::CDataWrapper *dat
         }
        
         
+        pack_layout=NULL;
+        if(tmode&LIBERA_IOP_MODE_PACKED){
+            if(tmode&LIBERA_IOP_MODE_DD){
+                pack_layout=&libera_dd_pack;
+            } else if(tmode&LIBERA_IOP_MODE_CONTINUOUS){
+                pack_layout=&libera_cw_pack;
+            } else if(tmode&LIBERA_IOP_MODE_SINGLEPASS){
+                pack_layout=&libera_sp_pack;
+            }
+        }
+        // resolve the destination attribute once, the driver reads straight into it on every loop
+        acquire_buffer=NULL;
+        acquire_buffer_size=0;
+        if(buffer_attr && pack_layout){
+            // sized on the first packed atoms
+            getAttributeCache()->setOutputAttributeNewSize(buffer_attr, 0);
+            pack_stage.resize(samples*atom_size);
+            acquire_buffer=&pack_stage[0];
+            acquire_buffer_size=samples*atom_size;
+        } else if(buffer_attr){
+            acquire_buffer=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, buffer_attr);
+            acquire_buffer_size=samples*atom_size;
+        } else {
+            // SA only
+            samples=tsa_samples;
+        }
+        sa_buffer=NULL;
+        sa_buffer_size=0;
+        if((tmode&LIBERA_IOP_MODE_SA) && (tmode&LIBERA_IOP_MODE_PACKED)){
+            sa_pack_stage.resize(tsa_samples*sizeof(libera_sa_t));
+            sa_buffer=(libera_sa_t*)&sa_pack_stage[0];
+            sa_buffer_size=tsa_samples*sizeof(libera_sa_t);
+        } else if(tmode&LIBERA_IOP_MODE_SA){
+            getAttributeCache()->setOutputAttributeNewSize("SA", tsa_samples*sizeof(libera_sa_t));
+            sa_buffer=getAttributeCache()->getRWPtr<libera_sa_t>(DOMAIN_OUTPUT, "SA");
+            sa_buffer_size=tsa_samples*sizeof(libera_sa_t);
+            if(sa_buffer==NULL){
+                buffer_attr="SA";
+            }
+        }
+        if((buffer_attr && (acquire_buffer==NULL)) || ((tmode&LIBERA_IOP_MODE_SA) && (sa_buffer==NULL))){
+            CMDCUERR_<<"cannot retrieve dataset \""<<(buffer_attr?buffer_attr:"")<<"\"";
+            *perr|=LIBERA_ERROR_ALLOCATE_DATASET;
+            getAttributeCache()->setOutputDomainAsChanged();
+            BC_END_RUNNIG_PROPERTY
+            throw chaos::CException(1, "Cannot retrieve acquisition dataset", __FUNCTION__);
+        }
+        driver->iop(LIBERA_IOP_CMD_SET_BUFFER,acquire_buffer,acquire_buffer_size);
+
         if((ret=driver->iop(LIBERA_IOP_CMD_ACQUIRE,(void*)&tmode,0))!=0){
             BC_END_RUNNIG_PROPERTY
             throw chaos::CException(ret, "Cannot start acquire", __FUNCTION__);
@@ -181,6 +309,8 @@ void driver::daq::libera::CmdLiberaAcquire::setHandler(c_data::CDataWrapper *dat
          q1 = getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "Q1");
          q2 = getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "Q2");
          psamples=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "SAMPLES");
+         pcount=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "COUNT");
+         psa_count=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "SA_COUNT");
          pmode=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "MODE");
         mt=getAttributeCache()->getRWPtr<uint64_t>(DOMAIN_OUTPUT, "MT");
          st=getAttributeCache()->getRWPtr<uint64_t>(DOMAIN_OUTPUT, "ST");
@@ -188,7 +318,39 @@ void driver::daq::libera::CmdLiberaAcquire::setHandler(c_data::CDataWrapper *dat
          acquire_loops = getAttributeCache()->getRWPtr<int64_t>(DOMAIN_OUTPUT, "ACQUISITION");
          *pmode=mode;
          *psamples=samples;
+         *pcount=0;
+         *psa_count=0;
          *acquire_loops=0;
+
+         lat_stats.reset();
+         for(int stage=0;stage<LIBERA_LAT_STAGES;stage++){
+             for(int figure=0;figure<LIBERA_LAT_FIGURES;figure++){
+                 plat[stage][figure]=getAttributeCache()->getRWPtr<int64_t>(DOMAIN_OUTPUT, libera_latency_attr(stage,figure).c_str());
+                 if(plat[stage][figure])
+                     *plat[stage][figure]=0;
+             }
+         }
+         for(int field=0;field<LIBERA_STATS_FIELDS;field++){
+             pstat_mean[field]=getAttributeCache()->getRWPtr<double>(DOMAIN_OUTPUT, libera_stats_attr(field,LIBERA_STATS_MEAN).c_str());
+             pstat_rms[field]=getAttributeCache()->getRWPtr<double>(DOMAIN_OUTPUT, libera_stats_attr(field,LIBERA_STATS_RMS).c_str());
+             pstat_min[field]=getAttributeCache()->getRWPtr<int64_t>(DOMAIN_OUTPUT, libera_stats_attr(field,LIBERA_STATS_MIN).c_str());
+             pstat_max[field]=getAttributeCache()->getRWPtr<int64_t>(DOMAIN_OUTPUT, libera_stats_attr(field,LIBERA_STATS_MAX).c_str());
+             pstat_p2p[field]=getAttributeCache()->getRWPtr<int64_t>(DOMAIN_OUTPUT, libera_stats_attr(field,LIBERA_STATS_P2P).c_str());
+             if(pstat_mean[field]) *pstat_mean[field]=0;
+             if(pstat_rms[field]) *pstat_rms[field]=0;
+             if(pstat_min[field]) *pstat_min[field]=0;
+             if(pstat_max[field]) *pstat_max[field]=0;
+             if(pstat_p2p[field]) *pstat_p2p[field]=0;
+         }
+         px_wmean=getAttributeCache()->getRWPtr<double>(DOMAIN_OUTPUT, "X_WMEAN");
+         py_wmean=getAttributeCache()->getRWPtr<double>(DOMAIN_OUTPUT, "Y_WMEAN");
+         if(px_wmean) *px_wmean=0;
+         if(py_wmean) *py_wmean=0;
+         plat_hist=getAttributeCache()->getRWPtr<uint32_t>(DOMAIN_OUTPUT, "LAT_HIST");
+         if(plat_hist)
+             memset(plat_hist,0,sizeof(lat_stats.hist));
+         lat_traced=0;
+         getAttributeCache()->setOutputAttributeNewSize("LAT_TRACE", 0);
          getAttributeCache()->setOutputDomainAsChanged();
         CMDCU_<<" start acquiring mode:"<<mode<<" samples:"<<samples<<" offset:"<<offset<<" loops:"<<loops;
          boost::posix_time::ptime start_test = boost::posix_time::microsec_clock::local_time();
@@ -200,6 +362,9 @@ void driver::daq::libera::CmdLiberaAcquire::acquireHandler() {
      boost::posix_time::ptime curr;
      int ret;
      libera_ts_t ts;
+     bool updated=false;
+     bool latency=false; // new data from the primary mode
+     int stop_all=LIBERA_IOP_MODE_SA;
 
     if(acquire_duration !=0){
         curr= boost::posix_time::microsec_clock::local_time();
@@ -223,63 +388,62 @@ void driver::daq::libera::CmdLiberaAcquire::acquireHandler() {
      }
     if(mode&LIBERA_IOP_MODE_DD){
         CMDCUDBG_ << "Acquiring DD";
-        libera_dd_t*pnt=(libera_dd_t*)getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "DD");
-        if(pnt==NULL){
-            CMDCUERR_<<"cannot retrieve dataset \"DD\"";
-            *pmode=0;
-            *perr|=LIBERA_ERROR_ALLOCATE_DATASET;
-
-            getAttributeCache()->setOutputDomainAsChanged();
-            BC_END_RUNNIG_PROPERTY;
-            return;
-        }
-        if((ret=driver->read((void*)pnt,0,samples*sizeof(libera_dd_t)))>=0){
-            
-            *va = pnt[0].Va;
-            *vb = pnt[0].Vb;
-            *vc = pnt[0].Vc;
-            *vd = pnt[0].Vd;
-            *x  = pnt[0].X;
-            *y  = pnt[0].Y;
-            *q  = pnt[0].Q;
-            *sum  = pnt[0].Sum;
+        libera_dd_t*pnt=(libera_dd_t*)acquire_buffer;
+        if((ret=driver->read(NULL,0,0))==0){
+            // triggered: no new buffer completed since last loop
+            CMDCUDBG_ << "no new DD data";
+        } else if(ret>0){
+            updated=true;
+            latency=true;
+            if(mode&LIBERA_IOP_MODE_SOA){
+                // column major, first element of each column
+                *va = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_VA);
+                *vb = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_VB);
+                *vc = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_VC);
+                *vd = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_VD);
+                *x  = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_X);
+                *y  = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_Y);
+                *q  = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_Q);
+                *sum  = *libera_dd_soa_column(pnt,ret,LIBERA_DD_SOA_SUM);
+            } else {
+                *va = pnt[0].Va;
+                *vb = pnt[0].Vb;
+                *vc = pnt[0].Vc;
+                *vd = pnt[0].Vd;
+                *x  = pnt[0].X;
+                *y  = pnt[0].Y;
+                *q  = pnt[0].Q;
+                *sum  = pnt[0].Sum;
+            }
             *q1 = 0;
             *q2 = 0;
-             CMDCUDBG_ << "DD read [ret="<<std::dec<<ret<<"]:"<<pnt[0];
+            *pcount = ret;
+            // computed by the driver along with the transform
+            libera_stats_t stats;
+            if(driver->iop(LIBERA_IOP_CMD_GET_STATS,(void*)&stats,sizeof(stats))==0){
+                update_stats(stats);
+            }
+            if(pack_layout){
+                publish_packed("DD",*pack_layout,pnt,ret);
+            }
+             CMDCUDBG_ << "DD read [ret="<<std::dec<<ret<<"] X:"<<*x<<" Y:"<<*y<<" SUM:"<<*sum;
              (*acquire_loops)++;
         } else {
            *perr|=LIBERA_ERROR_READING;
 
             CMDCUERR_<<"Error reading DD ret:"<<ret<<", mode:"<<mode<<" samples:"<<samples;
         }
-    } else if(mode&LIBERA_IOP_MODE_SA){
-        libera_sa_t*pnt=(libera_sa_t*)getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "SA");
-
-        if((ret=driver->read((void*)pnt,0,samples*sizeof(libera_sa_t)))>=0){
-            *va = pnt[0].Va;
-            *vb = pnt[0].Vb;
-            *vc = pnt[0].Vc;
-            *vd = pnt[0].Vd;
-            *x  = pnt[0].X;
-            *y  = pnt[0].Y;
-            *q  = pnt[0].Q;
-            *sum  = pnt[0].Sum;
-            *q1 = pnt[0].Cx;
-            *q2 = pnt[0].Cy;
-             (*acquire_loops)++;
-             
-            CMDCUDBG_ << "SA read:"<<pnt[0];
-
-        } else {
-             *perr|=LIBERA_ERROR_READING;
-
-            CMDCUERR_<<"Error reading SA ret:"<<ret<<", mode:"<<mode<<" samples:"<<samples;
-        }
     } else if(mode&LIBERA_IOP_MODE_CONTINUOUS){
-         libera_cw_t*pnt=(libera_cw_t*)getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "ADC_CW");
+         libera_cw_t*pnt=(libera_cw_t*)acquire_buffer;
 
-         if(driver->read(pnt,0,samples*sizeof(libera_cw_t))>=0){
+         if((ret=driver->read(NULL,0,0))>=0){
               (*acquire_loops)++;
+              updated=true;
+              latency=(ret>0);
+              if(pack_layout && (ret>0)){
+                  *pcount = ret;
+                  publish_packed("ADC_CW",*pack_layout,pnt,ret);
+              }
               CMDCUDBG_ << "ADC CW read:"<<pnt[0];
 
         } else {
@@ -288,10 +452,17 @@ void driver::daq::libera::CmdLiberaAcquire::acquireHandler() {
             CMDCUERR_<<"Error reading ADC CONTINUOUS, mode:"<<mode<<" samples:"<<samples;
         }
     } else if(mode&LIBERA_IOP_MODE_SINGLEPASS){
-        libera_sp_t*pnt = (libera_sp_t*)getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "ADC_SP");
-         if(driver->read(pnt,0,samples*sizeof(libera_sp_t))>=0){
+        libera_sp_t*pnt = (libera_sp_t*)acquire_buffer;
+         if((ret=driver->read(NULL,0,0))>=0){
               (*acquire_loops)++;
-              CMDCUDBG_ << "ADC SP read:"<<pnt[0];
+              updated=true;
+              latency=(ret>0);
+              // one atom per single pass shot
+              *pcount = ret;
+              if(pack_layout && (ret>0)){
+                  publish_packed("ADC_SP",*pack_layout,pnt,ret);
+              }
+              CMDCUDBG_ << "ADC SP read [shots="<<ret<<"]:"<<pnt[0];
 
         } else {
              *perr|=LIBERA_ERROR_READING;
@@ -299,9 +470,11 @@ void driver::daq::libera::CmdLiberaAcquire::acquireHandler() {
             CMDCUERR_<<"Error reading ADC SINGLE PASS, mode:"<<mode<<" samples:"<<samples;
         }
     } else if(mode&LIBERA_IOP_MODE_AVG){
-        libera_avg_t *pnt=(libera_avg_t *)getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "AVG");
-         if(driver->read(pnt,0,samples*sizeof(libera_avg_t))>=0){
+        libera_avg_t *pnt=(libera_avg_t *)acquire_buffer;
+         if((ret=driver->read(NULL,0,0))>=0){
            (*acquire_loops)++;
+           updated=true;
+           latency=(ret>0);
             CMDCUDBG_ << "AVG read:"<<pnt[0];
 
         } else {
@@ -310,12 +483,54 @@ void driver::daq::libera::CmdLiberaAcquire::acquireHandler() {
             CMDCUERR_<<"Error reading Average, mode:"<<mode<<" samples:"<<samples;
         }
     }
+    if(mode&LIBERA_IOP_MODE_SA){
+        // atoms streamed since last loop, independent of the primary acquisition
+        if((ret=driver->read(sa_buffer,CHANNEL_SA,sa_buffer_size))==0){
+            CMDCUDBG_ << "no new SA data";
+        } else if(ret>0){
+            *psa_count = ret;
+            updated=true;
+            if(mode&LIBERA_IOP_MODE_PACKED){
+                publish_packed("SA",libera_sa_pack,sa_buffer,ret);
+            }
+            if((mode&LIBERA_IOP_PRIMARY_MODES)==0){
+                // scalars from the most recent atom
+                libera_sa_t&last=sa_buffer[ret-1];
+                *pcount = ret;
+                *va = last.Va;
+                *vb = last.Vb;
+                *vc = last.Vc;
+                *vd = last.Vd;
+                *x  = last.X;
+                *y  = last.Y;
+                *q  = last.Q;
+                *sum  = last.Sum;
+                *q1 = last.Cx;
+                *q2 = last.Cy;
+                libera_stats_t stats;
+                libera_sa_stats(sa_buffer,ret,&stats);
+                update_stats(stats);
+                (*acquire_loops)++;
+            }
+            CMDCUDBG_ << "SA read "<<ret<<" atoms, last:"<<sa_buffer[ret-1];
+        } else {
+            *perr|=LIBERA_ERROR_READING;
+
+            CMDCUERR_<<"Error reading SA ret:"<<ret<<", mode:"<<mode;
+        }
+    }
+    if(!updated && (*perr==0) && (loops!=0) && (*pmode!=0)){
+        return;
+    }
+    if(latency){
+        update_latency();
+    }
         
     
     if((loops==0)|| (*pmode==0)){
         int ret;
         CMDCUDBG_ << "Acquiring loop ended after:"<<*acquire_loops<<" acquisitions.";
-        if((ret=driver->iop(LIBERA_IOP_CMD_STOP,0,0))!=0){
+        if((ret=driver->iop(LIBERA_IOP_CMD_STOP,(void*)&stop_all,sizeof(stop_all)))!=0){
              *perr|=LIBERA_ERROR_STOP_ACQUIRE;
         }
         *pmode=0;
@@ -328,7 +543,7 @@ void driver::daq::libera::CmdLiberaAcquire::acquireHandler() {
      
      if(*perr!=0){
        *pmode=0;
-        if((ret=driver->iop(LIBERA_IOP_CMD_STOP,0,0))!=0){
+        if((ret=driver->iop(LIBERA_IOP_CMD_STOP,(void*)&stop_all,sizeof(stop_all)))!=0){
              *perr|=LIBERA_ERROR_STOP_ACQUIRE;
         }
        getAttributeCache()->setOutputDomainAsChanged();
@@ -340,6 +555,66 @@ void driver::daq::libera::CmdLiberaAcquire::acquireHandler() {
 
    
 }
+void driver::daq::libera::CmdLiberaAcquire::update_latency(){
+    libera_latency_t lat;
+    if(driver->iop(LIBERA_IOP_CMD_GET_LATENCY,(void*)&lat,sizeof(lat))!=0){
+        return;
+    }
+    // published by the setOutputDomainAsChanged that follows
+    lat.publish=libera_monotonic_ns();
+    lat_stats.add(*acquire_loops,lat);
+    for(int stage=0;stage<LIBERA_LAT_STAGES;stage++){
+        if(plat[stage][LIBERA_LAT_P50])
+            *plat[stage][LIBERA_LAT_P50]=lat_stats.percentile(stage,0.5);
+        if(plat[stage][LIBERA_LAT_P99])
+            *plat[stage][LIBERA_LAT_P99]=lat_stats.percentile(stage,0.99);
+        if(plat[stage][LIBERA_LAT_MAX])
+            *plat[stage][LIBERA_LAT_MAX]=lat_stats.max[stage];
+    }
+    if(plat_hist)
+        memcpy(plat_hist,lat_stats.hist,sizeof(lat_stats.hist));
+    // the trace grows up to LIBERA_LAT_TRACE_SIZE records, oldest first
+    size_t traced=std::min(lat_stats.traced,(uint64_t)LIBERA_LAT_TRACE_SIZE);
+    if(traced!=lat_traced){
+        getAttributeCache()->setOutputAttributeNewSize("LAT_TRACE", traced*sizeof(libera_latency_trace_t));
+        lat_traced=traced;
+    }
+    libera_latency_trace_t*ptrace=getAttributeCache()->getRWPtr<libera_latency_trace_t>(DOMAIN_OUTPUT, "LAT_TRACE");
+    if(ptrace)
+        lat_stats.get_trace(ptrace);
+    CMDCUDBG_ << "latency total p50:"<<lat_stats.percentile(LIBERA_LAT_TOTAL,0.5)<<" p99:"<<lat_stats.percentile(LIBERA_LAT_TOTAL,0.99)<<" max:"<<lat_stats.max[LIBERA_LAT_TOTAL]<<" ns";
+}
+
+void driver::daq::libera::CmdLiberaAcquire::update_stats(const libera_stats_t& stats){
+    if(stats.count==0){
+        return;
+    }
+    for(int field=0;field<LIBERA_STATS_FIELDS;field++){
+        if(pstat_mean[field]) *pstat_mean[field]=stats.mean[field];
+        if(pstat_rms[field]) *pstat_rms[field]=stats.rms[field];
+        if(pstat_min[field]) *pstat_min[field]=stats.min[field];
+        if(pstat_max[field]) *pstat_max[field]=stats.max[field];
+        if(pstat_p2p[field]) *pstat_p2p[field]=(int64_t)stats.max[field]-stats.min[field];
+    }
+    if(px_wmean) *px_wmean=stats.x_wmean;
+    if(py_wmean) *py_wmean=stats.y_wmean;
+    CMDCUDBG_ << "stats of "<<stats.count<<" atoms X mean:"<<stats.mean[LIBERA_STATS_X]<<" rms:"<<stats.rms[LIBERA_STATS_X]<<" Y mean:"<<stats.mean[LIBERA_STATS_Y]<<" rms:"<<stats.rms[LIBERA_STATS_Y];
+}
+
+void driver::daq::libera::CmdLiberaAcquire::publish_packed(const char* attr,const libera_pack_layout_t& layout,const void* atoms,size_t count){
+    // room for the worst case, then trimmed to the packed size
+    getAttributeCache()->setOutputAttributeNewSize(attr, libera_pack_bound(layout,count));
+    char* out=getAttributeCache()->getRWPtr<char>(DOMAIN_OUTPUT, attr);
+    if(out==NULL){
+        CMDCUERR_<<"cannot retrieve dataset \""<<attr<<"\"";
+        *perr|=LIBERA_ERROR_ALLOCATE_DATASET;
+        return;
+    }
+    size_t size=libera_pack(layout,atoms,count,out);
+    getAttributeCache()->setOutputAttributeNewSize(attr, size);
+    CMDCUDBG_ << attr<<" packed "<<count<<" atoms in "<<size<<" bytes";
+}
+
 //void CmdLiberaAcquire::ccHandler() {
 //	AbstractPowerSupplyCommand::ccHandler();
 //	
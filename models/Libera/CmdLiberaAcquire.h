@@ -33,10 +33,32 @@ namespace driver {
                     int mode,samples,loops,offset;
     
                     int32_t* va,*vb,*vc,*vd,*x,*y,*q,*sum,*q1,*q2;
-                    int32_t* psamples,*pmode,*perr;
+                    int32_t* psamples,*pcount,*pmode,*perr;
                     int64_t*acquire_loops;
                     int acquire_duration;
                     uint64_t start_acquire;
+                    // output attribute buffer resolved once in setHandler and registered as the driver read target
+                    void* acquire_buffer;
+                    int acquire_buffer_size;
+                    // SA stream atoms, filled alongside the primary acquisition
+                    libera_sa_t* sa_buffer;
+                    int sa_buffer_size;
+                    int32_t* psa_count;
+                    // trigger to publish latency of the acquisitions of this command
+                    libera_latency_stats lat_stats;
+                    int64_t* plat[LIBERA_LAT_STAGES][LIBERA_LAT_FIGURES];
+                    uint32_t* plat_hist;
+                    size_t lat_traced;
+                    // LIBERA_IOP_MODE_PACKED: the driver reads into the stages, the attributes get the packed atoms
+                    std::vector<char> pack_stage,sa_pack_stage;
+                    const libera_pack_layout_t* pack_layout;
+                    // statistics of the last atoms
+                    double* pstat_mean[LIBERA_STATS_FIELDS],*pstat_rms[LIBERA_STATS_FIELDS];
+                    int64_t* pstat_min[LIBERA_STATS_FIELDS],*pstat_max[LIBERA_STATS_FIELDS],*pstat_p2p[LIBERA_STATS_FIELDS];
+                    double* px_wmean,*py_wmean;
+                    void update_latency();
+                    void update_stats(const libera_stats_t& stats);
+                    void publish_packed(const char* attr,const libera_pack_layout_t& layout,const void* atoms,size_t count);
 		protected:
 			//implemented handler
 		    //			uint8_t implementedHandler();
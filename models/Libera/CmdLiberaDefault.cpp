@@ -35,6 +35,7 @@ CmdLiberaDefault::CmdLiberaDefault() {
   driver =NULL;
   mt= NULL;
   st=NULL;
+  env_valid=false;
 }
 
 CmdLiberaDefault::~CmdLiberaDefault() {
@@ -72,6 +73,11 @@ void CmdLiberaDefault::setHandler(c_data::CDataWrapper *data) {
         *perr=0;
 	 mt=getAttributeCache()->getRWPtr<uint64_t>(DOMAIN_OUTPUT, "MT");
          st=getAttributeCache()->getRWPtr<uint64_t>(DOMAIN_OUTPUT, "ST");
+        env_attr.resize(libera_env_attrs_size);
+        for(int cnt=0;cnt<libera_env_attrs_size;cnt++){
+            env_attr[cnt]=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, libera_env_attrs[cnt].name);
+        }
+        env_valid=false;
 
 	BC_NORMAL_RUNNIG_PROPERTY
 
@@ -84,18 +90,50 @@ void CmdLiberaDefault::setHandler(c_data::CDataWrapper *data) {
  */
 void CmdLiberaDefault::acquireHandler() {
         libera_ts_t ts;
+        bool changed=false;
 	CMDCUDBG << "Default Acquiring libera status";
-	char * status= getAttributeCache()->getRWPtr<char>(DOMAIN_OUTPUT, "STATUS");
-	if(driver->iop(LIBERA_IOP_CMD_GETENV,status,MAX_STRING)==0){
-            CMDCUDBG<<"STATUS:"<<status;
-        }
         if(driver->iop(LIBERA_IOP_CMD_GET_TS,(void*)&ts,sizeof(ts))==0){
             CMDCUDBG<<"MT:"<<ts.mt<<" ST:"<<ts.st.tv_sec;
-            if(mt)
+            const uint64_t tst=ts.st.tv_sec*1000000ULL + ts.st.tv_nsec/1000;
+            // MT/ST are the heartbeat of the dataset, pushed whenever they advance
+            if(mt && (*mt!=ts.mt)){
                 *mt = ts.mt;
-            if(st)
-                *st=ts.st.tv_sec*1000000 + ts.st.tv_nsec/1000;
+                changed=true;
+            }
+            if(st && (*st!=tst)){
+                *st=tst;
+                changed=true;
+            }
+        }
+        // the environment attributes are written only when they change
+        if(updateEnv()>0){
+            changed=true;
+        }
+        if(changed){
+            getAttributeCache()->setOutputDomainAsChanged();
+        }
+}
+
+int CmdLiberaDefault::updateEnv() {
+        libera_env_params_t env;
+        int changed=0;
+        int ret;
+        if((ret=driver->iop(LIBERA_IOP_CMD_GETENV,&env,sizeof(env)))!=0){
+            CMDCUDBG<<"cannot read environment:"<<ret;
+            return (ret<0)?ret:-ret;
+        }
+        if(env_valid && (memcmp(&env,&env_last,sizeof(env))==0)){
+            return 0;
+        }
+        for(int cnt=0;cnt<(int)env_attr.size();cnt++){
+            const int32_t val=libera_env_value(env,libera_env_attrs[cnt]);
+            if(env_attr[cnt] && (!env_valid || (val!=libera_env_value(env_last,libera_env_attrs[cnt])))){
+                *env_attr[cnt]=val;
+                changed++;
+                CMDCUDBG<<libera_env_attrs[cnt].name<<":"<<val;
+            }
         }
-        getAttributeCache()->setOutputDomainAsChanged();
-	//force output dataset as changed
+        env_last=env;
+        env_valid=true;
+        return changed;
 }
@@ -40,6 +40,15 @@ namespace driver {
                       uint64_t     *st; // system time
                      
                     chaos::cu::driver_manager::driver::BasicIODriverInterface *driver;
+                    // environment attributes (libera_env_attrs) and the values last written
+                    std::vector<int32_t*> env_attr;
+                    libera_env_params_t env_last;
+                    bool env_valid;
+                    /**
+                     read the environment and write the attributes that differ from the last snapshot
+                     \return the number of attributes changed, negative on error
+                     */
+                    int updateEnv();
                 
 			// return the implemented handler
 			uint8_t implementedHandler();
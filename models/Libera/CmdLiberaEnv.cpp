@@ -37,6 +37,8 @@ void driver::daq::libera::CmdLiberaEnv::setHandler(c_data::CDataWrapper *data) {
 //        setFeatures(features::FeaturesFlagTypes::FF_SET_SCHEDULER_DELAY, (uint64_t)1000000);
 
         
+        // all the parameters of the command are applied by the driver in one call
+        std::vector<libera_env_t> envs;
 #define ADD_ENV_PARAM(param) \
 CMDCUDBG_<<"checking environment "<< # param; \
         if(data->hasKey(# param )) {\
@@ -44,13 +46,7 @@ CMDCUDBG_<<"checking environment "<< # param; \
             env.value = data->getInt64Value(# param);\
             env.selector=CSPI_ENV_## param;\
             CMDCUDBG_<<"Setting env \""<< # param <<"\" ("<<std::hex<<env.selector<<dec<<")="<<env.value ;\
-            if((ret=driver->iop(LIBERA_IOP_CMD_SETENV,&env,sizeof(libera_env_t)))!=0){\
-                *perr|=LIBERA_ERROR_SETTING_ENV;\
-                getAttributeCache()->setOutputDomainAsChanged();\
-                BC_END_RUNNIG_PROPERTY;\
-                throw chaos::CException(ret, "Cannot set environment", __FUNCTION__);\
-            }\
-            CMDCUDBG_<<"Sucessfully applied \""<< # param <<"\" ("<<std::hex<<env.selector<<dec<<")="<<env.value ;\
+            envs.push_back(env);\
 	}
         
         perr=getAttributeCache()->getRWPtr<int32_t>(DOMAIN_OUTPUT, "error");
@@ -94,9 +90,16 @@ CMDCUDBG_<<"checking environment "<< # param; \
         ADD_ENV_PARAM(SR);
         ADD_ENV_PARAM(SP);
         
-        char * status= getAttributeCache()->getRWPtr<char>(DOMAIN_OUTPUT, "STATUS");
-	if(driver->iop(LIBERA_IOP_CMD_GETENV,status,MAX_STRING)==0){
-            CMDCUDBG_<<"STATUS:"<<status;
+        if(envs.size()){
+            if((ret=driver->iop(LIBERA_IOP_CMD_SETENV,&envs[0],envs.size()*sizeof(libera_env_t)))!=0){
+                *perr|=LIBERA_ERROR_SETTING_ENV;
+                getAttributeCache()->setOutputDomainAsChanged();
+                BC_END_RUNNIG_PROPERTY;
+                throw chaos::CException(ret, "Cannot set environment", __FUNCTION__);
+            }
+            CMDCUDBG_<<"Sucessfully applied "<<envs.size()<<" environment parameters";
+        }
+        if(updateEnv()>0){
             getAttributeCache()->setOutputDomainAsChanged();
         }
         BC_END_RUNNIG_PROPERTY;
@@ -20,6 +20,7 @@ limitations under the License.
 
 #define ILK_PARAMCOUNT 8
 #include <chaos/cu_toolkit/driver_manager/driver/AbstractDriverPlugin.h>
+#include "models/Libera/cspi/pool.h"
 
 #include <boost/lexical_cast.hpp>
 
@@ -64,24 +65,64 @@ int LiberaBrillianceCSPIDriver::read_libera(liberaData_t *data,int size){
     
 }
 */
-static volatile size_t _event_id = 0;
-static pthread_cond_t eventc = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t eventm = PTHREAD_MUTEX_INITIALIZER;
-
-int event_callback(CSPI_EVENT *p)
+int LiberaBrillianceCSPIDriver::event_callback(CSPI_EVENT *p)
 {
-	_event_id = p->hdr.id;
-        LiberaBrillianceCSPILDBG_<<"Trigger Event arised:"<<_event_id;
-	pthread_cond_signal(&eventc);
+	LiberaBrillianceCSPIDriver* drv = (LiberaBrillianceCSPIDriver*)p->user_data;
+	libera_event_rec_t ev;
+
+	// non zero: the event goes on to the connections of the other drivers
+	if(drv==NULL)
+		return 1;
+	ev.id = p->hdr.id;
+	ev.param = p->hdr.param;
+	clock_gettime(CLOCK_MONOTONIC,&ev.ts);
+	if(drv->events.push(ev)){
+		sem_post(&drv->event_sem);
+	}
 
-	return 0;
+	return 1;
 }
 //GET_PLUGIN_CLASS_DEFINITION
 //we need to define the driver with alias version and a class that implement it
 //default constructor definition
 LiberaBrillianceCSPIDriver::LiberaBrillianceCSPIDriver() {
-    int rc;
     cfg.operation =liberaconfig::deinit;
+    env_handle = 0;
+    con_handle = 0;
+    memset(mode_con,0,sizeof(mode_con));
+    memset(mode_connected,0,sizeof(mode_connected));
+    memset(mode_events,0,sizeof(mode_events));
+    read_buffer = NULL;
+    read_buffer_size = 0;
+    acq_run = false;
+    acq_started = false;
+    acq_buf[0] = acq_buf[1] = NULL;
+    acq_nread[0] = acq_nread[1] = 0;
+    memset(acq_lat,0,sizeof(acq_lat));
+    memset(&last_lat,0,sizeof(last_lat));
+    memset(acq_stats,0,sizeof(acq_stats));
+    memset(&last_stats,0,sizeof(last_stats));
+    memset(acq_ts,0,sizeof(acq_ts));
+    memset(&last_ts,0,sizeof(last_ts));
+    acq_buf_size = 0;
+    dec_buf = NULL;
+    dec_buf_size = 0;
+    acq_write = 0;
+    acq_ready = -1;
+    acq_err = 0;
+    acq_completed = 0;
+    acq_overwritten = 0;
+    sa_con = 0;
+    sa_connected = false;
+    sa_run = false;
+    sa_started = false;
+    sa_ring = NULL;
+    sa_head = sa_tail = sa_dropped = 0;
+    sa_err = 0;
+    pthread_mutex_init(&acq_mutex,NULL);
+    pthread_mutex_init(&sa_mutex,NULL);
+    sem_init(&event_sem,0,0);
+    memset(&last_trigger,0,sizeof(last_trigger));
 /*
     if((rc=initIO(0,0))!=0){
         throw chaos::CException(rc,"Initializing","LiberaBrillianceCSPIDriver::LiberaBrillianceCSPIDriver");    
@@ -89,206 +130,379 @@ LiberaBrillianceCSPIDriver::LiberaBrillianceCSPIDriver() {
  */
 }
 
-
-std::stringstream& operator<<(std::stringstream& os, const CSPI_ENVPARAMS& obj){
-	const size_t tab = 17;
-	const char* labels[] = {
-		"Kx [nm]", "Ky [nm]",
-		"Xoffset [nm]", "Yoffset [nm]", "Qoffset [nm]",
-		"Switches",
-		"Level [dBm]",
-		"AGC",
-		"DSC",
-		//"Interlock",
-		0
-	};
-
-	const int *p = reinterpret_cast<const int*>(&obj);
-
-	// Health
-	os << std::setw(tab) << "Temp [C]" << ": ";
-	os << *p++ << std::endl;
-
-	os << std::setw(tab) << "Fans [rpm]" << ": ";
-	os << *p++ << " " << *p++ << std::endl;
-
-	os << std::setw(tab) << "Voltages [mV]" << ": ";
-
-	for (size_t i=0; i<8; ++i) {
-		os << *p++ << " ";
-	}
-	os << std::endl;
-
-	os << std::setw(tab) << "SC PLL" << ": ";
-	os << (*p++ ? "locked" : "unlocked") << std::endl;
-
-	os << std::setw(tab) << "MC PLL" << ": ";
-	os << (*p++ ? "locked" : "unlocked") << std::endl;
-
-	// TRIGmode
-	os << std::setw(tab) << "TRIGmode" << ": ";
-	os << *p++ << std::endl;
-
-	// Feature registers
-	os << std::setw(tab) << "Feature" << ": 0x";
-	os << std::hex << std::setfill('0');
-	os << std::setw(8) << *p++ << " 0x";
-	unsigned long feature = *p++;
-	os << std::setw(8) << feature;
-	os << std::dec << std::setfill(' ') ;
-	if ( LIBERA_IS_BRILLIANCE(feature) )
-		os << ", Brilliance";
-	if ( LIBERA_IS_GBETHERNET(feature) ) {
-		os << ", GbE";
-		if ( LIBERA_IS_GBE_DEMO(feature) )
-			os << "_demo";
-	}
-	if ( LIBERA_IS_DESY_MOLEX(feature) )
-		os << ", Desy Molex";
-	if ( LIBERA_IS_GROUPING(feature) )
-		os << ", Grouping (RIO)";
-	if ( LIBERA_IS_MAF(feature) )
-		os << ", MAF";
-	if ( LIBERA_IS_DCC(feature) )
-		os << ", Communication Controller";
-	os << std::endl;
-	// From Kx/y on
-	for (size_t i=0; labels[i]; ++i) {
-		os << std::setw(tab) << labels[i] << ": " << *p++ << std::endl;
-	}
-
-	os << std::setw(tab) << "Interlock" << ": ";
-	const int *q = p + ILK_PARAMCOUNT - 1;
-
-	std::copy(p, q, std::ostream_iterator<int>(std::cout," "));
-	os << *q << std::endl;
-	p += ILK_PARAMCOUNT;
-
-	os << std::setw(tab) << "InterlockStatus" << ": ";
-	unsigned long ilkStatus = *p++;
-	os << ilkStatus;
-	if ( INTERLOCK_XPOSITION(ilkStatus) )
-			os << ", X pos";
-	if ( INTERLOCK_YPOSITION(ilkStatus) )
-			os << ", Y pos";
-	if ( INTERLOCK_ATT_LIMIT(ilkStatus) )
-			os << ", attenuator limit";
-	if ( INTERLOCK_ADC_OVERFLOW(ilkStatus) )
-			os << ", ADC overflow";
-	if ( INTERLOCK_ADC_NOT_FILTERED(ilkStatus) )
-			os << ", ADC not filtered";
-	os << std::endl;
-	os << std::setw(tab) << "PostMortem" << ": ";
-	os << obj.pm.mode << " ";
-	os << obj.pm.min_x_limit << " ";
-	os << obj.pm.max_x_limit << " ";
-	os << obj.pm.min_y_limit << " ";
-	os << obj.pm.max_y_limit << " ";
-	os << obj.pm.overflow_limit << " ";
-	os << obj.pm.overflow_dur << " ";
-	os << std::endl;
-	os << std::setw(tab) << "PMoffset, PMdec" << ": ";
-	os << *p++ << ", ";
-	os << *p++ << std::endl;
-	os << std::setw(tab) << "TrigDelay" << ": ";
-	os << *p++ << std::endl;
-
-	os << std::setw(tab) << "ExternalSwitching" << ": ";
-	os << (*p++ ? "external" : "internal") << std::endl;
-	os << std::setw(tab) << "SwitchingDelay" << ": ";
-	os << *p++ << std::endl;
-
-	if ( LIBERA_IS_MAF(feature) ) {
-		os << std::setw(tab) << "MAF Length, Delay" << ": ";
-		os << obj.ddc_maflength << ", " << obj.ddc_mafdelay << std::endl;
-	}
-
-	const mt_status_t& mt_stat = obj.pll_status.mt_stat;
-	const st_status_t& st_stat = obj.pll_status.st_stat;
-
-	os << std::setw(tab) << "MT controller" << ": ";
-	os << "RtmSts= " << mt_stat.status << " "
-	<< "OffsTune= " << mt_stat.vcxo_offset << " "
-	<< "CompTune= " << (mt_stat.nco_shift ? "yes":"no") << " "
-	<< std::endl;
-	os << std::setw(tab) << "ST controller" << ": ";
-	os << "RtmSts= " << st_stat.status << " "
-	<< std::endl;
-
-	os << std::setw(tab) << "SpikeRemoval" << ": ";
-	os << obj.sr.enable << " ";
-	os << obj.sr.cspi_enable << " ";
-	os << obj.sr.averaging_stop << " ";
-	os << obj.sr.average_window << " ";
-	os << obj.sr.start << " ";
-	os << obj.sr.window << " ";
-	os << std::endl;
-
-	os << std::setw(tab) << "SinglePass" << ": ";
-	os << obj.sp.threshold << " ";
-	os << obj.sp.n_before << " ";
-	os << obj.sp.n_after << " ";
-	os << std::endl;
-
-	os << std::setw(tab) << "MaxADC" << ": ";
-	os << obj.max_adc << " "	<< std::endl;
-
-	return os ;
-}
-
 //default descrutcor
 
 LiberaBrillianceCSPIDriver::~LiberaBrillianceCSPIDriver() {
   deinitIO();  
+  pool_free(sa_ring,LIBERA_SA_RING_SIZE*sizeof(CSPI_SA_ATOM));
+  pthread_mutex_destroy(&acq_mutex);
+  pthread_mutex_destroy(&sa_mutex);
+  sem_destroy(&event_sem);
 }
 int LiberaBrillianceCSPIDriver::wait_trigger(){
     	int rc = 0;
-	struct timeval  now;
 	struct timespec timeout;
+	libera_event_rec_t ev;
+
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_sec += 30;
+	while(1){
+		// drain pending events, the ring is never locked
+		while(events.pop(ev)){
+			if(CSPI_EVENT_TRIGGET == ev.id){
+				last_trigger = ev;
+				return 0;
+			}
+		}
+		if(acq_started && !acq_run){
+			return -1;
+		}
+                LiberaBrillianceCSPILDBG_<<" waiting Trigger";
+		rc = sem_timedwait(&event_sem, &timeout);
+		if((rc!=0) && (errno==ETIMEDOUT)){
+			LiberaBrillianceCSPILERR_<<"trigger timeout, dropped events:"<<events.dropped;
+			return ETIMEDOUT;
+		}
+	}
+        return 0;
+}
+int LiberaBrillianceCSPIDriver::read_atoms(void*buffer,size_t count,size_t*nread,libera_latency_t*lat,libera_stats_t*stats){
+    void* dest = buffer;
+    const bool decimate = (cfg.mode==CSPI_MODE_DD) && dd_dec.enabled();
+    if(decimate){
+        // count decimated atoms from factor times the transformed atoms
+        count*=dd_dec.cfg.factor;
+        if(dec_buf_size<count*sizeof(libera_dd_t)){
+            pool_free(dec_buf,dec_buf_size);
+            dec_buf=(char*)pool_malloc(count*sizeof(libera_dd_t));
+            dec_buf_size=(dec_buf)?count*sizeof(libera_dd_t):0;
+            if(dec_buf==NULL){
+                LiberaBrillianceCSPILERR_<<"Cannot allocate decimation buffer of:"<<count*sizeof(libera_dd_t)<<" bytes";
+                return -100;
+            }
+        }
+        dest = dec_buf;
+    }
+    int rc = (cfg.mask & liberaconfig::want_trigger) ? CSPI_SEEK_TR : CSPI_SEEK_MT;
+    // Allways seek(), not just the first time.
+    rc = cspi_seek(con_handle, &cfg.dd.offset, rc);
+    lat->seek = libera_monotonic_ns();
+    if (CSPI_OK != rc) {
+        LiberaBrillianceCSPILERR_<<"Error seeking"<<rc;
+        return rc;
+    }
+    rc=cspi_read(con_handle,dest,count,nread);
+    lat->read = libera_monotonic_ns();
+    if (CSPI_OK != rc) {
+        LiberaBrillianceCSPILERR_<<"Error reading"<<rc;
+        return rc;
+    }
+    CSPI_CONPARAMS op;
+    lat->transform = (cspi_getconparam(con_handle,&op,CSPI_CON_OPTIME)==CSPI_OK)?op.op_time:0;
+    if(cfg.mode==CSPI_MODE_DD){
+        // right after the transform, while the atoms are still in cache
+        if(decimate){
+            *nread = dd_dec.run((libera_dd_t*)dec_buf,(libera_dd_t*)buffer,*nread);
+        }
+        libera_dd_stats((const libera_dd_t*)buffer,*nread,stats);
+        const uint64_t now = libera_monotonic_ns();
+        lat->transform += now - lat->read;
+        lat->read = now;
+    } else {
+        stats->count = 0;
+    }
+    return 0;
+}
 
+void* LiberaBrillianceCSPIDriver::acquire_thread(void*arg){
+    ((LiberaBrillianceCSPIDriver*)arg)->acquire_loop();
+    return NULL;
+}
 
-	do {
+void LiberaBrillianceCSPIDriver::acquire_loop(){
+    LiberaBrillianceCSPILDBG_<<"acquisition thread started, atoms:"<<cfg.atom_count;
+    while(acq_run){
+        size_t nread=0;
+        int rc;
+        if(wait_trigger()!=0){
+            // timeout, keep waiting
+            continue;
+        }
+        if(!acq_run)
+            break;
+        // acq_write is never the buffer handed over by read(), fill it without locking
+        libera_latency_t& lat = acq_lat[acq_write];
+        memset(&lat,0,sizeof(lat));
+        lat.wakeup = libera_monotonic_ns();
+        lat.trigger = (uint64_t)last_trigger.ts.tv_sec*1000000000ULL + last_trigger.ts.tv_nsec;
+        rc = read_atoms(acq_buf[acq_write],cfg.atom_count,&nread,&lat,&acq_stats[acq_write]);
+        // MT/ST of this buffer, ADC modes have none
+        if((rc!=0) || (cspi_gettimestamp(con_handle,&acq_ts[acq_write])!=CSPI_OK)){
+            memset(&acq_ts[acq_write],0,sizeof(CSPI_TIMESTAMP));
+        }
+        pthread_mutex_lock(&acq_mutex);
+        if(rc!=0){
+            acq_err = rc;
+        } else {
+            if(acq_ready>=0)
+                acq_overwritten++;
+            acq_nread[acq_write] = nread;
+            acq_ready = acq_write;
+            acq_write ^= 1;
+            acq_completed++;
+        }
+        pthread_mutex_unlock(&acq_mutex);
+    }
+    LiberaBrillianceCSPILDBG_<<"acquisition thread exiting, completed:"<<acq_completed<<" overwritten:"<<acq_overwritten<<" dropped events:"<<events.dropped;
+    POOL_STATS ps;
+    pool_getstats(&ps);
+    LiberaBrillianceCSPILDBG_<<"memory pool hits:"<<ps.hits<<" misses:"<<ps.misses<<" oversize:"<<ps.oversize<<" in use:"<<ps.in_use<<" high water:"<<ps.high_water<<" pooled:"<<ps.pooled<<" released:"<<ps.released;
+}
 
-		gettimeofday( &now, 0 );
-		timeout.tv_sec = now.tv_sec + 30;
-		timeout.tv_nsec = now.tv_usec * 1000;
-                LiberaBrillianceCSPILDBG_<<" waiting Trigger";
-                pthread_mutex_lock(&eventm);
-		rc = pthread_cond_timedwait( &eventc, &eventm, &timeout );
-                pthread_mutex_unlock(&eventm);
+int LiberaBrillianceCSPIDriver::alloc_acq_buffers(size_t size){
+    if(acq_buf_size<size){
+        pool_free(acq_buf[0],acq_buf_size);
+        pool_free(acq_buf[1],acq_buf_size);
+        acq_buf[0]=(char*)pool_malloc(size);
+        acq_buf[1]=(char*)pool_malloc(size);
+        acq_buf_size = size;
+        if((acq_buf[0]==NULL)||(acq_buf[1]==NULL)){
+            LiberaBrillianceCSPILERR_<<"Cannot allocate acquisition buffer of:"<<size<<" bytes";
+            pool_free(acq_buf[0],size);
+            pool_free(acq_buf[1],size);
+            acq_buf[0]=acq_buf[1]=NULL;
+            acq_buf_size = 0;
+            return -100;
+        }
+    }
+    return 0;
+}
 
-                LiberaBrillianceCSPILDBG_<<" exit wait stat:"<<rc;
-	} while((0 == rc) && (CSPI_EVENT_TRIGGET != _event_id));
+// back to the pool, deinitIO trims it afterwards
+void LiberaBrillianceCSPIDriver::free_acq_buffers(){
+    pool_free(acq_buf[0],acq_buf_size);
+    pool_free(acq_buf[1],acq_buf_size);
+    acq_buf[0]=acq_buf[1]=NULL;
+    acq_buf_size = 0;
+    pool_free(dec_buf,dec_buf_size);
+    dec_buf = NULL;
+    dec_buf_size = 0;
+}
 
+int LiberaBrillianceCSPIDriver::start_acquire_thread(){
+    int rc;
+    if((rc=alloc_acq_buffers(cfg.atom_count*cfg.datasize))!=0){
+        return rc;
+    }
+    acq_write = 0;
+    acq_ready = -1;
+    acq_err = 0;
+    memset(&last_ts,0,sizeof(last_ts));
+    acq_completed = 0;
+    acq_overwritten = 0;
+    acq_run = true;
+    if(pthread_create(&acq_thread,NULL,acquire_thread,this)!=0){
+        acq_run = false;
+        LiberaBrillianceCSPILERR_<<"Cannot create acquisition thread";
+        return -101;
+    }
+    acq_started = true;
+    return 0;
+}
 
-	if (ETIMEDOUT==rc) {
-            LiberaBrillianceCSPILERR_<<"trigger timeout:"<<rc;
-            return rc;
+int LiberaBrillianceCSPIDriver::stop_acquire_thread(){
+    if(!acq_started)
+        return 0;
+    acq_run = false;
+    // wake up the thread if waiting for a trigger
+    sem_post(&event_sem);
+    pthread_join(acq_thread,NULL);
+    acq_started = false;
+    return 0;
+}
 
+void* LiberaBrillianceCSPIDriver::sa_stream_thread(void*arg){
+    ((LiberaBrillianceCSPIDriver*)arg)->sa_stream_loop();
+    return NULL;
+}
+
+void LiberaBrillianceCSPIDriver::sa_stream_loop(){
+    CSPI_SA_ATOM atoms[LIBERA_SA_BATCH];
+    LiberaBrillianceCSPILDBG_<<"SA stream thread started";
+    while(sa_run){
+        size_t nread=0,ready=0;
+        // waits for the next SA atom (10 Hz) no longer than LIBERA_SA_POLL_MS,
+        // so that stop_sa_stream does not hang when no atom flows
+        int rc = cspi_poll(sa_con,LIBERA_SA_POLL_MS,&ready);
+        if((rc==CSPI_OK) && !ready)
+            continue;
+        // the connection is nonblocking, drains what is queued
+        if(rc==CSPI_OK)
+            rc = cspi_get_ex(sa_con,atoms,LIBERA_SA_BATCH,&nread);
+        pthread_mutex_lock(&sa_mutex);
+        if(rc!=CSPI_OK){
+            sa_err = rc;
+        } else {
+            for(size_t cnt=0;cnt<nread;cnt++){
+                sa_ring[(sa_head++)&(LIBERA_SA_RING_SIZE-1)] = atoms[cnt];
+            }
+            if((sa_head-sa_tail)>LIBERA_SA_RING_SIZE){
+                sa_dropped += (sa_head-sa_tail)-LIBERA_SA_RING_SIZE;
+                sa_tail = sa_head-LIBERA_SA_RING_SIZE;
+            }
+        }
+        pthread_mutex_unlock(&sa_mutex);
+        if(rc!=CSPI_OK){
+            LiberaBrillianceCSPILERR_<<"Error reading SA stream:"<<rc;
+            usleep(100000);
         }
+    }
+    LiberaBrillianceCSPILDBG_<<"SA stream thread exiting, atoms:"<<sa_head<<" dropped:"<<sa_dropped;
+}
+
+int LiberaBrillianceCSPIDriver::start_sa_stream(){
+    int rc;
+    if(sa_started)
         return 0;
+    if(sa_ring==NULL){
+        sa_ring = (CSPI_SA_ATOM*)pool_malloc(LIBERA_SA_RING_SIZE*sizeof(CSPI_SA_ATOM));
+        if(sa_ring==NULL){
+            LiberaBrillianceCSPILERR_<<"Cannot allocate SA stream buffer";
+            return -100;
+        }
+    }
+    if(sa_con==0){
+        if((rc=cspi_allochandle(CSPI_HANDLE_CON, env_handle, &sa_con))!=CSPI_OK){
+            LiberaBrillianceCSPILERR_<<"Cannot allocate CSPI connection resources for SA stream";
+            sa_con=0;
+            return rc;
+        }
+    }
+    if(!sa_connected){
+        CSPI_CONPARAMS sa_p;
+        sa_p.mode = CSPI_MODE_SA;
+        if((rc=cspi_setconparam(sa_con, &sa_p, CSPI_CON_MODE))!=CSPI_OK){
+            LiberaBrillianceCSPILERR_<<"Error setting SA stream connection parameters:"<<rc;
+            return rc;
+        }
+        if((rc=cspi_connect(sa_con))!=CSPI_OK){
+            LiberaBrillianceCSPILERR_<<"Error connecting SA stream:"<<rc;
+            return rc;
+        }
+        sa_connected = true;
+        // the stream thread waits with cspi_poll, reads must not block
+        CSPI_CONPARAMS_EBPP sa_nb;
+        sa_nb.nonblock = 1;
+        if((rc=cspi_setconparam(sa_con, (CSPI_CONPARAMS*)&sa_nb, CSPI_CON_SANONBLOCK))!=CSPI_OK){
+            LiberaBrillianceCSPILERR_<<"Error setting SA stream nonblocking:"<<rc;
+            cspi_disconnect(sa_con);
+            sa_connected = false;
+            return rc;
+        }
+    }
+    sa_head = sa_tail = sa_dropped = 0;
+    sa_err = 0;
+    sa_run = true;
+    if(pthread_create(&sa_thread,NULL,sa_stream_thread,this)!=0){
+        sa_run = false;
+        LiberaBrillianceCSPILERR_<<"Cannot create SA stream thread";
+        return -101;
+    }
+    sa_started = true;
+    return 0;
 }
+
+int LiberaBrillianceCSPIDriver::stop_sa_stream(){
+    if(sa_started){
+        sa_run = false;
+        // the thread returns within LIBERA_SA_POLL_MS
+        pthread_join(sa_thread,NULL);
+        sa_started = false;
+    }
+    // the SA device would keep queueing atoms while nobody reads them
+    if(sa_connected){
+        cspi_disconnect(sa_con);
+        sa_connected = false;
+    }
+    return 0;
+}
+
+int LiberaBrillianceCSPIDriver::read_sa(void*buffer,int bcount){
+    int ret;
+    pthread_mutex_lock(&sa_mutex);
+    if(sa_err){
+        ret = -sa_err;
+        sa_err = 0;
+    } else {
+        // the most recent atoms that fit the buffer, older ones are dropped
+        uint64_t avail = sa_head-sa_tail;
+        uint64_t n = std::min(avail,(uint64_t)(bcount/sizeof(CSPI_SA_ATOM)));
+        sa_dropped += avail-n;
+        sa_tail = sa_head-n;
+        CSPI_SA_ATOM*dst=(CSPI_SA_ATOM*)buffer;
+        for(ret=0;sa_tail<sa_head;ret++){
+            dst[ret] = sa_ring[(sa_tail++)&(LIBERA_SA_RING_SIZE-1)];
+        }
+    }
+    pthread_mutex_unlock(&sa_mutex);
+    return ret;
+}
+
 int LiberaBrillianceCSPIDriver::read(void *buffer, int addr, int bcount) {
   	int rc;
-	// Allways seek(), not just the first time.
+        if(addr==CHANNEL_SA){
+            // SA stream, independent of the current acquisition
+            if((buffer==NULL) || !sa_started){
+                return (buffer==NULL)?-1:0;
+            }
+            return read_sa(buffer,bcount);
+        }
+        if(buffer==NULL){
+            // read straight into the registered buffer (i.e. the CU attribute)
+            buffer = read_buffer;
+            bcount = read_buffer_size;
+            if(buffer==NULL){
+                LiberaBrillianceCSPILERR_<<"no destination buffer registered";
+                return -1;
+            }
+        }
          if((cfg.operation == liberaconfig::acquire)&& (cfg.datasize>0)){
           size_t nread=0; //initialize variable to 0
           
+          if(acq_started){
+              // hand over the last buffer completed by the acquisition thread, copied:
+              // the thread cannot fill the registered buffer while the caller publishes it
+              int ret=0;
+              pthread_mutex_lock(&acq_mutex);
+              if(acq_err){
+                  ret = -acq_err;
+                  acq_err = 0;
+              } else if(acq_ready>=0){
+                  size_t size = std::min((size_t)bcount,acq_nread[acq_ready]*cfg.datasize);
+                  ret = size/cfg.datasize;
+                  if(cfg.mask & liberaconfig::want_soa){
+                      libera_dd_to_soa((libera_dd_t*)acq_buf[acq_ready],(int32_t*)buffer,ret);
+                  } else {
+                      memcpy(buffer,acq_buf[acq_ready],size);
+                  }
+                  last_lat = acq_lat[acq_ready];
+                  last_stats = acq_stats[acq_ready];
+                  last_ts = acq_ts[acq_ready];
+                  acq_ready = -1;
+              }
+              pthread_mutex_unlock(&acq_mutex);
+              return ret;
+          }
+          memset(&last_lat,0,sizeof(last_lat));
           if (cfg.mask & liberaconfig::want_trigger) {
 	    if((rc=wait_trigger())!=0){
                 LiberaBrillianceCSPILERR_<<"Error waiting trigger:"<<rc;
 
                 return -rc;
             }
+            last_lat.trigger = (uint64_t)last_trigger.ts.tv_sec*1000000000ULL + last_trigger.ts.tv_nsec;
           }
-          if(cfg.mode ==CSPI_MODE_SA){
-              rc= cspi_get(con_handle,buffer);
-               if (CSPI_OK != rc) {
-                     LiberaBrillianceCSPILERR_<<"Error reading"<<rc;
-                     return -rc;
-               }
-              return 1;
-          }
+          last_lat.wakeup = libera_monotonic_ns();
           if(bcount<(cfg.atom_count*cfg.datasize)){
               LiberaBrillianceCSPILERR_<<"POSSIBLE error, buffer is smaller than required"<<rc;
           }
@@ -296,18 +510,19 @@ int LiberaBrillianceCSPIDriver::read(void *buffer, int addr, int bcount) {
           
           
           
-	  rc = (cfg.mask & liberaconfig::want_trigger) ? CSPI_SEEK_TR : CSPI_SEEK_MT;
-              
 	  if(addr==CHANNEL_DD){
-            //  LiberaBrillianceCSPILDBG_ << "DD seeeking off: "<<std::dec<<cfg.dd.offset<<" tr:"<<rc;
-	    rc = cspi_seek(con_handle, &cfg.dd.offset, rc);
-	    if (CSPI_OK != rc) {
-	      LiberaBrillianceCSPILERR_<<"Error seeking"<<rc;
-	      return -rc;
+	    if(cfg.mask & liberaconfig::want_soa){
+	      // read row major in the (idle) acquisition buffer, then transpose
+	      if((rc=alloc_acq_buffers(count*cfg.datasize))!=0){
+	        return rc;
+	      }
+	      if((rc=read_atoms(acq_buf[0],count,&nread,&last_lat,&last_stats))!=0){
+	        return -rc;
+	      }
+	      libera_dd_to_soa((libera_dd_t*)acq_buf[0],(int32_t*)buffer,nread);
+	      return nread;
 	    }
-	    rc=cspi_read(con_handle,buffer,count,&nread);
-	    if (CSPI_OK != rc) {
-	      LiberaBrillianceCSPILERR_<<"Error reading"<<rc;
+	    if((rc=read_atoms(buffer,count,&nread,&last_lat,&last_stats))!=0){
 	      return -rc;
 	    }
 	    return nread;
@@ -396,6 +611,7 @@ int LiberaBrillianceCSPIDriver::initIO(void *buffer, int sizeb) {
 
     ep.trig_mode = CSPI_TRIGMODE_GET;
      
+    lib.superuser = 1;
     cspi_setlibparam(&lib, CSPI_LIB_SUPERUSER);
     int rc = cspi_allochandle(CSPI_HANDLE_ENV, 0, &env_handle);
     if (CSPI_OK != rc) {
@@ -407,25 +623,142 @@ int LiberaBrillianceCSPIDriver::initIO(void *buffer, int sizeb) {
         LiberaBrillianceCSPILERR_<<"Cannot set env";
         return rc;
     }
-    rc = cspi_allochandle(CSPI_HANDLE_CON, env_handle, &con_handle);
-    
-    if (CSPI_OK != rc) {
-        LiberaBrillianceCSPILERR_<<"Cannot allocate CSPI connection resources";    
-        return rc;
+    // connections are allocated per mode on the first acquire
+    con_handle = 0;
+    return 0;
+}
+
+// device node of a CSPI mode, modes sharing a node are not kept connected together
+static size_t mode_device(size_t mode){
+    switch(mode){
+        case CSPI_MODE_AVERAGE:
+            return CSPI_MODE_DD;
+        case CSPI_MODE_ADC_CW:
+        case CSPI_MODE_ADC_SP:
+        case CSPI_MODE_ADC_SP_ROT:
+            return CSPI_MODE_ADC;
+    }
+    return mode;
+}
+
+int LiberaBrillianceCSPIDriver::select_connection(size_t mode,CSPI_BITMASK event_mask){
+    int rc;
+    if((mode==CSPI_MODE_UNKNOWN) || (mode>=LIBERA_MODE_LAST)){
+        LiberaBrillianceCSPILERR_<<"Invalid connection mode:"<<mode;
+        return CSPI_E_INVALID_MODE;
+    }
+    if(mode_con[mode]==0){
+        if((rc=cspi_allochandle(CSPI_HANDLE_CON, env_handle, &mode_con[mode]))!=CSPI_OK){
+            LiberaBrillianceCSPILERR_<<"Cannot allocate CSPI connection resources for mode:"<<mode;
+            mode_con[mode]=0;
+            return rc;
+        }
+        mode_connected[mode]=false;
+    }
+    con_handle = mode_con[mode];
+
+    CSPI_BITMASK param_mask = 0;
+    if(!mode_connected[mode]){
+        param_mask = CSPI_CON_MODE;
+        if (event_mask) param_mask |= (CSPI_CON_HANDLER|CSPI_CON_USERDATA|CSPI_CON_EVENTMASK);
+    } else if(event_mask!=mode_events[mode]){
+        // already connected, only (un)register the events
+        param_mask = (CSPI_CON_HANDLER|CSPI_CON_USERDATA|CSPI_CON_EVENTMASK);
+    }
+    if(param_mask){
+        p.handler = event_callback;
+        p.user_data = this;
+        p.mode = mode;
+        p.event_mask = event_mask;
+        LiberaBrillianceCSPILDBG_<<"Setting connection parameters on:"<<con_handle<<" :"<<param_mask;
+        // the handler may start the event thread, user_data must be there first
+        if(((rc=cspi_setconparam(con_handle, &p, param_mask&(CSPI_CON_MODE|CSPI_CON_USERDATA)))!=CSPI_OK) ||
+           ((rc=cspi_setconparam(con_handle, &p, param_mask&~(CSPI_CON_MODE|CSPI_CON_USERDATA)))!=CSPI_OK)){
+            LiberaBrillianceCSPILERR_<<"Error setting connection parameters on acquire"<<rc;
+            return rc;
+        }
+        mode_events[mode] = event_mask;
+    }
+    // only the active connection pushes into events, an event is never queued twice
+    for(size_t other=0;other<LIBERA_MODE_LAST;other++){
+        if((other!=mode) && mode_con[other] && mode_events[other]){
+            p.handler = event_callback;
+            p.event_mask = 0;
+            if((rc=cspi_setconparam(mode_con[other], &p, CSPI_CON_HANDLER|CSPI_CON_EVENTMASK))!=CSPI_OK){
+                LiberaBrillianceCSPILERR_<<"Error unregistering the events of mode:"<<other<<" err:"<<rc;
+                return rc;
+            }
+            mode_events[other] = 0;
+        }
+    }
+    if(!mode_connected[mode]){
+        for(size_t other=0;other<LIBERA_MODE_LAST;other++){
+            if((other!=mode) && mode_connected[other] && (mode_device(other)==mode_device(mode))){
+                LiberaBrillianceCSPILDBG_<<"Disconnecting mode:"<<other<<" sharing the device with mode:"<<mode;
+                cspi_disconnect(mode_con[other]);
+                mode_connected[other]=false;
+            }
+        }
+        if((rc=cspi_connect(con_handle))!=CSPI_OK){
+            LiberaBrillianceCSPILERR_<<"Error connecting to the HW acquire"<<rc;
+            return rc;
+        }
+        mode_connected[mode]=true;
+        LiberaBrillianceCSPILDBG_<<"Connected with HW mode:"<<mode;
+    } else {
+        LiberaBrillianceCSPILDBG_<<"Reusing connection of HW mode:"<<mode;
+    }
+    if(event_mask && !acq_started){
+        // forget the events received while idle
+        libera_event_rec_t ev;
+        while(events.pop(ev));
     }
-    
     return 0;
 }
 
+int LiberaBrillianceCSPIDriver::release_connections(){
+    int ret=0;
+    for(int mode=0;mode<LIBERA_MODE_LAST;mode++){
+        if(mode_con[mode]==0)
+            continue;
+        if(mode_connected[mode]){
+            cspi_disconnect(mode_con[mode]);
+            mode_connected[mode]=false;
+        }
+        int rc = cspi_freehandle(CSPI_HANDLE_CON, mode_con[mode]);
+        if (CSPI_OK != rc) {
+            LiberaBrillianceCSPILERR_<<"Cannot de-allocate CSPI CONN resources of mode:"<<mode;
+            ret = rc;
+        }
+        mode_con[mode]=0;
+        mode_events[mode]=0;
+    }
+    con_handle = 0;
+    return ret;
+}
+
 int LiberaBrillianceCSPIDriver::deinitIO() {
     if(cfg.operation == liberaconfig::deinit){
           LiberaBrillianceCSPILERR_<<"Already de-initializad";
     }
+    stop_acquire_thread();
+    free_acq_buffers();
+    pool_trim(0);
     cfg.operation =liberaconfig::deinit;
    /* if(raw_data){
         free(raw_data);
         raw_data=NULL;
     }*/
+    // connections must be freed before the environment
+    stop_sa_stream();
+    if(sa_con){
+        cspi_freehandle(CSPI_HANDLE_CON, sa_con);
+        sa_con = 0;
+    }
+    int rc = release_connections();
+    if (CSPI_OK != rc) {
+        return rc;
+    }
     if(env_handle){
         int rc = cspi_freehandle(CSPI_HANDLE_ENV, env_handle);
         if (CSPI_OK != rc) {
@@ -434,16 +767,6 @@ int LiberaBrillianceCSPIDriver::deinitIO() {
         }
         env_handle =NULL;
     }
-        
-    
-    if(con_handle){
-        int rc = cspi_freehandle(CSPI_HANDLE_CON, con_handle);
-        if (CSPI_OK != rc) {
-            LiberaBrillianceCSPILERR_<<"Cannot de-allocate CSPI CONN resources";
-            return rc;
-        }
-        con_handle =NULL;
-    }
     return 0;
 }
 
@@ -461,8 +784,8 @@ int LiberaBrillianceCSPIDriver::deinitIO() {
 #define LIBERA_IOP_MODE_SINGLEPASS 0x800
 
 #define LIBERA_IOP_CMD_ACQUIRE 0x1
-#define LIBERA_IOP_CMD_SETENV 0x2 // Setting environment
-#define LIBERA_IOP_CMD_GETENV 0x3 // getting environment
+#define LIBERA_IOP_CMD_SETENV 0x2 // Setting environment (array of libera_env_t)
+#define LIBERA_IOP_CMD_GETENV 0x3 // getting environment (CSPI_ENVPARAMS)
 #define LIBERA_IOP_CMD_SETTIME 0x4 // Setting Time
 #define LIBERA_IOP_CMD_SET_OFFSET 0x5 // set offset in buffer
 #define LIBERA_IOP_CMD_SET_SAMPLES 0x6 // set offset in buffer
@@ -482,7 +805,13 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
     switch(operation){
         case LIBERA_IOP_CMD_GET_TS:
             CSPI_TIMESTAMP ts;
-             rc = cspi_gettimestamp(con_handle,&ts);
+             if(acq_started){
+                 // con_handle is busy in the acquisition thread, MT/ST of the buffer last handed over
+                 ts = last_ts;
+                 rc = (ts.st.tv_sec>0)?CSPI_OK:CSPI_E_SEQUENCE;
+             } else {
+                 rc = cspi_gettimestamp(con_handle,&ts);
+             }
              if(rc==CSPI_OK){
                  LiberaBrillianceCSPILDBG_<<" TS:"<<ts.st.tv_sec<<" :"<<ts.st.tv_nsec;
                  memcpy(data,&ts,std::min((unsigned int)sizeb,sizeof(CSPI_TIMESTAMP)));
@@ -495,12 +824,60 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
             break;
         case LIBERA_IOP_CMD_STOP:
             LiberaBrillianceCSPILDBG_<<"IOP STOP"<<driver_mode;
-
-            cspi_disconnect(con_handle);
+            stop_acquire_thread();
+            // the acquisition buffers are kept for the next acquire, released by deinitIO
+            // the SA stream goes on unless asked to stop (data with LIBERA_IOP_MODE_SA)
+            if(data && (*(int*)data & LIBERA_IOP_MODE_SA)){
+                stop_sa_stream();
+            }
+            // DD/PM/ADC connections stay open for the next acquire
             cfg.operation = liberaconfig::unknown;
-
+            read_buffer = NULL;
+            read_buffer_size = 0;
+            break;
+        case LIBERA_IOP_CMD_GET_LATENCY:
+            if(data==NULL)
+                return -1;
+            memcpy(data,&last_lat,std::min((size_t)sizeb,sizeof(libera_latency_t)));
+            break;
+        case LIBERA_IOP_CMD_GET_STATS:
+            if(data==NULL)
+                return -1;
+            memcpy(data,&last_stats,std::min((size_t)sizeb,sizeof(libera_stats_t)));
+            break;
+        case LIBERA_IOP_CMD_SET_SP_SEPARATION:{
+            // applied to the single pass connection by the next acquire
+            if(data==NULL)
+                return -1;
+            int separation = *(int*)data;
+            if(separation<0){
+                LiberaBrillianceCSPILERR_<<"Invalid single pass separation:"<<separation;
+                return -1;
+            }
+            cfg.adc.sp_separation = separation;
+            LiberaBrillianceCSPILDBG_<<"Setting single pass separation:"<<separation;
+            break;
+        }
+        case LIBERA_IOP_CMD_SET_DECIMATION:{
+            if((data==NULL) || (sizeb<(int)sizeof(libera_decimation_t)))
+                return -1;
+            const libera_decimation_t* dec=(const libera_decimation_t*)data;
+            // the acquisition thread decimates with the current filter
+            stop_acquire_thread();
+            if(dd_dec.set(*dec)!=0){
+                LiberaBrillianceCSPILERR_<<"Invalid decimation filter:"<<dec->filter<<" factor:"<<dec->factor;
+                return -1;
+            }
+            LiberaBrillianceCSPILDBG_<<"Setting DD decimation filter:"<<dec->filter<<" factor:"<<dec->factor;
+            break;
+        }
+        case LIBERA_IOP_CMD_SET_BUFFER:
+            read_buffer = data;
+            read_buffer_size = (data)?sizeb:0;
+            LiberaBrillianceCSPILDBG_<<"Registered read buffer:"<<read_buffer<<" size:"<<read_buffer_size;
             break;
         case LIBERA_IOP_CMD_ACQUIRE:
+            stop_acquire_thread();
             driver_mode = *(int*)data;
             LiberaBrillianceCSPILDBG_<<"IOP Acquire driver mode:"<<driver_mode;
             if(driver_mode&LIBERA_IOP_MODE_TRIGGERED){
@@ -527,18 +904,31 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
             }
                  //const size_t modes[] = {CSPI_MODE_DD, CSPI_MODE_SA, CSPI_MODE_PM, CSPI_MODE_ADC, CSPI_MODE_AVERAGE};
 
+            cfg.mask&=~cfg.want_soa;
             if(driver_mode&LIBERA_IOP_MODE_DD){
               cfg.mode =CSPI_MODE_DD;
               LiberaBrillianceCSPILDBG_<<"Acquire Data on Demand";
               cfg.operation = liberaconfig::acquire;
               cfg.datasize=sizeof(CSPI_DD_ATOM);
+              if(driver_mode&LIBERA_IOP_MODE_SOA){
+                  cfg.mask|=cfg.want_soa;
+                  LiberaBrillianceCSPILDBG_<<"DD column major (SoA)";
+              }
 
             }
             if(driver_mode&LIBERA_IOP_MODE_SA){
-                cfg.mode =CSPI_MODE_SA;
+                // streamed on its own connection, together with the other modes
                 LiberaBrillianceCSPILDBG_<<"Acquire Data on Streaming";
-                cfg.operation = liberaconfig::acquire;
-                cfg.datasize=sizeof(CSPI_SA_ATOM);
+                if((rc=start_sa_stream())!=0){
+                    return rc;
+                }
+                if((driver_mode&LIBERA_IOP_PRIMARY_MODES)==0){
+                    // SA only, no acquisition on the mode connections
+                    cfg.mode = CSPI_MODE_UNKNOWN;
+                    cfg.operation = liberaconfig::unknown;
+                }
+            } else {
+                stop_sa_stream();
             }
             if(driver_mode&LIBERA_IOP_MODE_PM){
                 cfg.mode =CSPI_MODE_PM;
@@ -587,6 +977,11 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
                 LiberaBrillianceCSPILDBG_<<"Setting Samples:"<<cfg.atom_count;
 
                break;    
+        case LIBERA_IOP_CMD_GET_SAMPLES:
+            if(data==NULL)
+                return -1;
+            *(int *)data = cfg.atom_count;
+            break;
         case LIBERA_IOP_CMD_SET_OFFSET:
                cfg.dd.offset = *(int *)data;
                LiberaBrillianceCSPILDBG_<<"Setting Offset:"<<cfg.dd.offset;
@@ -594,35 +989,44 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
                break;
         case LIBERA_IOP_CMD_SETENV:{
             cfg.operation = liberaconfig::setenv;
+            // data is an array of sizeb/sizeof(libera_env_t) parameters, merged and applied at once
             libera_env_t* cmd_env=(libera_env_t*)data;
+            const int nenv=sizeb/sizeof(libera_env_t);
             CSPI_ENVPARAMS env;
-            
-            SET_ENV(KX,Kx);
-            SET_ENV(KY,Ky);
-            SET_ENV(XOFFSET,Xoffset);
-            SET_ENV(YOFFSET,Yoffset);
-            SET_ENV(QOFFSET,Qoffset);
-            SET_ENV(SWITCH,switches);
-            SET_ENV(GAIN,gain);
-            SET_ENV(AGC,agc);
-            SET_ENV(DSC,dsc);
-            SET_ENV(ILK,ilk.mode);
-            
+            CSPI_BITMASK selector=0;
+            if((data==NULL) || (nenv<=0)){
+                LiberaBrillianceCSPILERR_<<"Error setting env, no parameters";
+                return CSPI_E_INVALID_PARAM;
+            }
+            memset(&env,0,sizeof(env));
+            for(int cnt=0;cnt<nenv;cnt++,cmd_env++){
+                selector|=cmd_env->selector;
+                SET_ENV(KX,Kx);
+                SET_ENV(KY,Ky);
+                SET_ENV(XOFFSET,Xoffset);
+                SET_ENV(YOFFSET,Yoffset);
+                SET_ENV(QOFFSET,Qoffset);
+                SET_ENV(SWITCH,switches);
+                SET_ENV(GAIN,gain);
+                SET_ENV(AGC,agc);
+                SET_ENV(DSC,dsc);
+                SET_ENV(ILK,ilk.mode);
+
                 SET_ENV(ILKSTATUS, ilk_status);
                 SET_ENV(PMOFFSET, PMoffset);
-                
+
                 SET_ENV(PMDEC, PMdec);
 
-               SET_ENV(TRIGDELAY, trig_delay);
-               
+                SET_ENV(TRIGDELAY, trig_delay);
+
                 SET_ENV(EXTSWITCH, external_switching);
                 SET_ENV(SWDELAY, switching_delay);
                 SET_ENV(TRIGMODE,trig_mode);
                 SET_ENV(DDC_MAFLENGTH, ddc_maflength);
-               SET_ENV(DDC_MAFDELAY, ddc_mafdelay);
+                SET_ENV(DDC_MAFDELAY, ddc_mafdelay);
 
-               SET_ENV(NOTCH1, notch1[0]);
-               SET_ENV( NOTCH2, notch2[0]);
+                SET_ENV(NOTCH1, notch1[0]);
+                SET_ENV( NOTCH2, notch2[0]);
                 SET_ENV(POLYPHASE_FIR, polyphase_fir[0]);
 
                 SET_ENV(MTVCXOFFS, mtvcxoffs);
@@ -633,9 +1037,11 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
                 SET_ENV(STUNLCKTR, stunlcktr);
 
                 SET_ENV( PM, pm.mode);
-               SET_ENV( SR, sr.enable);
+                SET_ENV( SR, sr.enable);
                 SET_ENV(SP, sp.threshold);
-                rc = cspi_setenvparam(env_handle,(CSPI_ENVPARAMS*) &env, cmd_env->selector);
+            }
+                LiberaBrillianceCSPILDBG_<<"IO SET ENV "<<nenv<<" parameters, bitmask:"<<selector;
+                rc = cspi_setenvparam(env_handle,(CSPI_ENVPARAMS*) &env, selector);
             
                 if (CSPI_OK != rc) {
                  LiberaBrillianceCSPILERR_<<"Error setting env:"<<rc;
@@ -644,21 +1050,24 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
         }
             break;
         case LIBERA_IOP_CMD_GETENV:{
-            char *pdata=(char*)data;
             CSPI_BITMASK mask = ~(0LL);
             cfg.operation = liberaconfig::listenv;
             LiberaBrillianceCSPILDBG_<<"GET ENV";
-            CSPI_ENVPARAMS env;
-            rc = cspi_getenvparam(env_handle,(CSPI_ENVPARAMS*) &env, mask);
-            if(data && sizeb) *pdata=0;
+            if((data==NULL) || (sizeb<(int)sizeof(CSPI_ENVPARAMS))){
+                LiberaBrillianceCSPILERR_<<"Error getting env, buffer too small:"<<sizeb;
+                return CSPI_E_INVALID_PARAM;
+            }
+            CSPI_ENVPARAMS*env=(CSPI_ENVPARAMS*)data;
+            // one snapshot, only the stale fields are read from the device
+            rc = cspi_getenvparam_cached(env_handle,env,mask&~LIBERA_ENV_STATUS_MASK,LIBERA_ENV_CONFIG_MAXAGE);
+            if(CSPI_OK == rc){
+                rc = cspi_getenvparam_cached(env_handle,env,LIBERA_ENV_STATUS_MASK,LIBERA_ENV_STATUS_MAXAGE);
+            }
             if (CSPI_OK != rc) {
                  LiberaBrillianceCSPILERR_<<"Error getting env:"<<rc;
 
                 return rc;
             }
-            std::stringstream ss;
-            ss<<env;
-            strncpy(pdata,ss.str().c_str(),std::min((unsigned int)sizeb,ss.str().size()));
             break;
         }
         case LIBERA_IOP_CMD_SETTIME:{
@@ -724,25 +1133,25 @@ if(cmd_env->selector & CSPI_ENV_## cpimask ){\
              LiberaBrillianceCSPILERR_<<"Cannot allocate buffer of:"<<cfg.atom_count*cfg.datasize <<" bytes";
              return -100;
         }*/
-        p.handler = event_callback;
-	p.mode = cfg.mode;
-	p.event_mask = event_mask;
-        
-	CSPI_BITMASK param_mask = CSPI_CON_MODE;
-	if (event_mask) param_mask |= (CSPI_CON_HANDLER|CSPI_CON_EVENTMASK);
-        LiberaBrillianceCSPILDBG_<<"Setting connection parameters on:"<<con_handle<<" :"<<param_mask;
-
-	int rc = cspi_setconparam(con_handle, &p, param_mask);
-	if (CSPI_OK != rc) {
-            LiberaBrillianceCSPILERR_<<"Error setting connection parameters on acquire"<<rc;
+        int rc = select_connection(cfg.mode,event_mask);
+        if (CSPI_OK != rc) {
             return rc;
         }
-        rc = cspi_connect(con_handle);
-        if (CSPI_OK != rc) {
-            LiberaBrillianceCSPILERR_<<"Error connecting to the HW acquire"<<rc;
-            return rc;   
+        if((cfg.mode==CSPI_MODE_ADC_SP) || (cfg.mode==CSPI_MODE_ADC_SP_ROT)){
+            CSPI_CONPARAMS_EBPP p;
+            p.sp_separation = cfg.adc.sp_separation;
+            rc = cspi_setconparam(con_handle, (CSPI_CONPARAMS*)&p, CSPI_CON_SPSEPARATION);
+            if (CSPI_OK != rc) {
+                LiberaBrillianceCSPILERR_<<"Error setting single pass separation:"<<p.sp_separation<<" rc:"<<rc;
+                return rc;
+            }
+        }
+        if((operation==LIBERA_IOP_CMD_ACQUIRE) && (cfg.mask & liberaconfig::want_trigger) && (cfg.mode!=CSPI_MODE_SA)){
+            // triggered acquisitions are performed by the acquisition thread
+            if((rc=start_acquire_thread())!=0){
+                return rc;
+            }
         }
-        LiberaBrillianceCSPILDBG_<<"Connected with HW mode:"<<cfg.mode;
 
     }
   
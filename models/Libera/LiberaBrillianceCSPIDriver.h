@@ -22,6 +22,7 @@ limitations under the License.
 #include <chaos/cu_toolkit/driver_manager/driver/BasicIODriver.h>
 #define CSPI
 #include "LiberaData.h"
+#include <semaphore.h>
 DEFINE_CU_DRIVER_DEFINITION_PROTOTYPE(LiberaBrillianceCSPIDriver);
 
 struct liberaconfig
@@ -48,7 +49,7 @@ struct liberaconfig
 	} dd;
 	struct adc_specific
 	{
-		adc_specific() : mode(adc_specific::none), rotate(0) {};
+		adc_specific() : mode(adc_specific::none), rotate(0), sp_separation(0) {};
 		int mode;
 
 		enum {
@@ -57,6 +58,7 @@ struct liberaconfig
 			sp   = 0x02
 		};
 		int rotate;
+		size_t sp_separation;	// single pass shot separation, 0 first shot only
 	} adc;
 
 	size_t atom_count;		// number of samples to retrieve
@@ -81,24 +83,147 @@ struct liberaconfig
 		want_setst     = 0x20,
 		want_reserved  = 0x40,
 		want_dcc       = 0x80,
+		want_soa       = 0x100,	// DD handed over column major
 	};
 	CSPI_BITMASK mask;			// command-line switches (flags)
 };
 
+// event captured by the CSPI event callback
+typedef struct libera_event_rec {
+    int id;                 // CSPI_EVENT_xx
+    int param;              // event specific parameter
+    struct timespec ts;     // capture time (CLOCK_MONOTONIC)
+} libera_event_rec_t;
+
+#define LIBERA_EVENT_RING_SIZE 64 // must be a power of 2
+#define LIBERA_SA_BATCH 64 // max SA atoms per read of the stream thread
+#define LIBERA_SA_POLL_MS 100 // max wait of the stream thread for an SA atom, bounds stop_sa_stream
+
+// environment fields that change on their own (health, PLL, interlock, ADC), refreshed at every status read
+#define LIBERA_ENV_STATUS_MASK (CSPI_ENV_HEALTH|CSPI_ENV_PLL|CSPI_ENV_ILKSTATUS|CSPI_ENV_MTVCXOFFS|CSPI_ENV_MTNCOSHFT|\
+    CSPI_ENV_MTPHSOFFS|CSPI_ENV_MTUNLCKTR|CSPI_ENV_MTSYNCIN|CSPI_ENV_STUNLCKTR|CSPI_ENV_LPLLDSTAT|CSPI_ENV_MAX_ADC|CSPI_ENV_AVERAGE_SUM)
+#define LIBERA_ENV_STATUS_MAXAGE 500 // ms
+// configuration fields, changes through cspi_setenvparam are read back at once
+#define LIBERA_ENV_CONFIG_MAXAGE 30000 // ms
+
+/*
+ * lock-free single producer (CSPI event thread) single consumer ring of events
+ */
+struct liberaeventring
+{
+    liberaeventring() : head(0), tail(0), dropped(0) {}
+
+    libera_event_rec_t rec[LIBERA_EVENT_RING_SIZE];
+    volatile uint32_t head;     // written by the producer only
+    volatile uint32_t tail;     // written by the consumer only
+    volatile uint32_t dropped;  // events lost because the ring was full
+
+    bool push(const libera_event_rec_t& ev){
+        uint32_t h = head;
+        if((h - tail) >= LIBERA_EVENT_RING_SIZE){
+            dropped++;
+            return false;
+        }
+        rec[h & (LIBERA_EVENT_RING_SIZE-1)] = ev;
+        __sync_synchronize(); // record visible before the new head
+        head = h + 1;
+        return true;
+    }
+    bool pop(libera_event_rec_t& ev){
+        uint32_t t = tail;
+        if(t == head)
+            return false;
+        __sync_synchronize(); // head read before the record
+        ev = rec[t & (LIBERA_EVENT_RING_SIZE-1)];
+        __sync_synchronize(); // record copied before releasing the slot
+        tail = t + 1;
+        return true;
+    }
+};
+
 class LiberaBrillianceCSPIDriver : public chaos::cu::driver_manager::driver::BasicIODriver {
 protected:
     int driver_mode;
     int nacquire;
     char*raw_data;
+    // destination buffer registered by LIBERA_IOP_CMD_SET_BUFFER, used when read() is called with a NULL buffer
+    void*read_buffer;
+    int read_buffer_size;
     CSPIHENV env_handle;
-    CSPIHCON con_handle;
+    CSPIHCON con_handle; // connection of the current mode, one of mode_con
+    // connections kept open across acquisitions, allocated on first use of a CSPI mode
+    CSPIHCON mode_con[LIBERA_MODE_LAST];
+    bool mode_connected[LIBERA_MODE_LAST];
+    CSPI_BITMASK mode_events[LIBERA_MODE_LAST];
     CSPI_LIBPARAMS lib;
     CSPI_ENVPARAMS ep;
     CSPI_CONPARAMS p;
     
     struct liberaconfig cfg;
+
+    // triggered acquisition thread, fills a ping-pong pair of buffers
+    pthread_t acq_thread;
+    pthread_mutex_t acq_mutex;
+    volatile bool acq_run;
+    bool acq_started;
+    char* acq_buf[2];
+    size_t acq_nread[2];
+    libera_latency_t acq_lat[2];
+    libera_stats_t acq_stats[2];
+    CSPI_TIMESTAMP acq_ts[2]; // read by the thread, con_handle is not shared with GET_TS
+    size_t acq_buf_size;
+    int acq_write; // buffer being filled by the thread
+    int acq_ready; // last completed buffer not yet handed over, -1 none
+    int acq_err;
+    uint64_t acq_completed; // completed acquisitions
+    uint64_t acq_overwritten; // completed buffers replaced before read() picked them up
+
+    // DD software decimation, read_atoms reads factor times the atoms in dec_buf
+    libera_decimator dd_dec;
+    char* dec_buf;
+    size_t dec_buf_size;
+
+    // SA stream, read by its own thread on its own connection concurrently with the DD/ADC acquisition
+    CSPIHCON sa_con;
+    bool sa_connected;
+    pthread_t sa_thread;
+    pthread_mutex_t sa_mutex;
+    volatile bool sa_run;
+    bool sa_started;
+    CSPI_SA_ATOM* sa_ring; // LIBERA_SA_RING_SIZE atoms
+    uint64_t sa_head; // atoms written by the thread
+    uint64_t sa_tail; // atoms handed over by read()
+    uint64_t sa_dropped; // atoms never handed over
+    int sa_err;
+
+    // events pushed by event_callback, sem posted on every push
+    struct liberaeventring events;
+    sem_t event_sem;
+    libera_event_rec_t last_trigger;
+    // stage timestamps of the data last returned by read()
+    libera_latency_t last_lat;
+    // statistics of the DD last returned by read()
+    libera_stats_t last_stats;
+    // timestamp of the buffer last returned by read() in triggered mode
+    CSPI_TIMESTAMP last_ts;
+    static int event_callback(CSPI_EVENT *p);
+
     int wait_trigger();
     int assign_time(const char*time );
+    int read_atoms(void*buffer,size_t count,size_t*nread,libera_latency_t*lat,libera_stats_t*stats);
+    int select_connection(size_t mode,CSPI_BITMASK event_mask);
+    int release_connections();
+    int alloc_acq_buffers(size_t size);
+    void free_acq_buffers();
+    int start_acquire_thread();
+    int stop_acquire_thread();
+    static void* acquire_thread(void*arg);
+    void acquire_loop();
+    int start_sa_stream();
+    int stop_sa_stream();
+    static void* sa_stream_thread(void*arg);
+    void sa_stream_loop();
+    int read_sa(void*buffer,int bcount);
 public:
     LiberaBrillianceCSPIDriver();
 
@@ -106,8 +231,11 @@ public:
     //! Execute a command
 
     /**
-     \brief Read  from the physical device
-     \param buffer[out] destination buffer
+     \brief Read  from the physical device, in triggered mode returns the last buffer completed by the acquisition thread (0 if nothing new)
+     The registered buffer is filled with no copy in untriggered mode only: in triggered mode the thread
+     reads into its ping-pong buffers while the caller publishes the previous one, and the completed
+     buffer is copied at hand-over. That copy is the price of overlapping the read with the publish.
+     \param buffer[out] destination buffer, NULL to use the one registered with LIBERA_IOP_CMD_SET_BUFFER
      \param addr[in]  address or identification
      \param bcout[in] buffer count
      \return the number of succesful read items, negative error
@@ -5,6 +5,9 @@
  * Created on May 11, 2015, 11:26 AM
  */
 #include "models/Libera/LiberaData.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
 
 DEFINE_DESC(libera_dd_desc,{"VA","VB","VC","VD","X","Y","Q","SUM"});
 
@@ -13,9 +16,78 @@ DEFINE_DESC(libera_sp_desc,{"X","Y","BEFORE","AFTER","THRSH","TRIGGER","SUM"});
 DEFINE_DESC(libera_cw_desc,{"QA","QB","QC","QD","X","Y","CHA","CHB","CHC","CHD","SUM"});
 DEFINE_DESC(libera_avg_desc,{"AVG"});
 
+#define ENV_ATTR(name,desc,field) {name,desc,offsetof(libera_env_params_t,field),sizeof(((libera_env_params_t*)0)->field)}
+
+const libera_env_attr_t libera_env_attrs[]={
+    ENV_ATTR("TEMP","Temperature [C]",health.temp),
+    ENV_ATTR("FAN1","Fan 1 [rpm]",health.fan[0]),
+    ENV_ATTR("FAN2","Fan 2 [rpm]",health.fan[1]),
+    ENV_ATTR("VOLT1","Voltage 1 [mV]",health.voltage[0]),
+    ENV_ATTR("VOLT2","Voltage 2 [mV]",health.voltage[1]),
+    ENV_ATTR("VOLT3","Voltage 3 [mV]",health.voltage[2]),
+    ENV_ATTR("VOLT4","Voltage 4 [mV]",health.voltage[3]),
+    ENV_ATTR("VOLT5","Voltage 5 [mV]",health.voltage[4]),
+    ENV_ATTR("VOLT6","Voltage 6 [mV]",health.voltage[5]),
+    ENV_ATTR("VOLT7","Voltage 7 [mV]",health.voltage[6]),
+    ENV_ATTR("VOLT8","Voltage 8 [mV]",health.voltage[7]),
+    ENV_ATTR("SC_PLL","SC PLL locked",pll.sc),
+    ENV_ATTR("MC_PLL","MC PLL locked",pll.mc),
+    ENV_ATTR("TRIGMODE","Trigger mode",trig_mode),
+    ENV_ATTR("KX","Kx [nm]",Kx),
+    ENV_ATTR("KY","Ky [nm]",Ky),
+    ENV_ATTR("XOFFSET","X offset [nm]",Xoffset),
+    ENV_ATTR("YOFFSET","Y offset [nm]",Yoffset),
+    ENV_ATTR("QOFFSET","Q offset [nm]",Qoffset),
+    ENV_ATTR("SWITCH","Analog board switch mode",switches),
+    ENV_ATTR("GAIN","Analog board gain [dBm]",gain),
+    ENV_ATTR("AGC","AGC mode",agc),
+    ENV_ATTR("DSC","DSC mode",dsc),
+    ENV_ATTR("ILK_MODE","Interlock mode",ilk.mode),
+    ENV_ATTR("ILK_XLOW","Interlock X low [nm]",ilk.Xlow),
+    ENV_ATTR("ILK_XHIGH","Interlock X high [nm]",ilk.Xhigh),
+    ENV_ATTR("ILK_YLOW","Interlock Y low [nm]",ilk.Ylow),
+    ENV_ATTR("ILK_YHIGH","Interlock Y high [nm]",ilk.Yhigh),
+    ENV_ATTR("ILK_OVERFLOW_LIMIT","Interlock overflow limit [ADC count]",ilk.overflow_limit),
+    ENV_ATTR("ILK_OVERFLOW_DUR","Interlock overflow duration [ADC periods]",ilk.overflow_dur),
+    ENV_ATTR("ILK_GAIN_LIMIT","Interlock gain limit [dBm]",ilk.gain_limit),
+    ENV_ATTR("ILKSTATUS","Interlock status",ilk_status),
+    ENV_ATTR("PMOFFSET","Post mortem offset",PMoffset),
+    ENV_ATTR("PMDEC","Post mortem decimation",PMdec),
+    ENV_ATTR("TRIGDELAY","Trigger delay",trig_delay),
+    ENV_ATTR("EXTSWITCH","External switching",external_switching),
+    ENV_ATTR("SWDELAY","Switching delay",switching_delay),
+    ENV_ATTR("DDC_MAFLENGTH","MAF length",ddc_maflength),
+    ENV_ATTR("DDC_MAFDELAY","MAF delay",ddc_mafdelay),
+    ENV_ATTR("MT_STATUS","MT controller status",pll_status.mt_stat.status),
+    ENV_ATTR("MT_LOCKED","MT PLL locked",pll_status.mt_stat.locked_status),
+    ENV_ATTR("MT_VCXO_OFFSET","MT RF-VCXO detuning [40Hz]",pll_status.mt_stat.vcxo_offset),
+    ENV_ATTR("MT_NCO_SHIFT","MT NCO frequency shift",pll_status.mt_stat.nco_shift),
+    ENV_ATTR("ST_STATUS","ST controller status",pll_status.st_stat.status),
+    ENV_ATTR("ST_LOCKED","ST PLL locked",pll_status.st_stat.locked_status),
+    ENV_ATTR("MAX_ADC","Max ADC",max_adc),
+    ENV_ATTR("AVERAGE_SUM","Average sum between triggers",average_sum),
+    ENV_ATTR("SR_ENABLE","Spike removal enabled",sr.enable),
+    ENV_ATTR("SP_THRESHOLD","Single pass threshold",sp.threshold),
+};
+const int libera_env_attrs_size=sizeof(libera_env_attrs)/sizeof(libera_env_attr_t);
+
+int32_t libera_env_value(const libera_env_params_t& env,const libera_env_attr_t& attr){
+    const char* p=(const char*)&env + attr.offset;
+    if(attr.size==sizeof(long)){
+        // packed(4) struct, long may be unaligned. The long fields published
+        // (PLL lock flags, VCXO detuning) hold 32 bit values on any host
+        long v;
+        memcpy(&v,p,sizeof(v));
+        return (int32_t)v;
+    }
+    int32_t v;
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+
  std::ostream& operator<<(std::ostream&os,const libera_desc&data){
   
-            for (std::vector<const char*>::iterator i=data.getDesc().begin();i!=data.getDesc().end();i++){
+            for (std::vector<const char*>::const_iterator i=data.getDesc().begin();i!=data.getDesc().end();i++){
                 os<<*i<<",";
             }
             os<<std::endl;
@@ -28,24 +100,551 @@ DEFINE_DESC(libera_avg_desc,{"AVG"});
           
     
     std::ostream& operator <<(std::ostream&os,const libera_dd_t& data){
-        os<<std::dec<<data.Va<<","<<data.Vb<<","<<data.Vc<<","<<data.Vd<<","<<data.X<<","<<data.Y<<","<<data.Q<<","<<data.Sum<<std::endl;
+        os<<std::dec<<data.Va<<","<<data.Vb<<","<<data.Vc<<","<<data.Vd<<","<<data.X<<","<<data.Y<<","<<data.Q<<","<<data.Sum<<"\n";
         return os;
         
     }
     
     std::ostream& operator <<(std::ostream&os,const libera_sa_t& data){
         
-        return os<<std::dec<<data.Va<<","<<data.Vb<<","<<data.Vc<<","<<data.Vd<<","<<data.X<<","<<data.Y<<","<<data.Q<<","<<data.Cx<<","<<data.Cy<<","<<data.Sum<<std::endl;
+        return os<<std::dec<<data.Va<<","<<data.Vb<<","<<data.Vc<<","<<data.Vd<<","<<data.X<<","<<data.Y<<","<<data.Q<<","<<data.Cx<<","<<data.Cy<<","<<data.Sum<<"\n";
     }
     
     std::ostream& operator <<(std::ostream&os,const libera_cw_t& data){
-        return os<<std::dec<<data.Qa<<","<<data.Qb<<","<<data.Qc<<","<<data.Qd<<","<<data.X<<","<<data.Y<<","<<data.chA<<","<<data.chB<<","<<data.chC<<","<<data.chD<<","<<data.Sum<<std::endl;
+        return os<<std::dec<<data.Qa<<","<<data.Qb<<","<<data.Qc<<","<<data.Qd<<","<<data.X<<","<<data.Y<<","<<data.chA<<","<<data.chB<<","<<data.chC<<","<<data.chD<<","<<data.Sum<<"\n";
     }
     std::ostream& operator <<(std::ostream&os,const libera_sp_t& data){
-        return os<<std::dec<<data.X<<","<<data.Y<<","<<data.n_before<<","<<data.n_after<<","<<data.threshold<<","<<data.trigger<<","<<data.Sum<<std::endl;
+        return os<<std::dec<<data.X<<","<<data.Y<<","<<data.n_before<<","<<data.n_after<<","<<data.threshold<<","<<data.trigger<<","<<data.Sum<<"\n";
     }
     
     std::ostream& operator <<(std::ostream&os,const libera_avg_t& data){
         
-        return os<<std::dec<<data.avesum<<std::endl;
+        return os<<std::dec<<data.avesum<<"\n";
+    }
+
+    void libera_dd_to_soa(const libera_dd_t* in,int32_t* out,size_t count){
+        int32_t* __restrict__ va = out;
+        int32_t* __restrict__ vb = va + count;
+        int32_t* __restrict__ vc = vb + count;
+        int32_t* __restrict__ vd = vc + count;
+        int32_t* __restrict__ x = vd + count;
+        int32_t* __restrict__ y = x + count;
+        int32_t* __restrict__ q = y + count;
+        int32_t* __restrict__ sum = q + count;
+        // one pass over the atoms, eight sequential write streams
+        for(size_t i=0;i<count;i++){
+            va[i] = in[i].Va;
+            vb[i] = in[i].Vb;
+            vc[i] = in[i].Vc;
+            vd[i] = in[i].Vd;
+            x[i] = in[i].X;
+            y[i] = in[i].Y;
+            q[i] = in[i].Q;
+            sum[i] = in[i].Sum;
+        }
+    }
+
+// fields of a libera_dd_t, filtered one by one as int32
+#define DD_FIELDS (sizeof(libera_dd_t)/sizeof(int32_t))
+
+// division rounded to the nearest, halves away from zero
+static inline int32_t div_round(int64_t n,int64_t d){
+    return (int32_t)((n>=0)?(n+d/2)/d:-((-n+d/2)/d));
+}
+
+int libera_decimator::set(const libera_decimation_t& dec){
+    if((dec.factor<1) || (dec.factor>LIBERA_DEC_MAX_FACTOR)){
+        return -1;
+    }
+    switch(dec.filter){
+        case LIBERA_DEC_NONE:
+        case LIBERA_DEC_BOXCAR:
+        case LIBERA_DEC_CIC:
+            taps.clear();
+            break;
+        case LIBERA_DEC_FIR:{
+            // cut off at the Nyquist frequency of the decimated data, 1/(2*factor)
+            const int ntaps = LIBERA_DEC_FIR_SPAN*dec.factor+1;
+            const int center = ntaps/2;
+            std::vector<double> h(ntaps);
+            double sum=0;
+            for(int k=0;k<ntaps;k++){
+                const double t = M_PI*(k-center)/dec.factor;
+                const double sinc = (k==center)?1.0:sin(t)/t;
+                h[k] = sinc*(0.54-0.46*cos(2*M_PI*k/(ntaps-1)));
+                sum+=h[k];
+            }
+            taps.resize(ntaps);
+            int32_t qsum=0;
+            for(int k=0;k<ntaps;k++){
+                taps[k] = (int32_t)floor(h[k]/sum*65536.0+0.5);
+                qsum+=taps[k];
+            }
+            // unity DC gain
+            taps[center]+= 65536-qsum;
+            break;
+        }
+        default:
+            return -1;
+    }
+    cfg = dec;
+    return 0;
+}
+
+size_t libera_decimator::run(const libera_dd_t* in,libera_dd_t* out,size_t count) const{
+    const int64_t factor = cfg.factor;
+    const size_t nout = count/factor;
+    const int32_t* x = (const int32_t*)in;
+    int32_t* y = (int32_t*)out;
+    size_t m,f;
+    int64_t k;
+
+    if(!enabled()){
+        memcpy(out,in,count*sizeof(libera_dd_t));
+        return count;
+    }
+    if(nout==0){
+        return 0;
+    }
+    switch(cfg.filter){
+        case LIBERA_DEC_BOXCAR:
+            for(m=0;m<nout;m++,y+=DD_FIELDS){
+                int64_t acc[DD_FIELDS]={0};
+                for(k=0;k<factor;k++,x+=DD_FIELDS){
+                    for(f=0;f<DD_FIELDS;f++) acc[f]+=x[f];
+                }
+                for(f=0;f<DD_FIELDS;f++) y[f]=div_round(acc[f],factor);
+            }
+            break;
+
+        case LIBERA_DEC_CIC:{
+            // integrators at the input rate, combs at the output rate; unsigned
+            // arithmetic wraps around, the comb output is exact anyway.
+            // Output m is the comb output at the end of block m+1 (group delay
+            // of STAGES*(factor-1)/2 atoms), blocks before the first atom are
+            // primed with the first atom.
+            const int64_t gain = factor*factor*factor;
+            const int64_t first = -(LIBERA_DEC_CIC_STAGES-1)*factor;
+            const int64_t last = (int64_t)(nout+1)*factor;
+            uint64_t integ[LIBERA_DEC_CIC_STAGES][DD_FIELDS]={{0}};
+            uint64_t delay[LIBERA_DEC_CIC_STAGES][DD_FIELDS]={{0}};
+            int s;
+
+            for(k=first;k<last;k++){
+                const int64_t i = (k<0)?0:((k>=(int64_t)count)?count-1:k);
+                const int32_t* xi = x + i*DD_FIELDS;
+                for(f=0;f<DD_FIELDS;f++){
+                    integ[0][f]+=(int64_t)xi[f];
+                    for(s=1;s<LIBERA_DEC_CIC_STAGES;s++) integ[s][f]+=integ[s-1][f];
+                }
+                if((k-first)%factor!=factor-1){
+                    continue;
+                }
+                const int64_t block = (k+1)/factor - 2; // output atom, from the block end
+                for(f=0;f<DD_FIELDS;f++){
+                    uint64_t c = integ[LIBERA_DEC_CIC_STAGES-1][f];
+                    for(s=0;s<LIBERA_DEC_CIC_STAGES;s++){
+                        const uint64_t d = c;
+                        c-=delay[s][f];
+                        delay[s][f]=d;
+                    }
+                    if(block>=0){
+                        y[block*DD_FIELDS+f]=div_round((int64_t)c,gain);
+                    }
+                }
+            }
+            break;
+        }
+
+        case LIBERA_DEC_FIR:{
+            const int64_t ntaps = taps.size();
+            const int32_t* h = &taps[0];
+            for(m=0;m<nout;m++,y+=DD_FIELDS){
+                // taps centered on the block
+                const int64_t start = (int64_t)m*factor + factor/2 - ntaps/2;
+                int64_t acc[DD_FIELDS]={0};
+                if((start>=0) && (start+ntaps<=(int64_t)count)){
+                    const int32_t* xi = x + start*DD_FIELDS;
+                    for(k=0;k<ntaps;k++,xi+=DD_FIELDS){
+                        for(f=0;f<DD_FIELDS;f++) acc[f]+=(int64_t)h[k]*xi[f];
+                    }
+                } else {
+                    for(k=0;k<ntaps;k++){
+                        const int64_t i = std::min(std::max(start+k,(int64_t)0),(int64_t)count-1);
+                        const int32_t* xi = x + i*DD_FIELDS;
+                        for(f=0;f<DD_FIELDS;f++) acc[f]+=(int64_t)h[k]*xi[f];
+                    }
+                }
+                for(f=0;f<DD_FIELDS;f++) y[f]=div_round(acc[f],65536);
+            }
+            break;
+        }
+    }
+    return nout;
+}
+
+const char* libera_stats_fields[LIBERA_STATS_FIELDS]={"X","Y","Q","SUM"};
+static const char* stats_figures[LIBERA_STATS_FIGURES]={"MEAN","RMS","MIN","MAX","P2P"};
+
+std::string libera_stats_attr(int field,int figure){
+    return std::string(libera_stats_fields[field])+"_"+stats_figures[figure];
+}
+
+template <typename T>
+static void atom_stats(const T* in,size_t count,libera_stats_t* stats){
+    memset(stats,0,sizeof(*stats));
+    if(count==0){
+        return;
+    }
+    // sums of the offsets from the first atom: no cancellation in the variance of a large mean
+    const int64_t k[LIBERA_STATS_FIELDS]={in[0].X,in[0].Y,in[0].Q,in[0].Sum};
+    int64_t sum[LIBERA_STATS_FIELDS]={0,0,0,0};
+    double sq[LIBERA_STATS_FIELDS]={0,0,0,0};
+    int32_t mn[LIBERA_STATS_FIELDS]={in[0].X,in[0].Y,in[0].Q,in[0].Sum};
+    int32_t mx[LIBERA_STATS_FIELDS]={in[0].X,in[0].Y,in[0].Q,in[0].Sum};
+    double wx=0,wy=0,w=0;
+    for(size_t i=0;i<count;i++){
+        const int32_t v[LIBERA_STATS_FIELDS]={in[i].X,in[i].Y,in[i].Q,in[i].Sum};
+        for(int f=0;f<LIBERA_STATS_FIELDS;f++){
+            const int64_t d=v[f]-k[f];
+            sum[f]+=d;
+            sq[f]+=(double)d*d;
+            mn[f]=std::min(mn[f],v[f]);
+            mx[f]=std::max(mx[f],v[f]);
+        }
+        wx+=(double)v[LIBERA_STATS_X]*v[LIBERA_STATS_SUM];
+        wy+=(double)v[LIBERA_STATS_Y]*v[LIBERA_STATS_SUM];
+        w+=v[LIBERA_STATS_SUM];
+    }
+    stats->count=count;
+    for(int f=0;f<LIBERA_STATS_FIELDS;f++){
+        const double m=(double)sum[f]/count;
+        stats->mean[f]=k[f]+m;
+        stats->rms[f]=sqrt(std::max(sq[f]/count-m*m,0.0));
+        stats->min[f]=mn[f];
+        stats->max[f]=mx[f];
+    }
+    stats->x_wmean=(w!=0)?wx/w:stats->mean[LIBERA_STATS_X];
+    stats->y_wmean=(w!=0)?wy/w:stats->mean[LIBERA_STATS_Y];
+}
+
+void libera_dd_stats(const libera_dd_t* in,size_t count,libera_stats_t* stats){
+    atom_stats(in,count,stats);
+}
+
+void libera_sa_stats(const libera_sa_t* in,size_t count,libera_stats_t* stats){
+    atom_stats(in,count,stats);
+}
+
+#define PACK_FIELD(type,field) {(uint16_t)offsetof(type,field),(uint8_t)sizeof(((type*)0)->field),0}
+
+static const libera_pack_field_t dd_pack_fields[]={
+    PACK_FIELD(libera_dd_t,Va),PACK_FIELD(libera_dd_t,Vb),PACK_FIELD(libera_dd_t,Vc),PACK_FIELD(libera_dd_t,Vd),
+    PACK_FIELD(libera_dd_t,X),PACK_FIELD(libera_dd_t,Y),PACK_FIELD(libera_dd_t,Q),PACK_FIELD(libera_dd_t,Sum)
+};
+static const libera_pack_field_t sa_pack_fields[]={
+    PACK_FIELD(libera_sa_t,Va),PACK_FIELD(libera_sa_t,Vb),PACK_FIELD(libera_sa_t,Vc),PACK_FIELD(libera_sa_t,Vd),
+    PACK_FIELD(libera_sa_t,Sum),PACK_FIELD(libera_sa_t,Q),PACK_FIELD(libera_sa_t,X),PACK_FIELD(libera_sa_t,Y),
+    PACK_FIELD(libera_sa_t,Cx),PACK_FIELD(libera_sa_t,Cy),
+    PACK_FIELD(libera_sa_t,reserved[0]),PACK_FIELD(libera_sa_t,reserved[1]),PACK_FIELD(libera_sa_t,reserved[2]),
+    PACK_FIELD(libera_sa_t,reserved[3]),PACK_FIELD(libera_sa_t,reserved[4]),PACK_FIELD(libera_sa_t,reserved[5])
+};
+static const libera_pack_field_t cw_pack_fields[]={
+    PACK_FIELD(libera_cw_t,chD),PACK_FIELD(libera_cw_t,chC),PACK_FIELD(libera_cw_t,chB),PACK_FIELD(libera_cw_t,chA),
+    PACK_FIELD(libera_cw_t,X),PACK_FIELD(libera_cw_t,Y),PACK_FIELD(libera_cw_t,Sum),
+    PACK_FIELD(libera_cw_t,Qa),PACK_FIELD(libera_cw_t,Qb),PACK_FIELD(libera_cw_t,Qc),PACK_FIELD(libera_cw_t,Qd)
+};
+static const libera_pack_field_t sp_pack_fields[]={
+    PACK_FIELD(libera_sp_t,trigger),PACK_FIELD(libera_sp_t,threshold),PACK_FIELD(libera_sp_t,n_before),
+    PACK_FIELD(libera_sp_t,n_after),PACK_FIELD(libera_sp_t,X),PACK_FIELD(libera_sp_t,Y),PACK_FIELD(libera_sp_t,Sum)
+};
+
+#define PACK_LAYOUT(fields,type) {fields,sizeof(fields)/sizeof(libera_pack_field_t),sizeof(type)}
+
+const libera_pack_layout_t libera_dd_pack=PACK_LAYOUT(dd_pack_fields,libera_dd_t);
+const libera_pack_layout_t libera_sa_pack=PACK_LAYOUT(sa_pack_fields,libera_sa_t);
+const libera_pack_layout_t libera_cw_pack=PACK_LAYOUT(cw_pack_fields,libera_cw_t);
+const libera_pack_layout_t libera_sp_pack=PACK_LAYOUT(sp_pack_fields,libera_sp_t);
+
+static inline size_t pack_blocks(size_t count){
+    return (count>1)?(count-1+LIBERA_PACK_BLOCK-1)/LIBERA_PACK_BLOCK:0;
+}
+
+size_t libera_pack_bound(const libera_pack_layout_t& layout,size_t count){
+    size_t size=sizeof(libera_pack_header_t)+layout.size*sizeof(libera_pack_field_t);
+    for(int f=0;f<layout.size;f++){
+        // deltas are at most as wide as the field
+        size+=sizeof(int64_t)+pack_blocks(count)+(count?count-1:0)*layout.fields[f].size;
+    }
+    return size;
+}
+
+static inline int pack_width(uint64_t any){
+    return any?64-__builtin_clzll(any):0;
+}
+
+static inline uint64_t pack_mask(int width){
+    return (width<64)?((1ULL<<width)-1):~0ULL;
+}
+
+// deltas wrap around the field width (U unsigned, S signed of the same size)
+template <typename U,typename S>
+static uint8_t* pack_field(const char* in,size_t stride,size_t count,uint8_t* out){
+    U prev;
+    uint64_t z[LIBERA_PACK_BLOCK];
+    memcpy(&prev,in,sizeof(U));
+    const int64_t first=(S)prev;
+    memcpy(out,&first,sizeof(first));
+    out+=sizeof(first);
+    for(size_t i=1;i<count;i+=LIBERA_PACK_BLOCK){
+        const size_t n=std::min((size_t)LIBERA_PACK_BLOCK,count-i);
+        const char* p=in+i*stride;
+        uint64_t any=0;
+        for(size_t k=0;k<n;k++,p+=stride){
+            U v;
+            memcpy(&v,p,sizeof(U));
+            const S d=(S)(U)(v-prev);
+            prev=v;
+            // small magnitudes of either sign map to small codes
+            z[k]=(U)((U)((U)d<<1)^(U)(d>>(8*sizeof(S)-1)));
+            any|=z[k];
+        }
+        const int width=pack_width(any);
+        *out++=(uint8_t)width;
+        if(width==0){
+            continue;
+        }
+        uint64_t acc=0;
+        int used=0;
+        for(size_t k=0;k<n;k++){
+            acc|=z[k]<<used;
+            if(used+width>=64){
+                memcpy(out,&acc,sizeof(acc));
+                out+=sizeof(acc);
+                const int spill=used+width-64;
+                acc=spill?(z[k]>>(width-spill)):0;
+                used=spill;
+            } else {
+                used+=width;
+            }
+        }
+        if(used){
+            memcpy(out,&acc,(used+7)/8);
+            out+=(used+7)/8;
+        }
+    }
+    return out;
+}
+
+size_t libera_pack(const libera_pack_layout_t& layout,const void* in,size_t count,void* out){
+    libera_pack_header_t h;
+    uint8_t* p=(uint8_t*)out+sizeof(h);
+    h.magic=LIBERA_PACK_MAGIC;
+    h.version=LIBERA_PACK_VERSION;
+    h.fields=layout.size;
+    h.atom_size=layout.atom_size;
+    h.count=count;
+    memcpy(p,layout.fields,layout.size*sizeof(libera_pack_field_t));
+    p+=layout.size*sizeof(libera_pack_field_t);
+    if(count){
+        // one stream per field: the deltas of a quantity are small, across quantities they are not
+        for(int f=0;f<layout.size;f++){
+            const char* base=(const char*)in+layout.fields[f].offset;
+            switch(layout.fields[f].size){
+                case 2: p=pack_field<uint16_t,int16_t>(base,layout.atom_size,count,p); break;
+                case 4: p=pack_field<uint32_t,int32_t>(base,layout.atom_size,count,p); break;
+                default: p=pack_field<uint64_t,int64_t>(base,layout.atom_size,count,p); break;
+            }
+        }
+    }
+    h.size=p-(uint8_t*)out;
+    memcpy(out,&h,sizeof(h));
+    return h.size;
+}
+
+const libera_pack_header_t* libera_pack_header(const void* in,size_t size){
+    const libera_pack_header_t* h=(const libera_pack_header_t*)in;
+    if((in==NULL) || (size<sizeof(*h)) || (h->magic!=LIBERA_PACK_MAGIC) || (h->version!=LIBERA_PACK_VERSION) ||
+       (h->size>size) || (h->size<sizeof(*h)+h->fields*sizeof(libera_pack_field_t)) ||
+       (h->fields>LIBERA_PACK_MAX_FIELDS) || (h->atom_size==0)){
+        return NULL;
+    }
+    return h;
+}
+
+// \return the end of the field stream, NULL if it overruns end
+template <typename U,typename S>
+static const uint8_t* unpack_field(const uint8_t* in,const uint8_t* end,size_t count,char* out,size_t stride){
+    int64_t first;
+    if(end-in<(ptrdiff_t)sizeof(first)){
+        return NULL;
+    }
+    memcpy(&first,in,sizeof(first));
+    in+=sizeof(first);
+    U prev=(U)first;
+    memcpy(out,&prev,sizeof(U));
+    out+=stride;
+    for(size_t i=1;i<count;i+=LIBERA_PACK_BLOCK){
+        const size_t n=std::min((size_t)LIBERA_PACK_BLOCK,count-i);
+        if(in>=end){
+            return NULL;
+        }
+        const int width=*in++;
+        if(width>(int)(8*sizeof(U))){
+            return NULL;
+        }
+        size_t bytes=(n*width+7)/8;
+        if((size_t)(end-in)<bytes){
+            return NULL;
+        }
+        const uint64_t mask=pack_mask(width);
+        uint64_t acc=0;
+        int have=0;
+        for(size_t k=0;k<n;k++,out+=stride){
+            uint64_t z;
+            if(width==0){
+                z=0;
+            } else if(have>=width){
+                z=acc&mask;
+                acc=(width<64)?(acc>>width):0;
+                have-=width;
+            } else {
+                // refill with the next word, the last one may be short
+                uint64_t w=0;
+                const size_t len=std::min(bytes,sizeof(w));
+                memcpy(&w,in,len);
+                in+=len;
+                bytes-=len;
+                z=(acc|(have?(w<<have):w))&mask;
+                acc=(width-have<64)?(w>>(width-have)):0;
+                have+=8*len-width;
+            }
+            const S d=(S)(U)((U)(z>>1)^(U)(0-(U)(z&1)));
+            prev=(U)(prev+(U)d);
+            memcpy(out,&prev,sizeof(U));
+        }
+        in+=bytes;
+    }
+    return in;
+}
+
+int libera_unpack(const void* in,size_t size,void* out,size_t out_size){
+    const libera_pack_header_t* h=libera_pack_header(in,size);
+    if((h==NULL) || ((uint64_t)h->count*h->atom_size>out_size)){
+        return -1;
+    }
+    const libera_pack_field_t* fields=(const libera_pack_field_t*)(h+1);
+    const uint8_t* p=(const uint8_t*)(fields+h->fields);
+    const uint8_t* end=(const uint8_t*)in+h->size;
+    memset(out,0,(size_t)h->count*h->atom_size);
+    if(h->count==0){
+        return 0;
+    }
+    for(int f=0;f<h->fields;f++){
+        if(fields[f].offset+fields[f].size>h->atom_size){
+            return -1;
+        }
+        char* base=(char*)out+fields[f].offset;
+        switch(fields[f].size){
+            case 2: p=unpack_field<uint16_t,int16_t>(p,end,h->count,base,h->atom_size); break;
+            case 4: p=unpack_field<uint32_t,int32_t>(p,end,h->count,base,h->atom_size); break;
+            case 8: p=unpack_field<uint64_t,int64_t>(p,end,h->count,base,h->atom_size); break;
+            default: return -1;
+        }
+        if(p==NULL){
+            return -1;
+        }
+    }
+    return h->count;
+}
+
+const char* libera_latency_stages[LIBERA_LAT_STAGES]={"WAKEUP","SEEK","READ","TRANSFORM","PUBLISH","TOTAL"};
+static const char* latency_figures[LIBERA_LAT_FIGURES]={"P50","P99","MAX"};
+
+std::string libera_latency_attr(int stage,int figure){
+    return std::string("LAT_")+libera_latency_stages[stage]+"_"+latency_figures[figure];
+}
+
+// values below 8 have their own bucket, then 8 buckets per power of 2
+static int latency_bucket(uint64_t ns){
+    if(ns<8)
+        return ns;
+    int e=63-__builtin_clzll(ns);
+    int b=(e-2)*8 + ((ns>>(e-3))&7);
+    return (b<LIBERA_LAT_BUCKETS)?b:LIBERA_LAT_BUCKETS-1;
+}
+
+// first value of the bucket
+static uint64_t latency_bucket_base(int b){
+    if(b<8)
+        return b;
+    return (uint64_t)(8+(b&7))<<(b/8-1);
+}
+
+void libera_latency_stats::reset(){
+    memset(hist,0,sizeof(hist));
+    memset(samples,0,sizeof(samples));
+    memset(max,0,sizeof(max));
+    traced=0;
+}
+
+void libera_latency_stats::add(uint64_t acquisition,const libera_latency_t& lat){
+    uint64_t ns[LIBERA_LAT_STAGES];
+    bool valid[LIBERA_LAT_STAGES];
+    const uint64_t start=lat.trigger?lat.trigger:lat.wakeup;
+
+    valid[LIBERA_LAT_WAKEUP]=lat.trigger && (lat.wakeup>=lat.trigger);
+    ns[LIBERA_LAT_WAKEUP]=lat.wakeup-lat.trigger;
+    valid[LIBERA_LAT_SEEK]=lat.wakeup && (lat.seek>=lat.wakeup);
+    ns[LIBERA_LAT_SEEK]=lat.seek-lat.wakeup;
+    valid[LIBERA_LAT_READ]=lat.seek && (lat.read>=lat.seek+lat.transform);
+    ns[LIBERA_LAT_READ]=lat.read-lat.seek-lat.transform;
+    valid[LIBERA_LAT_TRANSFORM]=valid[LIBERA_LAT_READ];
+    ns[LIBERA_LAT_TRANSFORM]=lat.transform;
+    valid[LIBERA_LAT_PUBLISH]=lat.read && (lat.publish>=lat.read);
+    ns[LIBERA_LAT_PUBLISH]=lat.publish-lat.read;
+    valid[LIBERA_LAT_TOTAL]=start && (lat.publish>=start);
+    ns[LIBERA_LAT_TOTAL]=lat.publish-start;
+
+    libera_latency_trace_t& t=trace[(traced++)%LIBERA_LAT_TRACE_SIZE];
+    t.acquisition=acquisition;
+    t.trigger=start;
+    for(int stage=0;stage<LIBERA_LAT_STAGES;stage++){
+        if(!valid[stage]){
+            t.stage[stage]=0;
+            continue;
+        }
+        t.stage[stage]=(ns[stage]>0xffffffffULL)?0xffffffffU:(uint32_t)ns[stage];
+        hist[stage][latency_bucket(ns[stage])]++;
+        samples[stage]++;
+        if(ns[stage]>max[stage])
+            max[stage]=ns[stage];
+    }
+}
+
+uint64_t libera_latency_stats::percentile(int stage,double p) const{
+    if(samples[stage]==0)
+        return 0;
+    // rank of the sample, 1 based
+    uint64_t rank=(uint64_t)(p*samples[stage]);
+    if(rank<1)
+        rank=1;
+    uint64_t cnt=0;
+    for(int b=0;b<LIBERA_LAT_BUCKETS;b++){
+        cnt+=hist[stage][b];
+        if(cnt>=rank){
+            // upper end of the bucket, never above the max seen
+            uint64_t ns=(b+1<LIBERA_LAT_BUCKETS)?latency_bucket_base(b+1)-1:max[stage];
+            return std::min(ns,max[stage]);
+        }
+    }
+    return max[stage];
+}
+
+size_t libera_latency_stats::get_trace(libera_latency_trace_t* out) const{
+    size_t n=std::min(traced,(uint64_t)LIBERA_LAT_TRACE_SIZE);
+    for(size_t cnt=0;cnt<n;cnt++){
+        out[cnt]=trace[(traced-n+cnt)%LIBERA_LAT_TRACE_SIZE];
     }
+    return n;
+}
@@ -8,25 +8,39 @@
 #ifndef LIBERADATA_H
 #define	LIBERADATA_H
 #include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <string>
 #define LIBERA_IOP_MODE_DD 0x1 // data acquire on demand
-#define LIBERA_IOP_MODE_SA 0x2 // streaming data acquire
+#define LIBERA_IOP_MODE_SA 0x2 // streaming data acquire, runs alongside the other modes (read CHANNEL_SA)
 #define LIBERA_IOP_MODE_ADC 0x4 // ADC data acquire
 #define LIBERA_IOP_MODE_PM 0x8 // Post Mortem data acquire
 #define LIBERA_IOP_MODE_AVG 0x10 // Average data acquire
+#define LIBERA_IOP_PRIMARY_MODES (LIBERA_IOP_MODE_DD|LIBERA_IOP_MODE_ADC|LIBERA_IOP_MODE_PM|LIBERA_IOP_MODE_AVG) // read on CHANNEL_DD, one at a time
 
 #define LIBERA_IOP_MODE_TRIGGERED 0x100
 #define LIBERA_IOP_MODE_DECIMATED 0x200
 #define LIBERA_IOP_MODE_CONTINUOUS 0x400
 #define LIBERA_IOP_MODE_SINGLEPASS 0x800
+#define LIBERA_IOP_MODE_SOA 0x1000 // DD published column major (see libera_dd_to_soa)
+#define LIBERA_IOP_MODE_PACKED 0x2000 // DD, SA, ADC_CW and ADC_SP published packed (see libera_pack), handled by the CU
+
+#define LIBERA_SA_RING_SIZE 1024 // SA atoms kept by the driver stream (~100 s at 10 Hz), must be a power of 2
 
 #define LIBERA_IOP_CMD_ACQUIRE 0x1
-#define LIBERA_IOP_CMD_SETENV 0x2 // Setting environment
-#define LIBERA_IOP_CMD_GETENV 0x3 // getting environment
+#define LIBERA_IOP_CMD_SETENV 0x2 // Setting environment, array of libera_env_t applied in one call
+#define LIBERA_IOP_CMD_GETENV 0x3 // getting environment (fills a libera_env_params_t)
 #define LIBERA_IOP_CMD_SETTIME 0x4 // Setting Time
 #define LIBERA_IOP_CMD_SET_OFFSET 0x5 // set offset in buffer
 #define LIBERA_IOP_CMD_SET_SAMPLES 0x6 // set offset in buffer
-#define LIBERA_IOP_CMD_STOP 0x7
+#define LIBERA_IOP_CMD_STOP 0x7 // stop the acquisition, the SA stream too if data points to LIBERA_IOP_MODE_SA
 #define LIBERA_IOP_CMD_GET_TS 0x8 // get time stamps
+#define LIBERA_IOP_CMD_SET_BUFFER 0x9 // register the destination buffer of read (NULL to unregister), filled with no copy unless triggered
+#define LIBERA_IOP_CMD_GET_LATENCY 0xA // get the libera_latency_t of the last data returned by read
+#define LIBERA_IOP_CMD_SET_SP_SEPARATION 0xB // min ADC atoms between single pass shots, 0 first shot only (read returns the shots)
+#define LIBERA_IOP_CMD_SET_DECIMATION 0xC // DD software decimation (libera_decimation_t), read returns the decimated atoms
+#define LIBERA_IOP_CMD_GET_STATS 0xD // get the libera_stats_t of the last DD returned by read (count 0 in the other modes)
+#define LIBERA_IOP_CMD_GET_SAMPLES 0xE // get the atoms per acquisition (int), kept by the driver until the next SET_SAMPLES
 
 // ERROR
 #define LIBERA_ERROR_READING 0x1
@@ -57,7 +71,190 @@ int _T::size=sizeof(desc)/sizeof(const char*);
 #define CHANNEL_SP 2
 #define CHANNEL_AVG 3
 #define CHANNEL_ENV 4
+
+// DD columns in LIBERA_IOP_MODE_SOA, each column is an array of COUNT int32
+#define LIBERA_DD_SOA_VA 0
+#define LIBERA_DD_SOA_VB 1
+#define LIBERA_DD_SOA_VC 2
+#define LIBERA_DD_SOA_VD 3
+#define LIBERA_DD_SOA_X 4
+#define LIBERA_DD_SOA_Y 5
+#define LIBERA_DD_SOA_Q 6
+#define LIBERA_DD_SOA_SUM 7
+#define LIBERA_DD_SOA_COLUMNS 8
+
+// trigger to publish latency stages
+#define LIBERA_LAT_WAKEUP 0 // trigger event -> acquisition woken up (triggered only)
+#define LIBERA_LAT_SEEK 1 // cspi_seek
+#define LIBERA_LAT_READ 2 // cspi_read, transform excluded
+#define LIBERA_LAT_TRANSFORM 3 // cspi transform of the read atoms
+#define LIBERA_LAT_PUBLISH 4 // end of the read -> dataset published by the CU
+#define LIBERA_LAT_TOTAL 5 // trigger (or start of the read) -> dataset published
+#define LIBERA_LAT_STAGES 6
+#define LIBERA_LAT_BUCKETS 256 // log-linear buckets per stage, 8 per power of 2 (12% resolution, up to 8.6 s)
+#define LIBERA_LAT_TRACE_SIZE 128 // acquisitions kept in the trace
+// latency figures published per stage
+#define LIBERA_LAT_P50 0
+#define LIBERA_LAT_P99 1
+#define LIBERA_LAT_MAX 2
+#define LIBERA_LAT_FIGURES 3
+
+// CLOCK_MONOTONIC timestamps [ns] of an acquisition, 0 if the stage did not take place
+typedef struct libera_latency {
+    uint64_t trigger; // trigger event captured
+    uint64_t wakeup; // acquisition woken up by the trigger, or read started
+    uint64_t seek; // cspi_seek returned
+    uint64_t read; // cspi_read returned
+    uint64_t transform; // duration [ns] of the transform, within the read
+    uint64_t publish; // dataset published
+} libera_latency_t;
+
+// trace record of an acquisition
+typedef struct libera_latency_trace {
+    uint64_t acquisition; // acquisition number
+    uint64_t trigger; // CLOCK_MONOTONIC [ns] of the trigger (or start of the read)
+    uint32_t stage[LIBERA_LAT_STAGES]; // [ns], saturated to 0xffffffff
+} libera_latency_trace_t;
+
+/**
+ per stage latency histograms and trace of the last LIBERA_LAT_TRACE_SIZE acquisitions
+ */
+struct libera_latency_stats {
+    uint32_t hist[LIBERA_LAT_STAGES][LIBERA_LAT_BUCKETS];
+    uint64_t samples[LIBERA_LAT_STAGES];
+    uint64_t max[LIBERA_LAT_STAGES];
+    libera_latency_trace_t trace[LIBERA_LAT_TRACE_SIZE];
+    uint64_t traced;
+
+    libera_latency_stats(){reset();}
+    void reset();
+    /**
+     account the stages of an acquisition
+     */
+    void add(uint64_t acquisition,const libera_latency_t& lat);
+    /**
+     \return the latency [ns] below which fall the fraction p (0..1) of the samples of stage, 0 if no samples
+     */
+    uint64_t percentile(int stage,double p) const;
+    /**
+     copy the trace, oldest first
+     \return the number of records copied
+     */
+    size_t get_trace(libera_latency_trace_t* out) const;
+};
+
+extern const char* libera_latency_stages[LIBERA_LAT_STAGES];
+/**
+ \return the name of the output attribute of a figure (LIBERA_LAT_P50..) of a stage, i.e. LAT_READ_P99
+ */
+std::string libera_latency_attr(int stage,int figure);
+
+/**
+ \return CLOCK_MONOTONIC [ns]
+ */
+inline uint64_t libera_monotonic_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
     
+// waveform statistics, quantities
+#define LIBERA_STATS_X 0
+#define LIBERA_STATS_Y 1
+#define LIBERA_STATS_Q 2
+#define LIBERA_STATS_SUM 3
+#define LIBERA_STATS_FIELDS 4
+// figures published per quantity
+#define LIBERA_STATS_MEAN 0
+#define LIBERA_STATS_RMS 1 // deviation from the mean
+#define LIBERA_STATS_MIN 2
+#define LIBERA_STATS_MAX 3
+#define LIBERA_STATS_P2P 4
+#define LIBERA_STATS_FIGURES 5
+
+// statistics of the atoms of an acquisition
+typedef struct libera_stats {
+    uint32_t count; // atoms, 0 no statistics
+    double mean[LIBERA_STATS_FIELDS];
+    double rms[LIBERA_STATS_FIELDS];
+    int32_t min[LIBERA_STATS_FIELDS];
+    int32_t max[LIBERA_STATS_FIELDS];
+    double x_wmean,y_wmean; // X and Y means weighted by Sum, the plain means if Sum is 0
+} libera_stats_t;
+
+extern const char* libera_stats_fields[LIBERA_STATS_FIELDS];
+/**
+ \return the name of the output attribute of a figure (LIBERA_STATS_MEAN..) of a quantity, i.e. X_RMS
+ */
+std::string libera_stats_attr(int field,int figure);
+
+// DD software decimation filters
+#define LIBERA_DEC_NONE 0
+#define LIBERA_DEC_BOXCAR 1 // mean of the factor atoms
+#define LIBERA_DEC_CIC 2 // LIBERA_DEC_CIC_STAGES stages CIC, unity gain
+#define LIBERA_DEC_FIR 3 // Hamming windowed sinc low pass at the decimated Nyquist, LIBERA_DEC_FIR_SPAN*factor+1 taps
+#define LIBERA_DEC_CIC_STAGES 3
+#define LIBERA_DEC_FIR_SPAN 4
+#define LIBERA_DEC_MAX_FACTOR 1024 // CIC gain factor^3 must fit the 64 bit integrators
+#define LIBERA_DEC_MAX_INPUT (1024*1024) // max DD atoms read per decimated acquisition (samples*factor)
+
+typedef struct libera_decimation {
+    int32_t filter; // LIBERA_DEC_xx
+    int32_t factor; // input atoms per output atom, 1 no decimation
+} libera_decimation_t;
+
+#define LIBERA_PACK_MAGIC 0x4b50424c // "LBPK"
+#define LIBERA_PACK_VERSION 1
+#define LIBERA_PACK_BLOCK 128 // deltas of a field sharing one bit width
+#define LIBERA_PACK_MAX_FIELDS 32
+
+// packed buffer: header, the fields descriptors, then one stream per field
+// (int64 first value, then for each LIBERA_PACK_BLOCK deltas one byte bit width
+// and the zigzag encoded deltas bit packed, LSB first). Little endian.
+typedef struct libera_pack_header {
+    uint32_t magic; // LIBERA_PACK_MAGIC
+    uint8_t version;
+    uint8_t fields; // libera_pack_field_t following the header
+    uint16_t atom_size; // of the unpacked atoms
+    uint32_t count; // atoms
+    uint32_t size; // of the packed buffer, header included
+} libera_pack_header_t;
+
+typedef struct libera_pack_field {
+    uint16_t offset; // in the atom
+    uint8_t size; // 2, 4 or 8 bytes integer
+    uint8_t reserved;
+} libera_pack_field_t;
+
+// binary recording (daqLiberaClient --binary): a libera_rec_header_t, then for
+// every acquisition a libera_rec_block_t followed by its count atoms, as published
+#define LIBERA_REC_MAGIC 0x4345524c // "LREC"
+#define LIBERA_REC_VERSION 1
+// atom types, as daqLiberaClient --acquire
+#define LIBERA_REC_DD 1
+#define LIBERA_REC_SA 2
+#define LIBERA_REC_ADC_SP 3
+#define LIBERA_REC_ADC_CW 4
+#define LIBERA_REC_FLAG_SOA 0x1 // DD atoms of a block are column major
+
+typedef struct libera_rec_header {
+    uint32_t magic; // LIBERA_REC_MAGIC
+    uint16_t version;
+    uint16_t atom_type; // LIBERA_REC_xx
+    uint32_t atom_size; // bytes
+    int32_t samples; // requested per acquisition
+    uint32_t flags; // LIBERA_REC_FLAG_xx
+    uint32_t reserved;
+} libera_rec_header_t;
+
+typedef struct libera_rec_block {
+    uint64_t acquisition; // ACQUISITION, gaps are acquisitions not recorded
+    uint64_t mt; // machine time
+    uint64_t st; // system time [us]
+    uint64_t ts; // dataset timestamp
+    uint32_t count; // atoms following
+    uint32_t reserved;
+} libera_rec_block_t;
 
 typedef struct libera_env {
     uint64_t selector;
@@ -74,6 +271,23 @@ typedef struct libera_env {
     typedef CSPI_AVERAGE_ATOM libera_avg_t;
     typedef CSPI_AVERAGE_ATOM libera_avg_t;
     typedef CSPI_TIMESTAMP libera_ts_t;
+    typedef CSPI_ENVPARAMS libera_env_params_t;
+
+    // environment field published as an INT32 output attribute, the long
+    // fields are truncated: keep to fields whose values fit in 32 bits
+    typedef struct libera_env_attr {
+        const char* name;
+        const char* desc;
+        size_t offset; // of the field in libera_env_params_t
+        size_t size; // of the field, int or (unsigned) long
+    } libera_env_attr_t;
+
+    extern const libera_env_attr_t libera_env_attrs[];
+    extern const int libera_env_attrs_size;
+    /**
+     \return the value of the field described by attr in env
+     */
+    int32_t libera_env_value(const libera_env_params_t& env,const libera_env_attr_t& attr);
     
     class libera_desc{
     protected:
@@ -85,7 +299,7 @@ typedef struct libera_env {
             
             
         }
-        std::vector<const char*> getDesc() const {return p;}
+        const std::vector<const char*>& getDesc() const {return p;}
         friend std::ostream& operator<<(std::ostream&os,const libera_desc&data);
         
     };
@@ -104,6 +318,78 @@ typedef struct libera_env {
     std::ostream& operator <<(std::ostream&os,const libera_cw_t& data);
     std::ostream& operator <<(std::ostream&os,const libera_sp_t& data); 
     std::ostream& operator <<(std::ostream&os,const libera_avg_t& data);
+
+    /**
+     transpose count DD atoms into out as LIBERA_DD_SOA_COLUMNS contiguous columns of count int32
+     (Va[count],Vb[count],...,Sum[count]), out must not overlap in
+     */
+    void libera_dd_to_soa(const libera_dd_t* in,int32_t* out,size_t count);
+    /**
+     \return the column col (LIBERA_DD_SOA_xx) of a SoA DD buffer holding count atoms
+     */
+    inline const int32_t* libera_dd_soa_column(const void* buffer,size_t count,int col){
+        return (const int32_t*)buffer + col*count;
+    }
+
+    /**
+     software decimator of DD atoms, every field is filtered as an integer signal.
+     Output atom m is centered on the input atoms [m*factor,(m+1)*factor), the atoms
+     before the first and after the last are taken equal to them (no start up transient).
+     */
+    struct libera_decimator {
+        libera_decimation_t cfg;
+        std::vector<int32_t> taps; // FIR, Q16, sum 1<<16
+
+        libera_decimator(){libera_decimation_t none={LIBERA_DEC_NONE,1};set(none);}
+        /**
+         \return 0, -1 if the filter or the factor (1..LIBERA_DEC_MAX_FACTOR) is invalid
+         */
+        int set(const libera_decimation_t& dec);
+        bool enabled() const {return (cfg.filter!=LIBERA_DEC_NONE) && (cfg.factor>1);}
+        /**
+         decimate count atoms of in into out, out must not overlap in
+         \return the atoms written, count/factor
+         */
+        size_t run(const libera_dd_t* in,libera_dd_t* out,size_t count) const;
+    };
+
+    /**
+     statistics of X, Y, Q and Sum over count atoms, in one pass
+     */
+    void libera_dd_stats(const libera_dd_t* in,size_t count,libera_stats_t* stats);
+    void libera_sa_stats(const libera_sa_t* in,size_t count,libera_stats_t* stats);
+
+    // integer fields of an atom type, packed one after the other
+    typedef struct libera_pack_layout {
+        const libera_pack_field_t* fields;
+        int size;
+        size_t atom_size;
+    } libera_pack_layout_t;
+
+    extern const libera_pack_layout_t libera_dd_pack;
+    extern const libera_pack_layout_t libera_sa_pack;
+    extern const libera_pack_layout_t libera_cw_pack;
+    extern const libera_pack_layout_t libera_sp_pack;
+
+    /**
+     \return the max size of count atoms packed with layout
+     */
+    size_t libera_pack_bound(const libera_pack_layout_t& layout,size_t count);
+    /**
+     pack count atoms of in, out must hold libera_pack_bound bytes
+     \return the bytes written in out
+     */
+    size_t libera_pack(const libera_pack_layout_t& layout,const void* in,size_t count,void* out);
+    /**
+     \return the header of the packed buffer in, NULL if in is not a packed buffer of size bytes at most
+     */
+    const libera_pack_header_t* libera_pack_header(const void* in,size_t size);
+    /**
+     unpack the buffer in (size bytes at most) into out, the bytes not covered
+     by the fields (padding) are zeroed
+     \return the atoms written in out, -1 if in is malformed or out (out_size bytes) is too small
+     */
+    int libera_unpack(const void* in,size_t size,void* out,size_t out_size);
    
 #else
 #error "NO LIBERA PLATFORM SPECIFIED"
@@ -89,6 +89,14 @@ void SCLiberaCU::unitDefineActionAndDataset() throw(chaos::CException) {
 						  "Samples to acquire",
 						  DataType::TYPE_INT32,
 						  DataType::Output);
+        addAttributeToDataSet("COUNT",
+						  "Atoms in the last DD/SA array",
+						  DataType::TYPE_INT32,
+						  DataType::Output);
+        addAttributeToDataSet("SA_COUNT",
+						  "Atoms in the last SA array",
+						  DataType::TYPE_INT32,
+						  DataType::Output);
 	addAttributeToDataSet("ACQUISITION",
 						  "Acquisition number",
 						  DataType::TYPE_INT64,
@@ -124,10 +132,13 @@ void SCLiberaCU::unitDefineActionAndDataset() throw(chaos::CException) {
 						  "error status",
 						  DataType::TYPE_INT32,
 						  DataType::Output);
-        addAttributeToDataSet("STATUS",
-						  "status",
-						  DataType::TYPE_STRING,
-						  DataType::Output,MAX_STRING);
+        // environment, written only when changed
+        for(int cnt=0;cnt<libera_env_attrs_size;cnt++){
+            addAttributeToDataSet(libera_env_attrs[cnt].name,
+						  libera_env_attrs[cnt].desc,
+						  DataType::TYPE_INT32,
+						  DataType::Output);
+        }
         
 	//setup the dataset
 	addAttributeToDataSet("DD",
@@ -154,6 +165,40 @@ void SCLiberaCU::unitDefineActionAndDataset() throw(chaos::CException) {
 						  "Data Average",
 						  DataType::TYPE_BYTEARRAY,
 						  DataType::Output,1 * sizeof(libera_avg_t));
+
+        // statistics of the DD (or SA alone) atoms of the last acquisition
+        for(int field=0;field<LIBERA_STATS_FIELDS;field++){
+            for(int figure=0;figure<LIBERA_STATS_FIGURES;figure++){
+                static const char* figures[LIBERA_STATS_FIGURES]={"mean","RMS deviation from the mean","min","max","peak to peak"};
+                std::string desc=std::string(libera_stats_fields[field])+" "+figures[figure];
+                addAttributeToDataSet(libera_stats_attr(field,figure).c_str(),
+						  desc.c_str(),
+						  ((figure==LIBERA_STATS_MEAN)||(figure==LIBERA_STATS_RMS))?DataType::TYPE_DOUBLE:DataType::TYPE_INT64,
+						  DataType::Output);
+            }
+        }
+        addAttributeToDataSet("X_WMEAN","X mean weighted by SUM",DataType::TYPE_DOUBLE,chaos::DataType::Output);
+        addAttributeToDataSet("Y_WMEAN","Y mean weighted by SUM",DataType::TYPE_DOUBLE,chaos::DataType::Output);
+
+        // trigger to publish latency of the current acquisition
+        for(int stage=0;stage<LIBERA_LAT_STAGES;stage++){
+            for(int figure=0;figure<LIBERA_LAT_FIGURES;figure++){
+                std::string desc=std::string(libera_latency_stages[stage])+" latency "+
+                    ((figure==LIBERA_LAT_P50)?"median":(figure==LIBERA_LAT_P99)?"99th percentile":"max")+" [ns]";
+                addAttributeToDataSet(libera_latency_attr(stage,figure).c_str(),
+						  desc.c_str(),
+						  DataType::TYPE_INT64,
+						  DataType::Output);
+            }
+        }
+        addAttributeToDataSet("LAT_HIST",
+						  "Latency histograms, LAT stages x LAT buckets uint32",
+						  DataType::TYPE_BYTEARRAY,
+						  DataType::Output,sizeof(((libera_latency_stats*)0)->hist));
+        addAttributeToDataSet("LAT_TRACE",
+						  "Latency of the last acquisitions (libera_latency_trace_t)",
+						  DataType::TYPE_BYTEARRAY,
+						  DataType::Output,LIBERA_LAT_TRACE_SIZE * sizeof(libera_latency_trace_t));
         
 	
 }
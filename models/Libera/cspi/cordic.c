@@ -127,3 +127,52 @@ int cordic_amp( int I, int Q )
 	return cordic_correct(I);	// Compensate the CORDIC gain
 }
 
+//--------------------------------------------------------------------------
+
+void cordic_amp_batch( const int *I, const int *Q, int *A, size_t count )
+{
+	// Same algorithm as cordic_amp, with the rotation direction applied
+	// as a conditional negation: (x ^ s) - s is x for s = 0 and -x for
+	// s = -1. The fixed size lane loops are left to the compiler to
+	// vectorize (NEON, SSE).
+
+	size_t n = 0;
+
+	for( ; n + CORDIC_BATCH <= count; n += CORDIC_BATCH ) {
+
+		int vI[CORDIC_BATCH], vQ[CORDIC_BATCH];
+		int k, L;
+
+		for( k=0; k<CORDIC_BATCH; ++k ) {
+
+			const int i0 = I[n+k];
+			const int q0 = Q[n+k];
+			const int neg = -( i0 < 0 );	// all ones if I < 0
+			const int qpos = -( q0 > 0 );	// all ones if Q > 0
+
+			// Rotate by -90 (Q > 0) or +90 degrees, when I < 0
+			const int rI = ( q0 ^ ~qpos ) - ~qpos;	// Q > 0 ? Q : -Q
+			const int rQ = ( i0 ^ qpos ) - qpos;	// Q > 0 ? -I : I
+
+			vI[k] = ( rI & neg ) | ( i0 & ~neg );
+			vQ[k] = ( rQ & neg ) | ( q0 & ~neg );
+		}
+
+		for( L=0; L <= CORDIC_MAXLEVEL; ++L ) {
+
+			for( k=0; k<CORDIC_BATCH; ++k ) {
+
+				const int s = vQ[k] >> 31;	// all ones on negative phase
+				const int dI = vQ[k] >> L;
+				const int dQ = vI[k] >> L;
+
+				vI[k] += ( dI ^ s ) - s;
+				vQ[k] -= ( dQ ^ s ) - s;
+			}
+		}
+
+		for( k=0; k<CORDIC_BATCH; ++k ) A[n+k] = cordic_correct( vI[k] );
+	}
+
+	for( ; n < count; ++n ) A[n] = cordic_amp( I[n], Q[n] );
+}
@@ -6,6 +6,11 @@
 #if !defined(_CORDIC_H)
 #define _CORDIC_H
 
+#include <stddef.h>
+
+/** Number of (I,Q) pairs processed per iteration by cordic_amp_batch. */
+#define CORDIC_BATCH 8
+
 /** Private.
  *  Calculates the amplitude from I and Q (sin and cos) value.
  *  Returns amplitude.
@@ -15,4 +20,16 @@
  */
 int cordic_amp( int I, int Q );
 
+/** Private.
+ *  Calculates the amplitudes of count (I,Q) pairs, CORDIC_BATCH pairs
+ *  at a time without data dependent branches. Results are identical
+ *  to cordic_amp.
+ *
+ *  @param I Pointer to count I (sin) components.
+ *  @param Q Pointer to count Q (cos) components.
+ *  @param A Pointer to count amplitudes to overwrite.
+ *  @param count Number of pairs.
+ */
+void cordic_amp_batch( const int *I, const int *Q, int *A, size_t count );
+
 #endif	// _CORDIC_H
@@ -36,12 +36,17 @@ TAB = 4 spaces.
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
 #include <sys/ioctl.h>
 
 #include "eventd.h"		///chek!!!
 
 #include "cspi.h"
 #include "cspi_impl.h"
+#include "health.h"
+#include "io.h"
 #include "msp.h"
 
 /** A list of error messages corresponding to error codes. */
@@ -75,7 +80,7 @@ Environment environment = {
 	0,
 	-1,
 	CSPI_TRIGMODE_UNKNOWN,
-	{ CSPI_VER, 0 },
+	{ CSPI_VER, 0, CSPI_TRANSFORM_BATCH, HEALTH_PERIOD, CSPI_BACKEND_DEVICE },
 };
 
 //--------------------------------------------------------------------------
@@ -260,14 +265,21 @@ int base_initenv( CSPIHANDLE h )
 
 	if ( 1 == p->usage_count ) {
 
+		// All the devices of this environment go through one backend.
+		if ( CSPI_OK != io_select( (p->module).backend ) ) return CSPI_E_INVALID_PARAM;
+
 		int flags = ( (p->module).superuser ) ? O_RDWR : O_RDONLY;
-		p->fd = open( "/dev/libera.cfg", flags );
+		p->fd = io_open( "/dev/libera.cfg", flags );
 
 		if (-1 == p->fd) {
 
 			VERIFY( 0 == reset_sighandler() );
 			return CSPI_E_SYSTEM;
 		}
+
+		// Health is sampled in the background, a failure here is
+		// reported by the CSPI_ENV_HEALTH queries.
+		health_start( (p->module).health_period );
 	}
 
 	ASSERT(p->fd > 0);
@@ -279,7 +291,7 @@ int base_initenv( CSPIHANDLE h )
 int test_drvmismatch(int fd)
 {
 	int magic;
-	int rc = ioctl( fd, LIBERA_IOC_GET_MAGIC, &magic );
+	int rc = io_ioctl( fd, LIBERA_IOC_GET_MAGIC, &magic );
 	if (-1 == rc) return CSPI_E_SYSTEM;
 
 	return LIBERA_MAGIC == magic ? CSPI_OK : CSPI_E_VERSION;
@@ -304,7 +316,9 @@ int destroy_env( CSPIHANDLE h )
 		// if this is the last environment handle.
 		if ( 0 != p->connection_count ) return CSPI_E_SEQUENCE;
 
-		VERIFY( 0 == close( p->fd ) );
+		health_stop();
+
+		VERIFY( 0 == io_close( p->fd ) );
 		p->fd = -1;
 
 		// Reset signal handler to the default action.
@@ -343,11 +357,52 @@ int alloc_con( CSPIHANDLE h, CSPIHANDLE *p )
 void free_con( CSPIHANDLE h )
 {
 	ASSERT( is_hcon(h) );
+	free( ((Connection*)h)->scratch );
 	free( h );
 }
 
 //--------------------------------------------------------------------------
 
+void *get_scratch( Connection *p, size_t size )
+{
+	ASSERT(p);
+
+	if ( size > p->scratch_size ) {
+
+		void *buff = 0;
+		if ( posix_memalign( &buff, CSPI_CACHE_LINE, size ) ) return NULL;
+
+		free( p->scratch );
+		p->scratch = buff;
+		p->scratch_size = size;
+	}
+	return p->scratch;
+}
+
+//--------------------------------------------------------------------------
+
+int apply_op( Connection *p, CSPI_AUX_FNC op, const void *in, void *out,
+              size_t count )
+{
+	ASSERT(p);
+	ASSERT(op);
+
+	// The shot separation is a connection parameter, the default op
+	// (CSPI_AUX_FNC) cannot see it.
+	const int sp_shots = p->sp_separation && op == custom_getdefaultop( p ) &&
+		( CSPI_MODE_ADC_SP == p->mode || CSPI_MODE_ADC_SP_ROT == p->mode );
+
+	struct timespec t0, t1;
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+	const int rc = sp_shots ? custom_transform_sp( p, in, out, count ) : op( in, out, count );
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+
+	p->op_time = (t1.tv_sec - t0.tv_sec) * 1000000000UL + t1.tv_nsec - t0.tv_nsec;
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
 int base_initcon( CSPIHANDLE h, CSPIHANDLE hc )
 {
 	ASSERT( is_henv(h) );
@@ -481,6 +536,26 @@ int set_libparam( Library *module, const CSPI_LIBPARAMS *p, CSPI_BITMASK flags )
 		module->version = p->version;
 	}
 	if ( flags & CSPI_LIB_SUPERUSER ) module->superuser = p->superuser;
+	if ( flags & CSPI_LIB_TRANSFORM ) module->transform = p->transform;
+	if ( flags & CSPI_LIB_BACKEND ) {
+
+		// Devices already open on the current backend.
+		if ( -1 != environment.fd ) return CSPI_E_SEQUENCE;
+		if ( CSPI_BACKEND_DEVICE != p->backend &&
+		     CSPI_BACKEND_SIM != p->backend ) return CSPI_E_INVALID_PARAM;
+		module->backend = p->backend;
+	}
+	if ( flags & CSPI_LIB_HEALTH ) {
+
+		if ( p->health_period < 0 ) return CSPI_E_INVALID_PARAM;
+		module->health_period = p->health_period;
+
+		// Apply to a running environment (0 stops the sampler thread).
+		if ( -1 != environment.fd ) {
+			if ( !module->health_period ) health_stop();
+			health_start( module->health_period );
+		}
+	}
 
 	return CSPI_OK;
 }
@@ -511,6 +586,9 @@ int get_libparam( Library *module, CSPI_LIBPARAMS *p, CSPI_BITMASK flags )
 	/* Assume environment has been locked by caller. */
 	if ( flags & CSPI_LIB_VERSION ) p->version = module->version;
 	if ( flags & CSPI_LIB_SUPERUSER ) p->superuser = module->superuser;
+	if ( flags & CSPI_LIB_TRANSFORM ) p->transform = module->transform;
+	if ( flags & CSPI_LIB_HEALTH ) p->health_period = module->health_period;
+	if ( flags & CSPI_LIB_BACKEND ) p->backend = module->backend;
 
 	return CSPI_OK;
 }
@@ -529,96 +607,13 @@ int cspi_sethealthparam(Environment *e, const CSPI_ENVPARAMS *p,
 
 //--------------------------------------------------------------------------
 
-int cspi_health_get_temp( int *temp, const char *proc_filename )
-{
-
-	FILE *fp = fopen (proc_filename, "r" );
-	if ( !fp ) return CSPI_E_SYSTEM;
-
-	fscanf( fp, "%d\n",temp );
-	fclose( fp );
-	*temp = *temp / 1000;
-	return CSPI_OK;
-}
-
-int cspi_health_get_fan( int *speed, const char *proc_filename )
-{
-	FILE *fp = fopen( proc_filename, "r" );
-	if ( !fp ) return CSPI_E_SYSTEM;
-
-	fscanf( fp, "%d\n", speed );
-	fclose( fp );
-
-	return CSPI_OK;
-}
-
-int cspi_health_get_voltages( int *voltage )
-{
-	int rc = CSPI_OK;
-	size_t nread, i;
-	msp_atom_t msp_atom;
-	const char *mspdev = "/dev/msp0";
-
-	int fd = open(mspdev, O_RDONLY);
-	if ( fd < 0 ) return CSPI_E_SYSTEM;
-
-	nread = read( fd, &msp_atom, sizeof(msp_atom_t));
-	if ( ( nread != sizeof(msp_atom_t) ) &&
-			( nread < 0 ) )
-		rc = CSPI_E_SYSTEM;
-
-	for (i = 0; i < 8; i++)
-		*(voltage + i) = msp_atom.voltage[i];
-
-	close(fd);
-	return rc;
-}
-
-//--------------------------------------------------------------------------
-
 int cspi_gethealthparam(Environment *e, CSPI_ENVPARAMS *p,
                         CSPI_BITMASK flags)
 {
-	const char *dir       = "/sys/class/i2c-adapter/i2c-0";
-	const char *check_dir = "/sys/class/i2c-adapter/i2c-0/device/0-0029";
-	const char *proc_temp = "/0-0029/temp1_input";
-	const char *proc_fan0 = "/0-004b/fan1_input";
-	const char *proc_fan1 = "/0-0048/fan1_input";
-	char p_temp[1024];
-	char p_fan0[1024];
-	char p_fan1[1024];
+	// Served from the health sampler, see health.c
+	if ( flags & CSPI_ENV_HEALTH ) return health_get( &p->health );
 
-	int rc = CSPI_OK;
-
-	if ( flags & CSPI_ENV_HEALTH ) {
-
-		if (access(check_dir, F_OK)==0) {
-			sprintf(p_temp, "%s/device%s", dir, proc_temp);
-			sprintf(p_fan0, "%s/device%s", dir, proc_fan0);
-			sprintf(p_fan1, "%s/device%s", dir, proc_fan1);
-		}
-		else {
-			sprintf(p_temp, "%s%s", dir, proc_temp);
-			sprintf(p_fan0, "%s%s", dir, proc_fan0);
-			sprintf(p_fan1, "%s%s", dir, proc_fan1);
-		}
-
-    	// Temperature
-		rc = cspi_health_get_temp( &p->health.temp, p_temp );
-		if ( CSPI_OK != rc ) return rc;
-
-		// Front fan
-		rc = cspi_health_get_fan( &p->health.fan[0], p_fan0 );
-		if ( CSPI_OK != rc ) return rc;
-		// Back fan
-		rc = cspi_health_get_fan( &p->health.fan[1], p_fan1 );
-		if ( CSPI_OK != rc ) return rc;
-
-		// PS voltages
-		rc = cspi_health_get_voltages( p->health.voltage );
-		if ( CSPI_OK != rc ) return rc;
-	}
-	return rc;
+	return CSPI_OK;
 }
 
 //--------------------------------------------------------------------------
@@ -643,12 +638,12 @@ int cspi_getfeatureparam(Environment *e, CSPI_ENVPARAMS *p,
 		libera_cfg_request_t req;
 
 		req.idx = LIBERA_CFG_FEATURE_CUSTOMER;
-		if ( -1 == ioctl( e->fd, LIBERA_IOC_GET_CFG, &req ) )
+		if ( -1 == io_ioctl( e->fd, LIBERA_IOC_GET_CFG, &req ) )
 			return CSPI_E_SYSTEM;
 		p->feature.customer = req.val;
 
 		req.idx = LIBERA_CFG_FEATURE_ITECH;
-		if ( -1 == ioctl( e->fd, LIBERA_IOC_GET_CFG, &req ) )
+		if ( -1 == io_ioctl( e->fd, LIBERA_IOC_GET_CFG, &req ) )
 			return CSPI_E_SYSTEM;
 		p->feature.itech = req.val;
 	}
@@ -670,6 +665,9 @@ int cspi_setenvparam( CSPIHENV h, const CSPI_ENVPARAMS *p, CSPI_BITMASK flags )
 	// Call derived (customized) function to set parameters.
 	int rc = custom_setenvparam( e, p, flags );
 
+	// Read back from the device what was (maybe partially) set.
+	e->snapshot_valid &= ~flags;
+
 	VERIFY( 0 == pthread_mutex_unlock( &e->mutex ) );
 	return rc;
 }
@@ -739,6 +737,96 @@ int cspi_getenvparam( CSPIHENV h, CSPI_ENVPARAMS *p, CSPI_BITMASK flags )
 
 //--------------------------------------------------------------------------
 
+/** Private.
+ *  Returns the milliseconds elapsed from ts to now.
+ */
+static unsigned long snapshot_age( const struct timespec *ts, const struct timespec *now )
+{
+	return (now->tv_sec - ts->tv_sec) * 1000 +
+	       (now->tv_nsec - ts->tv_nsec) / 1000000;
+}
+
+//--------------------------------------------------------------------------
+
+int cspi_getenvparam_cached( CSPIHENV h, CSPI_ENVPARAMS *p,
+                             CSPI_BITMASK flags, unsigned long max_age )
+{
+	CSPI_LOG("%s(%p, %p, %llu, %lu)", __FUNCTION__, h, p, flags, max_age);
+
+	if ( !is_henv(h) ) return CSPI_E_INVALID_HANDLE;
+	if ( !p ) return CSPI_E_INVALID_PARAM;
+
+	struct timespec now;
+	if ( clock_gettime( CLOCK_MONOTONIC, &now ) ) return CSPI_E_SYSTEM;
+
+	Environment *e =  (Environment*) h;
+	VERIFY( 0 == pthread_mutex_lock( &e->mutex ) );
+
+	// Fields never read, invalidated by a set or older than max_age.
+	CSPI_BITMASK stale = flags & ~e->snapshot_valid;
+	size_t i;
+	for ( i=0; i<CSPI_ENV_FIELDS; ++i ) {
+
+		const CSPI_BITMASK bit = BIT(i);
+		if ( (flags & e->snapshot_valid & bit) &&
+		     snapshot_age( &e->snapshot_ts[i], &now ) >= max_age ) stale |= bit;
+	}
+
+	int rc = CSPI_OK;
+	if ( stale ) {
+
+		// One pass over the stale fields only.
+		rc = custom_getenvparam( e, &e->snapshot, stale );
+		if ( CSPI_OK == rc ) {
+
+			for ( i=0; i<CSPI_ENV_FIELDS; ++i )
+				if ( stale & BIT(i) ) e->snapshot_ts[i] = now;
+
+			e->snapshot_valid |= stale;
+		}
+	}
+	if ( CSPI_OK == rc ) *p = e->snapshot;
+
+	VERIFY( 0 == pthread_mutex_unlock( &e->mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+int cspi_getenvparam_age( CSPIHENV h, CSPI_BITMASK flags, unsigned long *age )
+{
+	CSPI_LOG("%s(%p, %llu, %p)", __FUNCTION__, h, flags, age);
+
+	if ( !is_henv(h) ) return CSPI_E_INVALID_HANDLE;
+	if ( !age || !flags ) return CSPI_E_INVALID_PARAM;
+
+	struct timespec now;
+	if ( clock_gettime( CLOCK_MONOTONIC, &now ) ) return CSPI_E_SYSTEM;
+
+	Environment *e =  (Environment*) h;
+	VERIFY( 0 == pthread_mutex_lock( &e->mutex ) );
+
+	*age = 0;
+	if ( flags & ~e->snapshot_valid ) {
+		*age = ULONG_MAX;
+	}
+	else {
+		size_t i;
+		for ( i=0; i<CSPI_ENV_FIELDS; ++i ) {
+
+			if ( flags & BIT(i) ) {
+				const unsigned long a = snapshot_age( &e->snapshot_ts[i], &now );
+				if ( a > *age ) *age = a;
+			}
+		}
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &e->mutex ) );
+	return CSPI_OK;
+}
+
+//--------------------------------------------------------------------------
+
 int handle_params( int fd, Param_map *p, CSPI_BITMASK flags, int op )
 {
 	ASSERT(fd > 0);
@@ -777,7 +865,7 @@ int set_param( int fd, int *p, const Param_traits *traits )
 	if ( validate && !validate(p) ) return CSPI_E_INVALID_PARAM;
 
 	libera_cfg_request_t request = { traits->code, *p };
-	if ( -1 == ioctl( fd, LIBERA_IOC_SET_CFG, &request ) ) return CSPI_E_SYSTEM;
+	if ( -1 == io_ioctl( fd, LIBERA_IOC_SET_CFG, &request ) ) return CSPI_E_SYSTEM;
 
 	return CSPI_OK;
 }
@@ -792,7 +880,7 @@ int get_param( int fd, int *p, const Param_traits *traits )
 	ASSERT(traits);
 
 	libera_cfg_request_t request = { traits->code, 0 };
-	if ( -1 == ioctl( fd, LIBERA_IOC_GET_CFG, &request ) ) return CSPI_E_SYSTEM;
+	if ( -1 == io_ioctl( fd, LIBERA_IOC_GET_CFG, &request ) ) return CSPI_E_SYSTEM;
 
 	*p = request.val;
 
@@ -864,18 +952,18 @@ int cspi_setenvparam_fa( CSPIHENV h, size_t offset,
 	if ( size % 4 ) return CSPI_E_INVALID_PARAM;
 
 	Environment *e =  (Environment*) h;
-	int fd = open( "/dev/libera.fa", O_WRONLY );
+	int fd = io_open( "/dev/libera.fa", O_WRONLY );
 	if ( -1 == fd ) return CSPI_E_SYSTEM;
 
 	int rc = CSPI_E_SYSTEM;
 	VERIFY( 0 == pthread_mutex_lock( &e->mutex ) );
 
-	if ((off_t)-1 != lseek(fd, offset, SEEK_SET)) {
-		if ((count*size) == write(fd, pbuf, count*size)) rc = CSPI_OK;
+	if ((off_t)-1 != io_lseek(fd, offset, SEEK_SET)) {
+		if ((count*size) == io_write(fd, pbuf, count*size)) rc = CSPI_OK;
 	}
 
 	VERIFY( 0 == pthread_mutex_unlock( &e->mutex ) );
-	VERIFY( 0 == close(fd) );
+	VERIFY( 0 == io_close(fd) );
     return rc;
 }
 
@@ -894,18 +982,18 @@ int cspi_getenvparam_fa( CSPIHENV h, size_t offset,
 	if ( size % 4 ) return CSPI_E_INVALID_PARAM;
 
 	Environment *e =  (Environment*) h;
-	int fd = open( "/dev/libera.fa", O_RDONLY );
+	int fd = io_open( "/dev/libera.fa", O_RDONLY );
 	if ( -1 == fd ) return CSPI_E_SYSTEM;
 
 	int rc = CSPI_E_SYSTEM;
 	VERIFY( 0 == pthread_mutex_lock( &e->mutex ) );
 
-	if ((off_t)-1 != lseek(fd, offset, SEEK_SET)) {
-		if ((count*size) == read(fd, pbuf, count*size)) rc = CSPI_OK;
+	if ((off_t)-1 != io_lseek(fd, offset, SEEK_SET)) {
+		if ((count*size) == io_read(fd, pbuf, count*size)) rc = CSPI_OK;
 	}
 
 	VERIFY( 0 == pthread_mutex_unlock( &e->mutex ) );
-	VERIFY( 0 == close(fd) );
+	VERIFY( 0 == io_close(fd) );
     return rc;
 }
 
@@ -962,6 +1050,7 @@ int base_setconparam( Connection *con, const CSPI_CONPARAMS *p, CSPI_BITMASK fla
 
 	if ( flags & CSPI_CON_USERDATA ) con->user_data = p->user_data;
 
+	// CSPI_CON_OPTIME is read only, ignored.
 	return rc;
 }
 
@@ -994,6 +1083,7 @@ int base_getconparam( Connection *con, CSPI_CONPARAMS *p, CSPI_BITMASK flags )
 	if ( flags & CSPI_CON_HANDLER ) p->handler = con->handler;
 	if ( flags & CSPI_CON_USERDATA ) p->user_data = con->user_data;
 	if ( flags & CSPI_CON_EVENTMASK ) p->event_mask = con->event_mask;
+	if ( flags & CSPI_CON_OPTIME ) p->op_time = con->op_time;
 
 	return CSPI_OK;
 }
@@ -1011,7 +1101,7 @@ int cspi_connect( CSPIHCON h )
 
 	if ( CSPI_MODE_UNKNOWN == p->mode ) return CSPI_E_INVALID_MODE;
 
-	int fd = open( get_devicename( p->mode ), O_RDONLY );
+	int fd = io_open( get_devicename( p->mode ), O_RDONLY );
 	if ( -1 == fd ) return CSPI_E_SYSTEM;
 
 	p->fd = fd;
@@ -1030,7 +1120,7 @@ int cspi_disconnect( CSPIHCON h )
 	Connection *p = (Connection *) h;
 
 	if ( -1 != p->fd ) {
-		if ( -1 == close( p->fd ) ) return CSPI_E_SYSTEM;
+		if ( -1 == io_close( p->fd ) ) return CSPI_E_SYSTEM;
 		p->fd = -1;
 	}
 	p->mode = CSPI_MODE_UNKNOWN;
@@ -1079,7 +1169,7 @@ int cspi_seek( CSPIHCON h, unsigned long long *offset, int origin )
 	if ( (CSPI_MODE_DD!=p->mode) && (CSPI_MODE_AVERAGE!=p->mode) )
 		return CSPI_E_ILLEGAL_CALL;
 
-	if ( (off_t)-1 != lseek( p->fd, *offset, origin ) ) return CSPI_OK;
+	if ( (off_t)-1 != io_lseek( p->fd, *offset, origin ) ) return CSPI_OK;
 
 	return CSPI_E_SYSTEM;
 }
@@ -1110,6 +1200,8 @@ int cspi_read_ex( CSPIHCON h,
 	Connection *p = (Connection*) h;
 	if ( -1 == p->fd ) return CSPI_E_SEQUENCE;	// Not connected?
 
+	p->op_time = 0;
+
 	// Must be a non-streaming mode!
 	if ( is_streamingmode( p->mode ) ) return CSPI_E_ILLEGAL_CALL;
 
@@ -1153,13 +1245,13 @@ int read_avg( Connection *p,
 		return rc;
 	}
 
-	ssize_t nb = read( p->fd, &atom, atomsize );
+	ssize_t nb = io_read( p->fd, &atom, atomsize );
 	if ( -1 == nb ) {
 		CSPI_ERR("%s: read error, errno: %d", __FUNCTION__, errno);
 		return CSPI_E_SYSTEM;
 	}
 
-	rc = ioctl( p->fd, LIBERA_IOC_GET_DD_TSTAMP, &p->timestamp );
+	rc = io_ioctl( p->fd, LIBERA_IOC_GET_DD_TSTAMP, &p->timestamp );
 	if ( -1 == rc ) {
 		CSPI_ERR("%s: ioctl error, errno: %d", __FUNCTION__, errno);
 		return CSPI_E_SYSTEM;
@@ -1176,7 +1268,7 @@ int read_avg( Connection *p,
 	if (op) {
 
 		if ( (rc=custom_initop()) != CSPI_OK ) return rc;
-		op( dest, dest, 1 );
+		apply_op( p, op, dest, dest, 1 );
 	}
 
 	return rc;
@@ -1198,7 +1290,7 @@ int read_dd( Connection *p,
 	// The number of bytes to retrieve.
 	const size_t nbytes = count * atomsize;
 
-	ssize_t nb = read( p->fd, dest, nbytes );
+	ssize_t nb = io_read( p->fd, dest, nbytes );
 	if ( -1 == nb ) {
 		CSPI_ERR("%s: read error, errno: %d", __FUNCTION__, errno);
 		return CSPI_E_SYSTEM;
@@ -1209,7 +1301,7 @@ int read_dd( Connection *p,
 	const int cd = CSPI_MODE_DD == p->mode ?
 		LIBERA_IOC_GET_DD_TSTAMP : LIBERA_IOC_GET_PM_TSTAMP;
 
-	int rc = ioctl( p->fd, cd, &p->timestamp );
+	int rc = io_ioctl( p->fd, cd, &p->timestamp );
 	if ( -1 == rc ) return CSPI_E_SYSTEM;
 
 	// Read may return less than the requested number
@@ -1226,7 +1318,7 @@ int read_dd( Connection *p,
 		ASSERT(sizeof(CSPI_DD_RAWATOM) == sizeof(CSPI_DD_ATOM));
 
 		// Apply auxiliary operator to each atom.
-		op(p2, p2, (size_t)nb);
+		apply_op(p, op, p2, p2, (size_t)nb);
 	}
 
 	// Not completed if not enough atoms or atoms left to process.
@@ -1253,11 +1345,12 @@ int read_adc( Connection *p,
 		buff = dest;
 	}
 	else {
-		buff = calloc( count, atomsize );
+		// Raw atoms go to the connection scratch buffer, no allocation
+		// once it has grown to the acquisition size.
+		buff = get_scratch( p, nbytes );
 		if ( !buff ) return CSPI_E_MALLOC;
 	}
-	if ( NULL == buff ) return -1; // check return value (out of memory)
-	size_t nb = read( p->fd, buff, nbytes );
+	size_t nb = io_read( p->fd, buff, nbytes );
 
 	int rc = CSPI_E_SYSTEM;
 	if ( -1 != nb ) {
@@ -1270,17 +1363,13 @@ int read_adc( Connection *p,
 			
 			if ( (rc=custom_initop()) != CSPI_OK ) return rc;
 			
-			op( buff, dest, eread );
+			const int n = apply_op( p, op, buff, dest, eread );
 			if (( CSPI_MODE_ADC_SP == p->mode ) ||
 				( CSPI_MODE_ADC_SP_ROT == p->mode ))
-				if ( nread ) *nread = 1; // one atom returned
+				if ( nread ) *nread = n; // one atom per single pass shot
 		}
 	}
 
-	if ( CSPI_MODE_ADC != p->mode ) {
-		free( buff );
-	}
-
 	return rc;
 }
 
@@ -1299,7 +1388,7 @@ int cspi_get( CSPIHCON h, void *atom )
 	// Must be an SA connection!
 	if ( CSPI_MODE_SA != p->mode ) return CSPI_E_ILLEGAL_CALL;
 
-	ssize_t nb = read( p->fd, atom, sizeof(CSPI_SA_ATOM) );
+	ssize_t nb = io_read( p->fd, atom, sizeof(CSPI_SA_ATOM) );
 	if ( -1 == nb ) return CSPI_E_SYSTEM;
 
 	ASSERT( sizeof(CSPI_SA_ATOM) == nb );
@@ -1311,6 +1400,81 @@ int cspi_get( CSPIHCON h, void *atom )
 
 //--------------------------------------------------------------------------
 
+int cspi_get_ex( CSPIHCON h, void *dest, size_t count, size_t *nread )
+{
+	CSPI_LOG("%s(%p, %p, %lu, %p)", __FUNCTION__, h, dest, count, nread);
+
+	if ( !is_hcon(h) ) return CSPI_E_INVALID_HANDLE;
+	if ( !dest || !nread || !count ) return CSPI_E_INVALID_PARAM;
+
+	Connection *p = (Connection*) h;
+	if ( -1 == p->fd ) return CSPI_E_SEQUENCE;	// Not connected?
+
+	// Must be an SA connection!
+	if ( CSPI_MODE_SA != p->mode ) return CSPI_E_ILLEGAL_CALL;
+
+	const size_t atomsize = sizeof(CSPI_SA_ATOM);
+	char *buff = (char *)dest;
+	size_t nb = 0;
+	*nread = 0;
+
+	// Wait for the first atom as cspi_get does.
+	ssize_t rb = io_read( p->fd, buff, atomsize );
+	if ( -1 == rb ) return (EAGAIN == errno) ? CSPI_OK : CSPI_E_SYSTEM;
+	nb = rb;
+
+	// Drain the atoms already queued, without blocking.
+	const int flags = io_fcntl( p->fd, F_GETFL, 0 );
+	if ( -1 == flags ) return CSPI_E_SYSTEM;
+	if ( !(flags & O_NONBLOCK) &&
+	     -1 == io_fcntl( p->fd, F_SETFL, flags | O_NONBLOCK ) ) return CSPI_E_SYSTEM;
+
+	int rc = CSPI_OK;
+	while ( nb < count*atomsize ) {
+
+		rb = io_read( p->fd, buff + nb, count*atomsize - nb );
+		if ( rb <= 0 ) {
+			if ( -1 == rb && EAGAIN != errno && EINTR != errno ) rc = CSPI_E_SYSTEM;
+			break;
+		}
+		nb += rb;
+	}
+
+	if ( !(flags & O_NONBLOCK) ) VERIFY( -1 != io_fcntl( p->fd, F_SETFL, flags ) );
+
+	*nread = nb/atomsize;
+	ASSERT( 0 == nb%atomsize );
+
+	CSPI_AUX_FNC op = custom_getdefaultop(h);
+	if (op) op( dest, dest, *nread );
+
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+int cspi_poll( CSPIHCON h, int timeout, size_t *ready )
+{
+	CSPI_LOG("%s(%p, %d, %p)", __FUNCTION__, h, timeout, ready);
+
+	if ( !is_hcon(h) ) return CSPI_E_INVALID_HANDLE;
+	if ( !ready ) return CSPI_E_INVALID_PARAM;
+
+	Connection *p = (Connection*) h;
+	if ( -1 == p->fd ) return CSPI_E_SEQUENCE;	// Not connected?
+
+	// Must be an SA connection!
+	if ( CSPI_MODE_SA != p->mode ) return CSPI_E_ILLEGAL_CALL;
+
+	const int rc = io_poll( p->fd, timeout );
+	if ( -1 == rc ) return CSPI_E_SYSTEM;
+
+	*ready = rc > 0;
+	return CSPI_OK;
+}
+
+//--------------------------------------------------------------------------
+
 int cspi_gettimestamp( CSPIHCON h, CSPI_TIMESTAMP *ts )
 {
 	CSPI_LOG("%s(%p, %p)", __FUNCTION__, h, ts);
@@ -1341,17 +1505,17 @@ int cspi_settime( CSPIHENV h, CSPI_SETTIMESTAMP *ts, CSPI_BITMASK flags )
 	if ( !ts ) return CSPI_E_INVALID_PARAM;
 	if (!flags) return CSPI_OK;
 
-	int fd = open( LIBERA_EVENT_FIFO_PATHNAME, O_RDONLY );
+	int fd = io_open( LIBERA_EVENT_FIFO_PATHNAME, O_RDONLY );
 	if ( -1 == fd ) return CSPI_E_SYSTEM;
 
 	int rc = 0;
 
 	if ( flags & CSPI_TIME_MT )
-		rc = ioctl( fd, LIBERA_EVENT_SET_MT, ts );
+		rc = io_ioctl( fd, LIBERA_EVENT_SET_MT, ts );
 
 	if ( -1 != rc &&  (flags & CSPI_TIME_ST) )
-		rc = ioctl( fd, LIBERA_EVENT_SET_ST, ts );
+		rc = io_ioctl( fd, LIBERA_EVENT_SET_ST, ts );
 
-	close(fd);
+	io_close(fd);
 	return 0 == rc ? CSPI_OK : CSPI_E_SYSTEM;
 }
@@ -284,9 +284,36 @@ typedef struct {
 	int version;
 	/** Superuser flag: 0 (the default) or 1 (R/W). */
 	int superuser;
+	/** DD and PM transform selection, combination of CSPI_TRANSFORMFLAGS
+	 *  (the default is CSPI_TRANSFORM_BATCH) (R/W). */
+	int transform;
+	/** Health (temperature, fans, PS voltages) sampling period in
+	 *  milliseconds, 0 to read the devices on every query (the default
+	 *  is 1000) (R/W). */
+	int health_period;
+	/** Device access, one of CSPI_BACKENDS (the default is
+	 *  CSPI_BACKEND_DEVICE). Takes effect when the environment handle
+	 *  is allocated, the CSPI_BACKEND environment variable ("device" or
+	 *  "sim") overrides it (R/W). */
+	int backend;
 }
 CSPI_LIBPARAMS;
 
+/** Values of the CSPI_LIBPARAMS backend field. */
+typedef enum {
+	CSPI_BACKEND_DEVICE	= 0,		//!< Libera device files and daemons.
+	CSPI_BACKEND_SIM	= 1,		//!< Simulated Libera, synthetic beam.
+}
+CSPI_BACKENDS;
+
+/** Transform selection flags for the CSPI_LIBPARAMS transform field. */
+typedef enum {
+	CSPI_TRANSFORM_SCALAR	= 0,		//!< One CORDIC amplitude at a time.
+	CSPI_TRANSFORM_BATCH	= 1 << 0,	//!< Batched branchless CORDIC.
+	CSPI_TRANSFORM_RCP		= 1 << 1,	//!< Batched CORDIC, positions with one reciprocal per atom.
+}
+CSPI_TRANSFORMFLAGS;
+
 /** Helper macro for bitmasks. */
 #define BIT(n)	(1LLU << (n))
 
@@ -296,6 +323,9 @@ CSPI_LIBPARAMS;
 typedef enum {
 	CSPI_LIB_VERSION	= BIT(0),	//!< CSPI version flag.
 	CSPI_LIB_SUPERUSER	= BIT(1),	//!< CSPI superuser flag.
+	CSPI_LIB_TRANSFORM	= BIT(2),	//!< CSPI transform selection.
+	CSPI_LIB_HEALTH		= BIT(3),	//!< CSPI health sampling period.
+	CSPI_LIB_BACKEND	= BIT(4),	//!< CSPI device access backend.
 }
 CSPI_LIBFLAGS;
 
@@ -460,6 +490,46 @@ int cspi_setenvparam( CSPIHENV h, const CSPI_ENVPARAMS *p, CSPI_BITMASK flags );
  */
 int cspi_getenvparam( CSPIHENV h, CSPI_ENVPARAMS *p, CSPI_BITMASK flags );
 
+/** Number of environment flags (bits of CSPI_BITMASK). */
+#define CSPI_ENV_FIELDS 64
+
+/** \brief Retrieve environment settings from the library snapshot.
+ *
+ *  Like cspi_getenvparam, but the values are kept in a snapshot shared
+ *  by all the callers. Only the fields in flags not read in the last
+ *  max_age milliseconds are read from the device, then the whole snapshot
+ *  is copied to p. Fields set with cspi_setenvparam are always read again.
+ *  With max_age 0 all the fields in flags are read.
+ *
+ *  Returns CSPI_OK on success, or one of the errors of cspi_getenvparam.
+ *  On error p is not modified.
+ *
+ *  \param h       Environment handle.
+ *  \param p       Pointer to CSPI_ENVPARAMS structure in which to return
+ *                 the snapshot.
+ *  \param flags   Bitmask specifying which parameters must be up to date.
+ *  \param max_age Maximum age of the cached values in milliseconds.
+ */
+int cspi_getenvparam_cached( CSPIHENV h, CSPI_ENVPARAMS *p,
+                             CSPI_BITMASK flags, unsigned long max_age );
+
+/** \brief Age of environment settings in the library snapshot.
+ *
+ *  Returns in age the milliseconds elapsed since the oldest of the fields
+ *  in flags was read by cspi_getenvparam_cached, or ULONG_MAX if any of
+ *  them is not in the snapshot.
+ *
+ *  Returns CSPI_OK on success, or one of the following errors:
+ *  CSPI_E_INVALID_HANDLE,
+ *  CSPI_E_INVALID_PARAM,
+ *  CSPI_E_SYSTEM.
+ *
+ *  \param h     Environment handle.
+ *  \param flags Bitmask specifying the parameters.
+ *  \param age   Pointer to the age in milliseconds.
+ */
+int cspi_getenvparam_age( CSPIHENV h, CSPI_BITMASK flags, unsigned long *age );
+
 /** \brief Set Fast Application (FA) parameters.
  *
  *  Writes 'count' elements of data, each 'size' bytes long, to the
@@ -549,7 +619,9 @@ CSPI_MODE;
 	/** User data passed to the handler on each call. */ \
 	void *user_data; \
 	/** Event mask. */ \
-	CSPI_BITMASK event_mask
+	CSPI_BITMASK event_mask; \
+	/** Time spent in the auxiliary function by the last read (ns), read only. */ \
+	unsigned long op_time
 
 /** Common connection parameters or attibutes.
  *  Derived, connection-specific structures add additional members.
@@ -568,7 +640,8 @@ typedef enum {
 	CSPI_CON_HANDLER	= BIT(1),
 	CSPI_CON_USERDATA	= BIT(2),
 	CSPI_CON_EVENTMASK	= BIT(3),
-/*	CSPI_CON_reserved	= BIT(4) - BIT(7), */
+	CSPI_CON_OPTIME		= BIT(4),
+/*	CSPI_CON_reserved	= BIT(5) - BIT(7), */
 }
 CSPI_CONFLAGS;
 
@@ -723,6 +796,9 @@ int cspi_seek( CSPIHCON h, unsigned long long *offset, int origin );
  *  ---------------------------------------------------------------
  *  DD, PM              convert I,Q vals to amplitudes and position
  *  SA, ADC             do nothing
+ *  ADC_SP, ADC_SP_ROT  position of the single pass shots, nread is the
+ *                      number of CSPI_ADC_SP_ATOMs (see sp_separation
+ *                      in CSPI_CONPARAMS_EBPP)
  *
  *  @param h     Connection handle.
  *  @param dest  Pointer to destination buffer to receive data.
@@ -821,6 +897,49 @@ int cspi_gettimestamp( CSPIHCON h, CSPI_TIMESTAMP *ts );
  */
 int cspi_get( CSPIHCON h, void *atom );
 
+/** \brief Read all pending samples from Slow Acquisition (SA) device.
+ *
+ *  Waits for the first SA sample like cspi_get (unless the connection
+ *  is nonblocking, see CSPI_CON_SANONBLOCK), then reads without blocking
+ *  all the samples already queued in the SA device, up to count.
+ *
+ *  Returns CSPI_OK on success, or one of the following errors:
+ *  CSPI_E_INVALID_HANDLE,
+ *  CSPI_E_ILLEGAL_CALL,
+ *  CSPI_E_SEQUENCE,
+ *  CSPI_INVALID_PARAM,
+ *  CSPI_E_SYSTEM.
+ *
+ *  @param h     Connection handle.
+ *  @param dest  Pointer to the destination buffer of count samples.
+ *  @param count Maximum number of samples to read.
+ *  @param nread Pointer to the number of samples actually read.
+ */
+int cspi_get_ex( CSPIHCON h, void *dest, size_t count, size_t *nread );
+
+/** \brief Wait for a Slow Acquisition (SA) sample.
+ *
+ *  Waits up to timeout milliseconds for an SA sample to be available.
+ *  Together with a nonblocking connection (see CSPI_CON_SANONBLOCK),
+ *  lets a reader thread wait for the samples and still check between
+ *  the waits whether it has to stop, which a blocking cspi_get or
+ *  cspi_get_ex cannot do when no samples flow.
+ *
+ *  Returns CSPI_OK on success, or one of the following errors:
+ *  CSPI_E_INVALID_HANDLE,
+ *  CSPI_E_ILLEGAL_CALL,
+ *  CSPI_E_SEQUENCE,
+ *  CSPI_INVALID_PARAM,
+ *  CSPI_E_SYSTEM.
+ *
+ *  @param h       Connection handle.
+ *  @param timeout Maximum time to wait in milliseconds, negative to
+ *                 wait forever.
+ *  @param ready   Pointer to the flag set to 1 if a sample can be read,
+ *                 0 if the timeout expired.
+ */
+int cspi_poll( CSPIHCON h, int timeout, size_t *ready );
+
 //--------------------------------------------------------------------------
 // Sync. event section.
 
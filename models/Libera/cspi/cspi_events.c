@@ -44,6 +44,7 @@ TAB = 4 spaces.
 
 #include "cspi.h"
 #include "cspi_impl.h"
+#include "io.h"
 
 //--------------------------------------------------------------------------
 
@@ -223,6 +224,9 @@ int do_event_handler_registration( int pid, int uid, size_t mask )
 	int rc = CSPI_OK;
 	const Request req = { pid, uid, mask };
 
+	if ( cspi_io->event_request )
+		return cspi_io->event_request( pid, uid, mask );
+
 	int fd = open( EVENTD_REQ_FIFO_PATHNAME, O_WRONLY );
 	if ( -1 == fd ) {
 
@@ -8,6 +8,7 @@
 
 #include <signal.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "debug.h"
 
@@ -86,6 +87,12 @@ typedef struct tagLibrary {
 	int version;
 	/** Super user flag: 0 or 1 (R/W). */
 	int superuser;
+	/** Transform selection, see CSPI_TRANSFORMFLAGS (R/W). */
+	int transform;
+	/** Health sampling period in ms, 0 = on demand (R/W). */
+	int health_period;
+	/** Device access backend, see CSPI_BACKENDS (R/W). */
+	int backend;
 } Library;
 
 /** Private. Magic numbers. */
@@ -94,6 +101,9 @@ typedef enum {
 	MAGIC_CON = 230271,	//!< Connection magic.
 } MAGIC;
 
+/** Private. Alignment of the connection scratch buffers. */
+#define CSPI_CACHE_LINE 64
+
 /** Typedef. See struct tagConnection for more information. */
 typedef struct tagConnection Connection;	// forward decl
 
@@ -115,6 +125,9 @@ typedef struct tagEnvironment {
 	int fd;						//!< Configuration device file descriptor.
 	int trig_mode;				//!< Trigger mode.
 	Library module;				//!< Global CSPI module parameters.
+	CSPI_ENVPARAMS snapshot;	//!< Cached parameters, see cspi_getenvparam_cached.
+	CSPI_BITMASK snapshot_valid;	//!< Cached fields (environment flags).
+	struct timespec snapshot_ts[CSPI_ENV_FIELDS];	//!< Field read time (CLOCK_MONOTONIC).
 } Environment;
 
 /** Private.
@@ -138,6 +151,10 @@ struct tagConnection {
 	void *user_data;			//!< User data passed to handler on each call.
 	CSPI_TIMESTAMP timestamp;	//!< Time stamp of the last DD read.
 	Environment *environment;	//!< Environment that owns the connection.
+	void *scratch;				//!< Grow-only read buffer, see get_scratch.
+	size_t scratch_size;		//!< Size of the scratch buffer in bytes.
+	unsigned long op_time;		//!< Auxiliary function time of the last read (ns).
+	size_t sp_separation;		//!< Single pass shot separation, 0 = first shot only.
 	Connection *next;			//!< Next object in the connection list.
 	Connection *prev;			//!< Previous object in the connection list.
 };
@@ -528,6 +545,20 @@ CSPI_AUX_FNC custom_getdefaultop( const Connection *p );
 
 int custom_initop();
 
+/** Private.
+ *  Default aux. operator of the single pass connections with a shot
+ *  separation (sp_separation) set: one atom per shot instead of the
+ *  first shot only. Returns the number of atoms written.
+ *  Overriden by each member of the Libera family.
+ *
+ *  @param p     Connection pointer.
+ *  @param in    Samples to transform.
+ *  @param out   Transformed samples.
+ *  @param count Number of samples.
+ */
+int custom_transform_sp( const Connection *p, const void *in, void *out,
+                         size_t count );
+
 /** Private.
  *  Read Average data from register.
  *  Returns CSPI_OK on success, or one of the following errors:
@@ -561,6 +592,29 @@ int read_dd( Connection *p,
              size_t *nread,
              CSPI_AUX_FNC op );
 
+/** Private.
+ *  Returns the connection scratch buffer, grown to at least size bytes.
+ *  The buffer is aligned to CSPI_CACHE_LINE, is never shrunk and is
+ *  released with the connection. Returns NULL when out of memory.
+ *
+ *  @param p    Connection.
+ *  @param size Minimum buffer size in bytes.
+ */
+void *get_scratch( Connection *p, size_t size );
+
+/** Private.
+ *  Applies the auxiliary function op of a read and records the time it
+ *  took in the connection (see CSPI_CON_OPTIME). Returns what op returns.
+ *
+ *  @param p     Connection.
+ *  @param op    Auxiliary function.
+ *  @param in    Samples to transform.
+ *  @param out   Transformed samples.
+ *  @param count Number of samples.
+ */
+int apply_op( Connection *p, CSPI_AUX_FNC op, const void *in, void *out,
+              size_t count );
+
 /** Private.
  *  Read from ADC data source.
  *  Returns CSPI_OK on success, or one of the following errors:
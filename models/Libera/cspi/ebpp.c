@@ -34,6 +34,7 @@ TAB = 4 spaces.
 #include <stdio.h>	// sprintf, getline
 #include <ctype.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <errno.h>
 #include <string.h>
 #include <pthread.h>
@@ -55,6 +56,8 @@ TAB = 4 spaces.
 
 #include "dscd.h"
 #include "ebpp.h"
+#include "ebpp_transform.h"
+#include "io.h"
 
 #if DEBUG < 3
 #define CSPI_LOG( format, ... ) ((void)0)
@@ -103,6 +106,12 @@ typedef struct tagCache {
 		unsigned long harmonic;		//!< harmonic
 		double frev;				//!< revolutions
 	} cw;
+	struct {				//!< cw transform coefficients, see ebpp_update_cw
+		float a;			//!< current sample coefficient
+		float b;			//!< previous sample coefficient
+		float kx, ky;		//!< Kx, Ky
+		float offx, offy;	//!< Xoffset, Yoffset
+	} cwc;
 } Cache;
 
 /** Private. EBPP specific. Local to this module only.
@@ -135,6 +144,28 @@ int cspi_getfeatureparam(Environment *e, CSPI_ENVPARAMS *p, CSPI_BITMASK flags);
 
 //--------------------------------------------------------------------------
 
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Recalculates the ADC CW transform coefficients from the cached
+ *  environment data, so they are not computed on every read.
+ *  Assume cache has been locked by caller.
+ */
+static void ebpp_update_cw()
+{
+	const double flmcdhz = (double)cache.cw.frequency;
+	const double fadc = flmcdhz/10.0;
+	const double fif = (double)cache.cw.frev*(double)cache.cw.harmonic - flmcdhz*4.0;
+	const double theta = (2.0*M_PI*fif)/fadc;
+
+	cache.cwc.a = (float)-(cos(theta)/sin(theta));
+	cache.cwc.b = (float)(1/sin(theta));
+	cache.cwc.kx = (float)cache.Kx;
+	cache.cwc.ky = (float)cache.Ky;
+	cache.cwc.offx = (float)cache.Xoffset;
+	cache.cwc.offy = (float)cache.Yoffset;
+}
+//--------------------------------------------------------------------------
+
 /** Private. EBPP specific. Local to this module only.
  *
  *  Update cached environment data.
@@ -167,13 +198,15 @@ int ebpp_update_cache( Environment *e )
 		libera_cfg_request_t request;
 
 		request.idx = LIBERA_CFG_BCD_XOFFSET;
-		if ( -1 == ioctl( e->fd, LIBERA_IOC_GET_CFG, &request ) ) {
+		if ( -1 == io_ioctl( e->fd, LIBERA_IOC_GET_CFG, &request ) ) {
+			VERIFY( 0 == pthread_mutex_unlock( &cache_mutex ) );
 			return CSPI_E_SYSTEM;
 		}
 		cache.Xoffset += request.val;
 
 		request.idx = LIBERA_CFG_BCD_YOFFSET;
-		if ( -1 == ioctl( e->fd, LIBERA_IOC_GET_CFG, &request ) ) {
+		if ( -1 == io_ioctl( e->fd, LIBERA_IOC_GET_CFG, &request ) ) {
+			VERIFY( 0 == pthread_mutex_unlock( &cache_mutex ) );
 			return CSPI_E_SYSTEM;
 		}
 		cache.Yoffset += request.val;
@@ -194,6 +227,8 @@ int ebpp_update_cache( Environment *e )
 		cache.cw.harmonic = ep.pll_status.mt_stat.harmonic;
 		cache.cw.frev = ep.frev;
 
+		ebpp_update_cw();
+
 		VERIFY( 0 == pthread_mutex_unlock( &cache_mutex ) );
 	}
 
@@ -217,6 +252,9 @@ int ebpp_dsc_message( size_t msg_type, size_t size, const void *msg_val )
 	int rc = CSPI_E_SYSTEM;
 	const pid_t pid = getpid();
 
+	if ( cspi_io->dsc_message )
+		return cspi_io->dsc_message( msg_type, size, (void *)msg_val );
+
 	char fname[PATH_MAX];
 	sprintf( fname, "/tmp/%d.fifo", pid );
 
@@ -789,7 +827,7 @@ int ebpp_setdscparam(Environment *e, const CSPI_ENVPARAMS *p,
 {
 	int rc = CSPI_OK;
 
-	if (!(fcntl(e->fd, F_GETFL) & O_RDWR))
+	if (!(io_fcntl(e->fd, F_GETFL, 0) & O_RDWR))
 	{
 		errno = EPERM;
 		return CSPI_E_SYSTEM;
@@ -1066,8 +1104,11 @@ int ebpp_pll_setcmd(const char * cmd_strg)
 {
 	int rc = CSPI_E_SYSTEM;
 
-	FILE *cmd_pipe = fopen(LPLLD_COMMAND_FIFO_d, "w");
     CSPI_LOG("%s", __FUNCTION__);
+	if ( cspi_io->pll_message )
+		return cspi_io->pll_message( cmd_strg, 0 );
+
+	FILE *cmd_pipe = fopen(LPLLD_COMMAND_FIFO_d, "w");
 	if (NULL != cmd_pipe)
 	{
 		if (fputs(cmd_strg, cmd_pipe) > 0)
@@ -1128,7 +1169,11 @@ int ebpp_get_pllparam(Environment *e, const CSPI_ENVPARAMS *p,
 		}
 	}
 
-	if (cmdmsg_str)
+	if (cmdmsg_str && cspi_io->pll_message)
+	{
+		rc = cspi_io->pll_message(cmdmsg_str, pllstat);
+	}
+	else if (cmdmsg_str)
 	{
 		int status_pipe = open(LPLLD_STATUS_FIFO_d, O_RDONLY | O_NONBLOCK);
 		if (-1 == status_pipe) {
@@ -1259,7 +1304,7 @@ int custom_initenv( CSPIHANDLE h ) {
 	if (0 == rc) {
 		Environment *p = (Environment *) h;
 		libera_cfg_request_t req = {LIBERA_CFG_DEC_DDC, 0};
-		if ( ioctl(p->fd, LIBERA_IOC_GET_CFG, &req) ) {
+		if ( io_ioctl(p->fd, LIBERA_IOC_GET_CFG, &req) ) {
 			rc = CSPI_E_SYSTEM;
 		}
 		else {
@@ -1513,7 +1558,7 @@ int custom_setconparam( Connection *con, const CSPI_CONPARAMS *p, CSPI_BITMASK f
 		if ( !ebpp_is_validdec( &q->dec ) ) return CSPI_E_INVALID_PARAM;
 
 		ASSERT(-1 != con->fd);
-		if (-1 == ioctl( con->fd, LIBERA_IOC_SET_DEC, &q->dec )) {
+		if (-1 == io_ioctl( con->fd, LIBERA_IOC_SET_DEC, (void *)&q->dec )) {
 			return CSPI_E_SYSTEM;
 		}
 	}
@@ -1527,7 +1572,7 @@ int custom_setconparam( Connection *con, const CSPI_CONPARAMS *p, CSPI_BITMASK f
 		const CSPI_CONPARAMS_EBPP *q = (CSPI_CONPARAMS_EBPP *)p;
 
 		ASSERT(-1 != con->fd);
-		int sa_flags = fcntl( con->fd, F_GETFL, 0);
+		int sa_flags = io_fcntl( con->fd, F_GETFL, 0);
 		if (-1 == sa_flags) {
 			return CSPI_E_SYSTEM;
 		}
@@ -1535,11 +1580,18 @@ int custom_setconparam( Connection *con, const CSPI_CONPARAMS *p, CSPI_BITMASK f
 			sa_flags |= O_NONBLOCK;
 		else
 			sa_flags &= ~O_NONBLOCK;
-		if (-1 == fcntl( con->fd, F_SETFL, sa_flags )) {
+		if (-1 == io_fcntl( con->fd, F_SETFL, sa_flags )) {
 			return CSPI_E_SYSTEM;
 		}
 	}
 
+	// Single pass shots of this connection only, see custom_transform_sp.
+	if ( flags & CSPI_CON_SPSEPARATION ) {
+
+		const CSPI_CONPARAMS_EBPP *q = (CSPI_CONPARAMS_EBPP *)p;
+		con->sp_separation = q->sp_separation;
+	}
+
 	return rc;
 }
 
@@ -1559,10 +1611,16 @@ int custom_getconparam( Connection *con, CSPI_CONPARAMS *p, CSPI_BITMASK flags )
 
 		if ( CSPI_MODE_DD != con->mode ) return CSPI_E_ILLEGAL_CALL;
 
-		const CSPI_CONPARAMS_EBPP *q = (CSPI_CONPARAMS_EBPP *)p;
+		CSPI_CONPARAMS_EBPP *q = (CSPI_CONPARAMS_EBPP *)p;
 
 		ASSERT(-1 != con->fd);
-		if (-1 == ioctl( con->fd, LIBERA_IOC_GET_DEC, &q->dec )) rc = CSPI_E_SYSTEM;
+		if (-1 == io_ioctl( con->fd, LIBERA_IOC_GET_DEC, &q->dec )) rc = CSPI_E_SYSTEM;
+	}
+
+	if ( flags & CSPI_CON_SPSEPARATION ) {
+
+		CSPI_CONPARAMS_EBPP *q = (CSPI_CONPARAMS_EBPP *)p;
+		q->sp_separation = con->sp_separation;
 	}
 
 	return rc;
@@ -1572,20 +1630,17 @@ int custom_getconparam( Connection *con, CSPI_CONPARAMS *p, CSPI_BITMASK flags )
 
 /** Private. EBPP specific. Local to this module only.
  *
- *  Transforms a single CSPI_DD_RAWATOM into CSPI_DD_ATOM.
- *  @param in Pointer to the CSPI_DD_RAWATOM to transform.
- *  @param out Pointer to CSPI_DD_ATOM to overwrite.
+ *  Calculates X, Y, Q and Sum of a CSPI_DD_ATOM from its amplitudes.
+ *  @param q Pointer to CSPI_DD_ATOM to overwrite.
  */
-
-void ebpp_transform_dd_single( const void *in, void *out )
+static inline void ebpp_dd_position( const int Va, const int Vb,
+                                     const int Vc, const int Vd,
+                                     CSPI_DD_ATOM *q )
 {
-	CSPI_DD_RAWATOM *p = (CSPI_DD_RAWATOM *)in;
-	CSPI_DD_ATOM *q = (CSPI_DD_ATOM *)out;
-
-	const int Va = q->Va = cordic_amp( p->sinVa >> 1, p->cosVa >> 1 );
-	const int Vb = q->Vb = cordic_amp( p->sinVb >> 1, p->cosVb >> 1 );
-	const int Vc = q->Vc = cordic_amp( p->sinVc >> 1, p->cosVc >> 1 );
-	const int Vd = q->Vd = cordic_amp( p->sinVd >> 1, p->cosVd >> 1 );
+	q->Va = Va;
+	q->Vb = Vb;
+	q->Vc = Vc;
+	q->Vd = Vd;
 
 	const int64_t S = (int64_t)Va+Vb+Vc+Vd;
 
@@ -1607,6 +1662,151 @@ void ebpp_transform_dd_single( const void *in, void *out )
 
 //--------------------------------------------------------------------------
 
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Returns N/S rounded toward zero, exactly as the integer division,
+ *  given the reciprocal inv = 1/S. The estimate N*inv is within one
+ *  unit from the quotient as long as |N/S| < 2^31 and is corrected
+ *  with the integer remainder.
+ *  @param N Dividend.
+ *  @param S Divisor, must be positive.
+ *  @param inv Reciprocal of S.
+ */
+static inline int64_t ebpp_div_rcp( const int64_t N, const int64_t S,
+                                    const double inv )
+{
+	int64_t q = (int64_t)( (double)N * inv );
+	const int64_t r = N - q*S;
+
+	if ( N >= 0 ) {
+		if ( r < 0 ) q--;
+		else if ( r >= S ) q++;
+	}
+	else {
+		if ( r > 0 ) q++;
+		else if ( r <= -S ) q--;
+	}
+	return q;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Same as ebpp_dd_position but with a single reciprocal of the sum
+ *  instead of three 64-bit divisions. The result is identical, except
+ *  that a zero sum (division by zero) yields the offsets.
+ *  @param q Pointer to CSPI_DD_ATOM to overwrite.
+ */
+static inline void ebpp_dd_position_rcp( const int Va, const int Vb,
+                                         const int Vc, const int Vd,
+                                         CSPI_DD_ATOM *q )
+{
+	q->Va = Va;
+	q->Vb = Vb;
+	q->Vc = Vc;
+	q->Vd = Vd;
+
+	const int64_t S = (int64_t)Va+Vb+Vc+Vd;
+
+	if ( S <= 0 ) {
+
+		q->X = -cache.Xoffset;
+		q->Y = -cache.Yoffset;
+		q->Q = -cache.Qoffset;
+		q->Sum = (int)(S >> 2);
+		return;
+	}
+
+	const double inv = 1.0 / (double)S;
+
+	const int64_t X = ((int64_t)Va+Vd-Vb-Vc) * cache.Kx;
+	q->X = (int)ebpp_div_rcp( X, S, inv ) - cache.Xoffset;
+
+	const int64_t Y = ((int64_t)Va+Vb-Vc-Vd) * cache.Ky;
+	q->Y = (int)ebpp_div_rcp( Y, S, inv ) - cache.Yoffset;
+
+	const int64_t Q = ((int64_t)Va+Vc-Vb-Vd) * cache.Kx;
+	q->Q = (int)ebpp_div_rcp( Q, S, inv ) - cache.Qoffset;
+
+	// Prevent sum overflow
+	q->Sum = (int)(S >> 2);
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Transforms a single CSPI_DD_RAWATOM into CSPI_DD_ATOM.
+ *  @param in Pointer to the CSPI_DD_RAWATOM to transform.
+ *  @param out Pointer to CSPI_DD_ATOM to overwrite.
+ */
+
+void ebpp_transform_dd_single( const void *in, void *out )
+{
+	CSPI_DD_RAWATOM *p = (CSPI_DD_RAWATOM *)in;
+
+	ebpp_dd_position( cordic_amp( p->sinVa >> 1, p->cosVa >> 1 ),
+	                  cordic_amp( p->sinVb >> 1, p->cosVb >> 1 ),
+	                  cordic_amp( p->sinVc >> 1, p->cosVc >> 1 ),
+	                  cordic_amp( p->sinVd >> 1, p->cosVd >> 1 ),
+	                  (CSPI_DD_ATOM *)out );
+}
+
+//--------------------------------------------------------------------------
+
+void ebpp_setcache_position( int Kx, int Ky, int Xoffset, int Yoffset,
+                             int Qoffset )
+{
+	VERIFY( 0 == pthread_mutex_lock( &cache_mutex ) );
+	cache.Kx = Kx;
+	cache.Ky = Ky;
+	cache.Xoffset = Xoffset;
+	cache.Yoffset = Yoffset;
+	cache.Qoffset = Qoffset;
+	ebpp_update_cw();
+	VERIFY( 0 == pthread_mutex_unlock( &cache_mutex ) );
+}
+
+//--------------------------------------------------------------------------
+
+void ebpp_setcache_sp( int threshold, int n_before, int n_after )
+{
+	VERIFY( 0 == pthread_mutex_lock( &cache_mutex ) );
+	cache.sp.threshold = threshold;
+	cache.sp.n_before = n_before;
+	cache.sp.n_after = n_after;
+	VERIFY( 0 == pthread_mutex_unlock( &cache_mutex ) );
+}
+
+//--------------------------------------------------------------------------
+
+void ebpp_setcache_sr( int averaging_stop, int average_window, int start,
+                       int window )
+{
+	VERIFY( 0 == pthread_mutex_lock( &cache_mutex ) );
+	cache.sr.averaging_stop = averaging_stop;
+	cache.sr.average_window = average_window;
+	cache.sr.start = start;
+	cache.sr.window = window;
+	VERIFY( 0 == pthread_mutex_unlock( &cache_mutex ) );
+}
+
+//--------------------------------------------------------------------------
+
+void ebpp_setcache_cw( unsigned long frequency, unsigned long harmonic,
+                       double frev )
+{
+	VERIFY( 0 == pthread_mutex_lock( &cache_mutex ) );
+	cache.cw.frequency = frequency;
+	cache.cw.harmonic = harmonic;
+	cache.cw.frev = frev;
+	ebpp_update_cw();
+	VERIFY( 0 == pthread_mutex_unlock( &cache_mutex ) );
+}
+
+//--------------------------------------------------------------------------
+
 /** Private. EBPP specific. Local to this module only.
  *
  *  Transforms a CSPI_DD_RAWATOM into CSPI_DD_ATOM. Returns 0.
@@ -1628,123 +1828,321 @@ int ebpp_transform_dd( const void *in, void *out, size_t count )
 
 //--------------------------------------------------------------------------
 
+/** Number of atoms transformed per cordic_amp_batch call. */
+#define DD_BATCH_ATOMS 64
+
 /** Private. EBPP specific. Local to this module only.
  *
- *  Transforms a CSPI_DD_RAWATOM into CSPI_DD_ATOM and remove spikes.
- *  Returns 0.
+ *  Transforms CSPI_DD_RAWATOMs into CSPI_DD_ATOMs using the batched
+ *  CORDIC kernel. Can transform in place (in == out).
  *  @param in Pointer to the CSPI_DD_RAWATOM to transform.
  *  @param out Pointer to CSPI_DD_ATOM to overwrite.
+ *  @param count Number of atoms.
+ *  @param rcp Nonzero to calculate positions with ebpp_dd_position_rcp.
  */
-int ebpp_transform_dd_remove_spikes( const void *in, void *out, size_t count )
+static inline void ebpp_transform_dd_block( const void *in, void *out,
+                                            size_t count, const int rcp )
 {
-	CSPI_DD_RAWATOM *p = (CSPI_DD_RAWATOM *)in;
+	const CSPI_DD_RAWATOM *p = (const CSPI_DD_RAWATOM *)in;
 	CSPI_DD_ATOM *q = (CSPI_DD_ATOM *)out;
-	CSPI_DD_ATOM *dest;
-	CSPI_DD_ATOM *buffer = (CSPI_DD_ATOM *)out;
 
-	size_t i, shifts;	// iterators
-	int tb;				// trigger bit
+	int I[4*DD_BATCH_ATOMS], Q[4*DD_BATCH_ATOMS], A[4*DD_BATCH_ATOMS];
 
-	size_t eb, ee;				// edge begin, edge end
-	size_t period;				// number of samples between two triggers
-	size_t avestop, avestart;	// first and last samples where average is calculated
-	size_t holdstart, holdstop;	// first and last samples where average value is to be applied
-	size_t first, last;			// first and last samples where is possible to do calucaltions
+	while ( count ) {
 
-	int64_t ave_a, ave_b, ave_c, ave_d;	// acumulated values
-	int64_t S, X, Y, Q;					//
+		const size_t n = count < DD_BATCH_ATOMS ? count : DD_BATCH_ATOMS;
+		size_t i;
 
-	//
-	eb = ee = 0;
+		// Gather the whole block before overwriting it.
+		for( i=0; i<n; i++ ) {
 
-	// find period
-	tb = p->cosVa & 1;
-	ebpp_transform_dd_single( p, q );
+			I[4*i+0] = p[i].sinVa >> 1; Q[4*i+0] = p[i].cosVa >> 1;
+			I[4*i+1] = p[i].sinVb >> 1; Q[4*i+1] = p[i].cosVb >> 1;
+			I[4*i+2] = p[i].sinVc >> 1; Q[4*i+2] = p[i].cosVc >> 1;
+			I[4*i+3] = p[i].sinVd >> 1; Q[4*i+3] = p[i].cosVd >> 1;
+		}
 
-	for( i=1, p++, q++; (i<count) && ((p->cosVa&1)==tb); i++, p++, q++ )
-		ebpp_transform_dd_single( p, q );
+		cordic_amp_batch( I, Q, A, 4*n );
+
+		for( i=0; i<n; i++ ) {
+
+			if ( rcp )
+				ebpp_dd_position_rcp( A[4*i+0], A[4*i+1], A[4*i+2], A[4*i+3], q+i );
+			else
+				ebpp_dd_position( A[4*i+0], A[4*i+1], A[4*i+2], A[4*i+3], q+i );
+		}
+
+		p += n;
+		q += n;
+		count -= n;
+	}
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific.
+ *
+ *  Transforms a CSPI_DD_RAWATOM into CSPI_DD_ATOM using the batched
+ *  CORDIC kernel. Results are identical to ebpp_transform_dd.
+ *  Can transform in place (in == out). Returns 0.
+ *  @param in Pointer to the CSPI_DD_RAWATOM to transform.
+ *  @param out Pointer to CSPI_DD_ATOM to overwrite.
+ */
+int ebpp_transform_dd_batch( const void *in, void *out, size_t count )
+{
+	ebpp_transform_dd_block( in, out, count, 0 );
+	return 0;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific.
+ *
+ *  Same as ebpp_transform_dd_batch but calculates positions with one
+ *  reciprocal of the sum per atom instead of three divisions.
+ *  Results are identical to ebpp_transform_dd. Returns 0.
+ *  @param in Pointer to the CSPI_DD_RAWATOM to transform.
+ *  @param out Pointer to CSPI_DD_ATOM to overwrite.
+ */
+int ebpp_transform_dd_rcp( const void *in, void *out, size_t count )
+{
+	ebpp_transform_dd_block( in, out, count, 1 );
+	return 0;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Calculates the atom applied over a spike removal hold window from the
+ *  sums of the amplitudes over the average window.
+ *  @param sum Sums of Va, Vb, Vc and Vd over the average window.
+ *  @param shifts log2 of the average window.
+ *  @param q Pointer to CSPI_DD_ATOM to overwrite.
+ */
+static inline void ebpp_sr_hold( const int64_t sum[4], const size_t shifts,
+                                 CSPI_DD_ATOM *q )
+{
+	const int64_t a = sum[0] >> shifts;
+	const int64_t b = sum[1] >> shifts;
+	const int64_t c = sum[2] >> shifts;
+	const int64_t d = sum[3] >> shifts;
+	const int64_t S = a+b+c+d;
+
+	q->Va = (int)a;
+	q->Vb = (int)b;
+	q->Vc = (int)c;
+	q->Vd = (int)d;
+
+	// No beam in the average window, do not divide by zero.
+	q->X = (int)( S ? ((a+d-b-c) * cache.Kx) / S : 0 ) - cache.Xoffset;
+	q->Y = (int)( S ? ((a+b-c-d) * cache.Ky) / S : 0 ) - cache.Yoffset;
+	q->Q = (int)( S ? ((a+c-b-d) * cache.Kx) / S : 0 ) - cache.Qoffset;
+	q->Sum = (int)(S >> 2);	// Prevent sum overflow
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Finds the spike removal windows of count CSPI_DD_RAWATOMs.
+ *  The DSC switching toggles the trigger bit (bit 0 of cosVa) every
+ *  period atoms, the first average window ends at avestop and the first
+ *  hold window starts at holdstart, both repeat every period.
+ *  Returns 0, -1 or -2 if less than two switching edges are found in the
+ *  data, -3 if the average window is not a power of 2.
+ *  @param in Pointer to the CSPI_DD_RAWATOMs.
+ *  @param count Number of atoms.
+ *  @param period Switching period.
+ *  @param avestop First average window end.
+ *  @param holdstart First hold window start, possibly negative.
+ *  @param shifts log2 of the average window.
+ */
+static int ebpp_sr_windows( const CSPI_DD_RAWATOM *p, size_t count,
+                            ptrdiff_t *period, ptrdiff_t *avestop,
+                            ptrdiff_t *holdstart, size_t *shifts )
+{
+	size_t i, eb, ee;	// edge begin, edge end
+	ptrdiff_t first;	// first edge with the average window in the data
+	int tb;				// trigger bit
 
+	if( !count ) return -1;
+
+	tb = p[0].cosVa & 1;
+	for( i=1; (i<count) && ((p[i].cosVa&1)==tb); i++ );
 	if( i==count ) return -1;	// no spike
 	eb = i;
 
-	tb = p->cosVa & 1;
-	for( ; (i<count) && ((p->cosVa&1)==tb); i++, p++, q++ )
-		ebpp_transform_dd_single( p, q );
-
+	tb = p[i].cosVa & 1;
+	for( ; (i<count) && ((p[i].cosVa&1)==tb); i++ );
 	if( i==count ) return -2;	// no spike
 	ee = i;
 
-	// period found, calc transformations for rest of data
-	for( ; i<count; i++, p++, q++ )
-		ebpp_transform_dd_single( p, q );
-
 	// calc shift value for dividing average values
 	i = cache.sr.average_window;
-	for( shifts=0; !(i&1) && (shifts<64); i>>=1, shifts++ );
+	if( !i ) return -3;
+	for( *shifts=0; !(i&1); i>>=1, (*shifts)++ );
 	if( (i>>1) ) return -3;	// more than 1 bits are set
 
-	// calc period
-	period = ee-eb;
+	*period = ee-eb;
 
 	// move edge begin position to first spike where calculations can be done
-	first = -(cache.sr.start+cache.sr.averaging_stop-cache.sr.average_window+1);
-	for( ; eb < first; eb += period );
+	first = -(ptrdiff_t)(cache.sr.start+cache.sr.averaging_stop-cache.sr.average_window+1);
+	for( ; (ptrdiff_t)eb < first; eb += *period );
 
-	// calc intervals to do averages
-	avestop   = eb+cache.sr.start+cache.sr.averaging_stop;
-	avestart  = avestop-cache.sr.average_window+1;
-	holdstart = eb+cache.sr.start;
-	holdstop  = holdstart+cache.sr.window-1;
+	*avestop   = eb+cache.sr.start+cache.sr.averaging_stop;
+	*holdstart = eb+cache.sr.start;
 
-	// iterate thru data
-	// while first position to apply average is in data range
-	while( holdstart<count ) {
+	return 0;
+}
 
-		// calculate average values
-		ave_a = ave_b = ave_c = ave_d = 0LL;
+//--------------------------------------------------------------------------
 
-		for( q=&buffer[avestart], i=avestart; i<=avestop; i++, p++)
-		{
-			ave_a += (int64_t)q->Va;
-			ave_b += (int64_t)q->Vb;
-			ave_c += (int64_t)q->Vc;
-			ave_d += (int64_t)q->Vd;
+/** Private. EBPP specific.
+ *
+ *  Transforms a CSPI_DD_RAWATOM into CSPI_DD_ATOM and removes the DSC
+ *  switching spikes: every switching period the hold window is
+ *  overwritten with the average of the average window. Periods with
+ *  the average window ending past the data are left as they are.
+ *  Reference implementation of ebpp_transform_dd_remove_spikes,
+ *  see ebpp_sr_windows for the return value.
+ *  @param in Pointer to the CSPI_DD_RAWATOM to transform.
+ *  @param out Pointer to CSPI_DD_ATOM to overwrite.
+ */
+int ebpp_transform_dd_remove_spikes_ref( const void *in, void *out, size_t count )
+{
+	CSPI_DD_ATOM *buffer = (CSPI_DD_ATOM *)out;
+
+	size_t shifts;
+	ptrdiff_t i, period;
+	ptrdiff_t avestop, avestart;	// first and last samples where average is calculated
+	ptrdiff_t holdstart, holdstop;	// first and last samples where average value is to be applied
+	int64_t sum[4];
+	CSPI_DD_ATOM hold;
+
+	const int rc = ebpp_sr_windows( (const CSPI_DD_RAWATOM *)in, count,
+	                                &period, &avestop, &holdstart, &shifts );
+
+	ebpp_transform_dd( in, out, count );
+	if( rc ) return rc;
+
+	avestart = avestop-cache.sr.average_window+1;
+	holdstop = holdstart+cache.sr.window-1;
+
+	// while the average window is in data range
+	for( ; avestop<(ptrdiff_t)count; avestart += period, avestop += period,
+	       holdstart += period, holdstop += period ) {
+
+		sum[0] = sum[1] = sum[2] = sum[3] = 0;
+		for( i=avestart; i<=avestop; i++ ) {
+			sum[0] += buffer[i].Va;
+			sum[1] += buffer[i].Vb;
+			sum[2] += buffer[i].Vc;
+			sum[3] += buffer[i].Vd;
 		}
+		ebpp_sr_hold( sum, shifts, &hold );
 
-		ave_a >>= shifts;
-		ave_b >>= shifts;
-		ave_c >>= shifts;
-		ave_d >>= shifts;
+		for( i = holdstart < 0 ? 0 : holdstart;
+		     i<=holdstop && i<(ptrdiff_t)count; i++ )
+			buffer[i] = hold;
+	}
 
-		S = ave_a+ave_b+ave_c+ave_d;
-		X = ((ave_a+ave_d-ave_b-ave_c) * cache.Kx) / S - cache.Xoffset;
-		Y = ((ave_a+ave_b-ave_c-ave_d) * cache.Ky) / S - cache.Yoffset;
-		Q = ((ave_a+ave_c-ave_b-ave_d) * cache.Kx) / S - cache.Qoffset;
-		S >>= 2;	// Prevent sum overflow
+	return 0;
+}
 
-		// apply average values
-		if( holdstop<count )
-			last = holdstop;
-		else
-			last = count-1;
-
-		q=&buffer[holdstart];
-		q->Va = (int)ave_a;
-		q->Vb = (int)ave_b;
-		q->Vc = (int)ave_c;
-		q->Vd = (int)ave_d;
-		q->X = (int)X;
-		q->Y = (int)Y;
-		q->Q = (int)Q;
-		q->Sum = (int)S;
-
-		for( dest=q+1, i=holdstart+1; i<=last; i++, dest++ )
-			memcpy( dest, q, sizeof(CSPI_DD_ATOM) );
-
-		holdstart += period;
-		holdstop += period;
-		avestart += period;
-		avestop += period;
+//--------------------------------------------------------------------------
+
+/** Hold atoms kept by ebpp_transform_dd_remove_spikes, averages completed
+ *  before their hold window starts. */
+#define SR_HOLDS 32
+
+/** Private. EBPP specific.
+ *
+ *  Transforms a CSPI_DD_RAWATOM into CSPI_DD_ATOM and removes the DSC
+ *  switching spikes in a single pass over the data: blocks of atoms are
+ *  transformed with the batched CORDIC kernel, the averages kept as
+ *  running sums over the transformed atoms and the hold windows filled
+ *  as the atoms are written. Results are identical to
+ *  ebpp_transform_dd_remove_spikes_ref. Can transform in place
+ *  (in == out). See ebpp_sr_windows for the return value.
+ *  @param in Pointer to the CSPI_DD_RAWATOM to transform.
+ *  @param out Pointer to CSPI_DD_ATOM to overwrite.
+ */
+int ebpp_transform_dd_remove_spikes( const void *in, void *out, size_t count )
+{
+	const CSPI_DD_RAWATOM *p = (const CSPI_DD_RAWATOM *)in;
+	CSPI_DD_ATOM *q = (CSPI_DD_ATOM *)out;
+
+	size_t shifts;
+	ptrdiff_t i, j, k, n, m, period, avestop, holdstart;
+	ptrdiff_t done = 0;				// periods with the average calculated
+	ptrdiff_t started = -1;			// last period with the hold window started
+	int64_t sum[4] = { 0, 0, 0, 0 };	// running sums of the average window
+	CSPI_DD_ATOM hold[SR_HOLDS];	// of periods started-SR_HOLDS+1..done-1
+
+	const int rc = ebpp_sr_windows( p, count, &period, &avestop,
+	                                &holdstart, &shifts );
+	if( rc ) {
+		ebpp_transform_dd_block( in, out, count, 0 );
+		return rc;
+	}
+
+	const ptrdiff_t window = cache.sr.average_window;
+	const ptrdiff_t hold_size = cache.sr.window;
+
+	// Averages ending way before their hold window: not worth a larger ring.
+	if( holdstart-avestop >= (SR_HOLDS-1)*period )
+		return ebpp_transform_dd_remove_spikes_ref( in, out, count );
+
+	ptrdiff_t next_start = holdstart;	// hold window start of period started+1
+
+	for( i=0; i<(ptrdiff_t)count; i += n ) {
+
+		n = count-i < DD_BATCH_ATOMS ? count-i : DD_BATCH_ATOMS;
+		ebpp_transform_dd_block( p+i, q+i, n, 0 );
+
+		for( j=i; j<i+n; j++ ) {
+
+			for( ; next_start<=j; next_start += period ) started++;
+
+			// The latest hold window over j wins, as windows longer than
+			// the period overlap.
+			m = started < done-1 ? started : done-1;
+			if( m>=0 && j<=holdstart+m*period+hold_size-1 )
+				q[j] = hold[m % SR_HOLDS];
+
+			sum[0] += q[j].Va;
+			sum[1] += q[j].Vb;
+			sum[2] += q[j].Vc;
+			sum[3] += q[j].Vd;
+			if( j>=window ) {
+				sum[0] -= q[j-window].Va;
+				sum[1] -= q[j-window].Vb;
+				sum[2] -= q[j-window].Vc;
+				sum[3] -= q[j-window].Vd;
+			}
+
+			if( j!=avestop+done*period ) continue;
+
+			// Average window complete. Its hold window may have started
+			// already: overwrite the atoms written (and in the sums).
+			ebpp_sr_hold( sum, shifts, &hold[done % SR_HOLDS] );
+
+			const CSPI_DD_ATOM *h = &hold[done % SR_HOLDS];
+			const ptrdiff_t first = holdstart+done*period;
+			const ptrdiff_t last = first+hold_size-1;
+
+			for( k = first < 0 ? 0 : first; k<=j && k<=last; k++ ) {
+				if( k>j-window ) {
+					sum[0] += (int64_t)h->Va - q[k].Va;
+					sum[1] += (int64_t)h->Vb - q[k].Vb;
+					sum[2] += (int64_t)h->Vc - q[k].Vc;
+					sum[3] += (int64_t)h->Vd - q[k].Vd;
+				}
+				q[k] = *h;
+			}
+			done++;
+		}
 	}
 
 	return 0;
@@ -1771,103 +2169,91 @@ static int ebpp_transform_adc( const void *in, void *out, size_t count )
 
 /** Private. EBPP specific. Local to this module only.
  *
- *  Calculate ADC CW valuses.
- *  @param in Not used.
- *  @param out Pointer to the CSPI_ADC_ATOM to transform.
+ *  Calculates one ADC CW atom from the four channels and their squared
+ *  quadrature components, in the order A, B, C, D. The four channel
+ *  loops are meant to be vectorized by the compiler (one vector sqrt
+ *  for the four channels).
+ *  @param ch Channel samples.
+ *  @param qsq Squared quadrature components.
+ *  @param in Pointer to the CSPI_ADC_ATOM transformed.
+ *  @param out Pointer to the CSPI_ADC_CW_ATOM to overwrite.
  */
-static int ebpp_transform_adc_cw( const void *in, void *out, size_t count )
+static inline void ebpp_adc_cw_atom( const float ch[4], const float qsq[4],
+                                     const CSPI_ADC_ATOM *in,
+                                     CSPI_ADC_CW_ATOM *out )
 {
-	//* CW
-	CSPI_ADC_ATOM *curr, *prev;
-	CSPI_ADC_CW_ATOM *curr_out;
+	float q[4], v[4];
+	int c;
 
-	int rc;
-	double kx, ky;
-	double flmcdhz, fif, fadc;
-	double theta, a, b;
+	for ( c=0; c<4; c++ ) {
 
-	kx = (double)cache.Kx;
-	ky = (double)cache.Ky;
-
-	double offx = (double)cache.Xoffset;
-	double offy = (double)cache.Yoffset;
+		q[c] = sqrtf( qsq[c] );
+		v[c] = sqrtf( ch[c]*ch[c] + qsq[c] );
+	}
 
-	flmcdhz = (double)cache.cw.frequency;
+	const float sum = v[0] + v[1] + v[2] + v[3];
+	const float inv = sum > 0.0f ? 1.0f/sum : 0.0f;
 
-	fadc = flmcdhz/10.0;
-	fif = (double)cache.cw.frev*(double)cache.cw.harmonic - flmcdhz*4.0;
+	out->chA = in->chA;
+	out->chB = in->chB;
+	out->chC = in->chC;
+	out->chD = in->chD;
+	out->X = (int)(cache.cwc.kx * (v[0] + v[3] - v[1] - v[2]) * inv - cache.cwc.offx);
+	out->Y = (int)(cache.cwc.ky * (v[0] + v[1] - v[2] - v[3]) * inv - cache.cwc.offy);
+	out->Sum = (int)sum;
+	out->Qa = (int)q[0];
+	out->Qb = (int)q[1];
+	out->Qc = (int)q[2];
+	out->Qd = (int)q[3];
+}
 
-	theta = (2.0*M_PI*fif)/fadc;
-	a = -(cos(theta)/sin(theta));
-	b = 1/sin(theta);
+//--------------------------------------------------------------------------
 
-	double qa, qb, qc, qd;
-	double va, vb, vc, vd;
-	double sum;
-	double x, y;
-	double d1, d2;
+/** Private. EBPP specific.
+ *
+ *  Calculate ADC CW valuses, in single precision with the coefficients
+ *  precalculated by ebpp_update_cw.
+ *  @param in Pointer to the CSPI_ADC_ATOM to transform.
+ *  @param out Pointer to the CSPI_ADC_CW_ATOM to overwrite.
+ */
+int ebpp_transform_adc_cw( const void *in, void *out, size_t count )
+{
+	const CSPI_ADC_ATOM *curr = (const CSPI_ADC_ATOM*)in;
+	CSPI_ADC_CW_ATOM *curr_out = (CSPI_ADC_CW_ATOM*)out;
 
-	curr = prev = (CSPI_ADC_ATOM*)in;
-	curr_out = (CSPI_ADC_CW_ATOM*)out;
+	const float a = cache.cwc.a;
+	const float b = cache.cwc.b;
 
-	d1 = (a*(double)prev->chA);	qa = sqrt( 2.0*d1*d1 );
-	d1 = (a*(double)prev->chB);	qb = sqrt( 2.0*d1*d1 );
-	d1 = (a*(double)prev->chC);	qc = sqrt( 2.0*d1*d1 );
-	d1 = (a*(double)prev->chD);	qd = sqrt( 2.0*d1*d1 );
+	float prev[4], ch[4], qsq[4];
+	int c;
 
-	d1 = (double)curr->chA;	va = sqrt( d1*d1 + qa*qa );
-	d1 = (double)curr->chB;	vb = sqrt( d1*d1 + qb*qb );
-	d1 = (double)curr->chC;	vc = sqrt( d1*d1 + qc*qc );
-	d1 = (double)curr->chD;	vd = sqrt( d1*d1 + qd*qd );
+	if ( !count ) return 0;
 
-	sum = va + vb + vc + vd;
-	x = cache.Kx * (va + vd - vb - vc) / sum;
-	y = cache.Ky * (va + vb - vc - vd) / sum;
+	// The first sample has no previous one: qsq = 2*(a*ch)^2
+	ch[0] = curr->chA; ch[1] = curr->chB; ch[2] = curr->chC; ch[3] = curr->chD;
+	for ( c=0; c<4; c++ ) {
 
-	curr_out->chA = curr->chA;
-	curr_out->chB = curr->chB;
-	curr_out->chC = curr->chC;
-	curr_out->chD = curr->chD;
-	curr_out->X = (int)(x - offx);
-	curr_out->Y = (int)(y - offy);
-	curr_out->Sum = (int)sum;
-	curr_out->Qa = (int)qa;
-	curr_out->Qb = (int)qb;
-	curr_out->Qc = (int)qc;
-	curr_out->Qd = (int)qd;
+		const float d1 = a*ch[c];
+		qsq[c] = 2.0f*d1*d1;
+		prev[c] = ch[c];
+	}
+	ebpp_adc_cw_atom( ch, qsq, curr, curr_out );
 
 	++curr_out;
 	++curr;
 
-	for( size_t i=1; i<count; i++, prev++, curr++, curr_out++ ) {
-
-		d1 = (a*(double)curr->chA);	d2 = (b*(double)prev->chA);	qa = sqrt( d1*d1 + d2*d2 );
-		d1 = (a*(double)curr->chB);	d2 = (b*(double)prev->chB);	qb = sqrt( d1*d1 + d2*d2 );
-		d1 = (a*(double)curr->chC);	d2 = (b*(double)prev->chC);	qc = sqrt( d1*d1 + d2*d2 );
-		d1 = (a*(double)curr->chD);	d2 = (b*(double)prev->chD);	qd = sqrt( d1*d1 + d2*d2 );
-
-		d1 = (double)curr->chA;	va = sqrt( d1*d1 + qa*qa );
-		d1 = (double)curr->chB;	vb = sqrt( d1*d1 + qb*qb );
-		d1 = (double)curr->chC;	vc = sqrt( d1*d1 + qc*qc );
-		d1 = (double)curr->chD;	vd = sqrt( d1*d1 + qd*qd );
-
-		sum = va + vb + vc + vd;
-		x = kx * (va + vd - vb - vc) / sum;
-		y = ky * (va + vb - vc - vd) / sum;
-
-		curr_out->chA = curr->chA;
-		curr_out->chB = curr->chB;
-		curr_out->chC = curr->chC;
-		curr_out->chD = curr->chD;
-		curr_out->X = (int)(x - offx);
-		curr_out->Y = (int)(y - offy);
-		curr_out->Sum = (int)sum;
-		curr_out->Qa = (int)qa;
-		curr_out->Qb = (int)qb;
-		curr_out->Qc = (int)qc;
-		curr_out->Qd = (int)qd;
+	for( size_t i=1; i<count; i++, curr++, curr_out++ ) {
+
+		ch[0] = curr->chA; ch[1] = curr->chB; ch[2] = curr->chC; ch[3] = curr->chD;
+		for ( c=0; c<4; c++ ) {
+
+			const float d1 = a*ch[c];
+			const float d2 = b*prev[c];
+			qsq[c] = d1*d1 + d2*d2;
+			prev[c] = ch[c];
+		}
+		ebpp_adc_cw_atom( ch, qsq, curr, curr_out );
 	}
-	//*/
 
 	return 0;
 }
@@ -1877,84 +2263,138 @@ static int ebpp_transform_adc_cw( const void *in, void *out, size_t count )
 typedef void (*SP_POS_FNC)(double *x, double *y, double *sum,
 	 double aa, double ab, double ac, double ad);
 
+/** Number of ADC atoms compared per block by ebpp_sp_scan. */
+#define SP_SCAN_ATOMS 16
+
 /** Private. EBPP specific. Local to this module only.
  *
- *  Calculate ADC SP valuses.
- *  @param in Not used.
- *  @param out Pointer to the CSPI_ADC_ATOM to transform.
+ *  Returns the index of the first of count CSPI_ADC_ATOMs, from first on,
+ *  with a channel above threshold, or count if none is.
+ *  Whole blocks of SP_SCAN_ATOMS atoms are compared branchless, the 16-bit
+ *  lane loop is left to the compiler to vectorize (NEON, SSE), and only
+ *  the block with the crossing is searched atom by atom.
+ *  @param buffer Pointer to the CSPI_ADC_ATOMs.
+ *  @param first Index of the first atom to search.
+ *  @param count Number of atoms.
+ *  @param threshold Single pass threshold.
  */
-static int ebpp_transform_adc_common( const void *in, void *out, size_t count,
-	SP_POS_FNC sp_pos)
+static size_t ebpp_sp_scan( const CSPI_ADC_ATOM *buffer, size_t first,
+                            size_t count, int threshold )
 {
-	CSPI_ADC_ATOM *buffer = (CSPI_ADC_ATOM*)in;
-	CSPI_ADC_ATOM *curr;
-	CSPI_ADC_SP_ATOM *o = (CSPI_ADC_SP_ATOM*)out;
+	if( threshold >= SHRT_MAX ) return count;
+	if( threshold < SHRT_MIN ) return first < count ? first : count;
+
+	const short t = (short)threshold;
+	const short *s = (const short *)buffer;	// chD, chC, chB, chA per atom
+	size_t i = first;
+
+	for( ; i + SP_SCAN_ATOMS <= count; i += SP_SCAN_ATOMS ) {
 
-	double kx = (double)cache.Kx;
-	double ky = (double)cache.Ky;
-	double offx = (double)cache.Xoffset;
-	double offy = (double)cache.Yoffset;
-	size_t trigger = count;
+		const short *b = s + 4*i;
+		short hit = 0;
+		int k;
 
-	int threshold = cache.sp.threshold;
-	size_t n_before = cache.sp.n_before;
-	size_t n_after = cache.sp.n_after;
+		for( k=0; k<4*SP_SCAN_ATOMS; k++ ) hit |= ( b[k] > t );
+		if( hit ) break;
+	}
+
+	for( ; i<count; i++ ) {
+
+		const short *b = s + 4*i;
+		if( ( b[0] > t ) | ( b[1] > t ) | ( b[2] > t ) | ( b[3] > t ) ) break;
+	}
+
+	return i;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Calculates the CSPI_ADC_SP_ATOM of a shot from the energy of the
+ *  n_before atoms before and the n_after atoms after the trigger.
+ *  With the trigger at count (no shot), only the parameters are set.
+ *  @param buffer Pointer to the CSPI_ADC_ATOMs.
+ *  @param count Number of atoms.
+ *  @param trigger Index of the threshold crossing.
+ *  @param sp_pos Button geometry.
+ *  @param o Pointer to the CSPI_ADC_SP_ATOM to overwrite.
+ */
+static void ebpp_sp_atom( const CSPI_ADC_ATOM *buffer, size_t count,
+                          size_t trigger, SP_POS_FNC sp_pos,
+                          CSPI_ADC_SP_ATOM *o )
+{
+	const size_t n_before = cache.sp.n_before;
+	const size_t n_after = cache.sp.n_after;
 
 	double ea, eb, ec, ed;	// energy
 	ea = eb = ec = ed = 0.0;
-	double aa, ab, ac, ad;	// amplitude
-	aa = ab = ac = ad = 0.0;
-	unsigned int i, j=0, k=0;
 	double d;
 	double sum = 0.0;
 	double x = 0.0, y = 0.0;
-
-	for( i=0, curr=buffer; i<count; i++, curr++ )
-	{
-		if ( ( curr->chA > threshold ) || ( curr->chB > threshold ) ||
-			( curr->chC > threshold ) || ( curr->chD > threshold ) )
-		{
-			trigger = i;
-			break;
-		}
-	}
+	size_t i, j, k;
 
 	if( trigger < count )
 	{
-#define __min( a, b ) a < b ? a : b
-#define __max( a, b ) a > b ? a : b
+		j = trigger < n_before ? 0 : trigger-n_before;
+		k = trigger+n_after+1 < count ? trigger+n_after+1 : count;
 
-		if( trigger < n_before ) j=0; else j=trigger-n_before;
-		k = __min( trigger+n_after+1, count );
-
-		for( curr=buffer+j, i=j; i<k; i++, curr++ )
+		for( i=j; i<k; i++ )
 		{
-			d = (double)curr->chA; ea += d*d;
-			d = (double)curr->chB; eb += d*d;
-			d = (double)curr->chC; ec += d*d;
-			d = (double)curr->chD; ed += d*d;
+			d = (double)buffer[i].chA; ea += d*d;
+			d = (double)buffer[i].chB; eb += d*d;
+			d = (double)buffer[i].chC; ec += d*d;
+			d = (double)buffer[i].chD; ed += d*d;
 		}
 
-		aa = sqrt( ea );
-		ab = sqrt( eb );
-		ac = sqrt( ec );
-		ad = sqrt( ed );
-
-		sp_pos(&x, &y, &sum, aa, ab, ac, ad);
+		sp_pos(&x, &y, &sum, sqrt( ea ), sqrt( eb ), sqrt( ec ), sqrt( ed ));
 
-		x = kx * x - offx;
-		y = ky * y - offy;
+		x = (double)cache.Kx * x - (double)cache.Xoffset;
+		y = (double)cache.Ky * y - (double)cache.Yoffset;
 	}
 
 	o->trigger = trigger;
-	o->threshold = threshold;
+	o->threshold = cache.sp.threshold;
 	o->n_before = n_before;
 	o->n_after = n_after;
 	o->X = x;
 	o->Y = y;
 	o->Sum = sum;
+}
 
-	return 0;
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Calculate ADC SP valuses: one CSPI_ADC_SP_ATOM for the first threshold
+ *  crossing or, with a separation, one per crossing at least separation
+ *  atoms after the previous one.
+ *  Returns the number of CSPI_ADC_SP_ATOMs written.
+ *  @param in Pointer to the CSPI_ADC_ATOMs.
+ *  @param out Pointer to the CSPI_ADC_SP_ATOMs to overwrite.
+ *  @param separation Shot separation in ADC atoms, 0 first shot only.
+ */
+static int ebpp_transform_adc_common( const void *in, void *out, size_t count,
+	SP_POS_FNC sp_pos, size_t separation )
+{
+	const CSPI_ADC_ATOM *buffer = (const CSPI_ADC_ATOM*)in;
+	CSPI_ADC_SP_ATOM *o = (CSPI_ADC_SP_ATOM*)out;
+
+	const int threshold = cache.sp.threshold;
+	size_t trigger = ebpp_sp_scan( buffer, 0, count, threshold );
+	int n = 0;
+
+	if( !separation ) {
+		ebpp_sp_atom( buffer, count, trigger, sp_pos, o );
+		return 1;
+	}
+
+	for( ; trigger < count; n++ ) {
+		ebpp_sp_atom( buffer, count, trigger, sp_pos, o+n );
+		trigger = ebpp_sp_scan( buffer, trigger+separation, count, threshold );
+	}
+
+	return n;
 }
 
 void sp_pos_straight(double *x, double *y, double *sum,
@@ -1973,14 +2413,49 @@ void sp_pos_rot(double *x, double *y, double *sum,
 		*y = ( ab - ad ) / ( ab + ad );
 }
 
-static int ebpp_transform_adc_sp( const void *in, void *out, size_t count )
+int ebpp_transform_adc_sp( const void *in, void *out, size_t count )
 {
-	return ebpp_transform_adc_common(in, out, count, sp_pos_straight);
+	return ebpp_transform_adc_common(in, out, count, sp_pos_straight, 0);
 }
 
-static int ebpp_transform_adc_sp_rot( const void *in, void *out, size_t count )
+int ebpp_transform_adc_sp_rot( const void *in, void *out, size_t count )
 {
-	return ebpp_transform_adc_common(in, out, count, sp_pos_rot);
+	return ebpp_transform_adc_common(in, out, count, sp_pos_rot, 0);
+}
+
+int ebpp_transform_adc_shots( const void *in, void *out, size_t count,
+	size_t separation, int rot )
+{
+	return ebpp_transform_adc_common(in, out, count,
+		rot ? sp_pos_rot : sp_pos_straight, separation);
+}
+
+//--------------------------------------------------------------------------
+
+int custom_transform_sp( const Connection *p, const void *in, void *out,
+                         size_t count )
+{
+	ASSERT(p);
+	return ebpp_transform_adc_shots( in, out, count, p->sp_separation,
+		CSPI_MODE_ADC_SP_ROT == p->mode );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. EBPP specific. Local to this module only.
+ *
+ *  Returns the DD/PM transform selected with the transform library
+ *  parameter (see CSPI_LIBPARAMS).
+ */
+static CSPI_AUX_FNC ebpp_getdefaultop_dd()
+{
+	if ( environment.module.transform & CSPI_TRANSFORM_RCP ) {
+		return ebpp_transform_dd_rcp;
+	}
+	if ( environment.module.transform & CSPI_TRANSFORM_BATCH ) {
+		return ebpp_transform_dd_batch;
+	}
+	return ebpp_transform_dd;
 }
 
 //--------------------------------------------------------------------------
@@ -1996,10 +2471,10 @@ CSPI_AUX_FNC custom_getdefaultop( const Connection *p )
 			if( (2 == cache.sr.dsc) && (0 != cache.sr.cspi_enable) ) {
 				return ebpp_transform_dd_remove_spikes;
 			}
-			return ebpp_transform_dd;
+			return ebpp_getdefaultop_dd();
 
 		case CSPI_MODE_PM:
-			return ebpp_transform_dd;
+			return ebpp_getdefaultop_dd();
 
 		case CSPI_MODE_ADC_CW:
 			return ebpp_transform_adc_cw;
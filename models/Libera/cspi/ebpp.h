@@ -331,6 +331,13 @@ typedef struct {
 
 	/** SA non-blocking mode. */
 	size_t nonblock;
+
+	/** Minimum separation in ADC samples between two single pass shots
+	 *  (CSPI_MODE_ADC_SP, CSPI_MODE_ADC_SP_ROT). 0 (the default) returns
+	 *  one CSPI_ADC_SP_ATOM for the first threshold crossing only,
+	 *  otherwise one atom per crossing: the read destination must hold
+	 *  as many atoms as ADC atoms are read. */
+	size_t sp_separation;
 }
 CSPI_CONPARAMS_EBPP;
 #pragma pack()
@@ -343,6 +350,7 @@ CSPI_CONPARAMS_EBPP;
 typedef enum {
 	CSPI_CON_DEC        = CUSTOM_CON_BIT(0),
 	CSPI_CON_SANONBLOCK = CUSTOM_CON_BIT(1),
+	CSPI_CON_SPSEPARATION = CUSTOM_CON_BIT(2),
 }
 CSPI_CONFLAGS_EBPP;
 
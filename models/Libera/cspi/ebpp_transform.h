@@ -0,0 +1,111 @@
+//! \file ebpp_transform.h
+//! Private EBPP data transforms, exported for the transform check and
+//! benchmark programs.
+
+#if !defined(_EBPP_TRANSFORM_H)
+#define _EBPP_TRANSFORM_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Private. EBPP specific.
+ *  Transforms CSPI_DD_RAWATOMs into CSPI_DD_ATOMs, one atom and three
+ *  64-bit divisions at a time. This is the reference implementation.
+ *  Can transform in place (in == out). Returns 0.
+ */
+int ebpp_transform_dd( const void *in, void *out, size_t count );
+
+/** Private. EBPP specific.
+ *  Same as ebpp_transform_dd, using the batched CORDIC kernel.
+ */
+int ebpp_transform_dd_batch( const void *in, void *out, size_t count );
+
+/** Private. EBPP specific.
+ *  Same as ebpp_transform_dd_batch, with one reciprocal of the sum per
+ *  atom instead of the three divisions.
+ */
+int ebpp_transform_dd_rcp( const void *in, void *out, size_t count );
+
+/** Private. EBPP specific.
+ *  Same as ebpp_transform_dd, then replaces the samples around the
+ *  switching spikes with their average (see the CSPI_ENV_SR parameters).
+ *  The trigger bit of cosVa marks the switching edges. Single pass, can
+ *  transform in place. Returns 0, or a negative value if less than two
+ *  edges are found or the average window is not a power of 2.
+ */
+int ebpp_transform_dd_remove_spikes( const void *in, void *out, size_t count );
+
+/** Private. EBPP specific.
+ *  Straightforward implementation of ebpp_transform_dd_remove_spikes,
+ *  to validate it against.
+ */
+int ebpp_transform_dd_remove_spikes_ref( const void *in, void *out, size_t count );
+
+/** Private. EBPP specific.
+ *  Transforms CSPI_ADC_ATOMs into CSPI_ADC_CW_ATOMs. Returns 0.
+ */
+int ebpp_transform_adc_cw( const void *in, void *out, size_t count );
+
+/** Private. EBPP specific.
+ *  Calculates the single pass CSPI_ADC_SP_ATOM of the first threshold
+ *  crossing in count CSPI_ADC_ATOMs, with the straight or rotated button
+ *  geometry. Returns 1.
+ */
+int ebpp_transform_adc_sp( const void *in, void *out, size_t count );
+int ebpp_transform_adc_sp_rot( const void *in, void *out, size_t count );
+
+/** Private. EBPP specific.
+ *  As ebpp_transform_adc_sp (rot 0) or ebpp_transform_adc_sp_rot, one atom
+ *  per crossing at least separation atoms after the previous one when
+ *  separation is not 0 (out must then hold count atoms), see the
+ *  sp_separation connection parameter.
+ *  Returns the number of atoms written.
+ */
+int ebpp_transform_adc_shots( const void *in, void *out, size_t count,
+	size_t separation, int rot );
+
+/** Private. EBPP specific.
+ *  Overwrites the cached calibration coefficients and offsets used by
+ *  the position calculations, without accessing Libera. The cache is
+ *  reloaded from Libera as soon as an environment parameter changes.
+ *
+ *  @param Kx Horizontal calibration coefficient.
+ *  @param Ky Vertical calibration coefficient.
+ *  @param Xoffset Horizontal offset.
+ *  @param Yoffset Vertical offset.
+ *  @param Qoffset Electrical offset.
+ */
+void ebpp_setcache_position( int Kx, int Ky, int Xoffset, int Yoffset,
+                             int Qoffset );
+
+/** Private. EBPP specific.
+ *  Overwrites the cached single pass parameters, see ebpp_setcache_position.
+ */
+void ebpp_setcache_sp( int threshold, int n_before, int n_after );
+
+/** Private. EBPP specific.
+ *  Overwrites the cached spike removal parameters, see
+ *  ebpp_setcache_position.
+ */
+void ebpp_setcache_sr( int averaging_stop, int average_window, int start,
+                       int window );
+
+/** Private. EBPP specific.
+ *  Overwrites the cached machine frequencies the ADC CW coefficients are
+ *  calculated from, see ebpp_setcache_position.
+ *
+ *  @param frequency LMC frequency (dHz).
+ *  @param harmonic Harmonic number.
+ *  @param frev Revolution frequency (Hz).
+ */
+void ebpp_setcache_cw( unsigned long frequency, unsigned long harmonic,
+                       double frev );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	// _EBPP_TRANSFORM_H
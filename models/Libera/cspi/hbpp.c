@@ -104,3 +104,8 @@ CSPI_AUX_FNC custom_getdefaultop( const Connection *p )
 //--------------------------------------------------------------------------
 
 int custom_initop() { /*not used*/ return CSPI_OK; }
+
+//--------------------------------------------------------------------------
+
+int custom_transform_sp( const Connection *p, const void *in, void *out,
+                         size_t count ) { /*not used*/ return 0; }
@@ -0,0 +1,288 @@
+//! \file health.c
+//! Implements the health (temperature, fans, PS voltages) sampler.
+
+/*
+CSPI - Control System Programming Interface
+Copyright (C) 2004-2006 Instrumentation Technologies
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+or visit http://www.gnu.org
+*/
+
+/* TAB = 4 spaces. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "cspi.h"
+#include "cspi_impl.h"
+#include "health.h"
+#include "io.h"
+#include "msp.h"
+
+/** Private.
+ *  Health sampler state. The descriptors are opened once and re-read
+ *  with pread, the sample is protected by the mutex.
+ */
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		//!< Signals stop or period change.
+	pthread_t thread;
+	int running;				//!< Sampler thread started.
+	int stop;					//!< Sampler thread must exit.
+	unsigned int period;		//!< Sampling period (ms).
+
+	int fd_temp;				//!< sysfs temperature (millidegrees).
+	int fd_fan[2];				//!< sysfs front and back fan speed.
+	int fd_msp;					//!< MSP PS voltages.
+
+	cspi_health_t sample;		//!< Latest sample.
+	int rc;						//!< Result of the latest sample.
+} health = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	0, 0, 0, HEALTH_PERIOD,
+	-1, {-1, -1}, -1,
+	{0, {0, 0}, {0}},
+	CSPI_E_SEQUENCE,
+};
+
+//--------------------------------------------------------------------------
+
+static void health_close();
+
+/** Private.
+ *  Opens the sysfs and MSP descriptors, the sysfs paths are resolved
+ *  here once. Assume health.mutex has been locked by caller.
+ */
+static int health_open()
+{
+	const char *dir       = "/sys/class/i2c-adapter/i2c-0";
+	const char *check_dir = "/sys/class/i2c-adapter/i2c-0/device/0-0029";
+	const char *proc_temp = "/0-0029/temp1_input";
+	const char *proc_fan0 = "/0-004b/fan1_input";
+	const char *proc_fan1 = "/0-0048/fan1_input";
+	const char *mspdev    = "/dev/msp0";
+	char path[1024];
+
+	if ( -1 != health.fd_msp ) return CSPI_OK;
+
+	const char *sub = ( 0 == access(check_dir, F_OK) ) ? "/device" : "";
+
+	snprintf( path, sizeof(path), "%s%s%s", dir, sub, proc_temp );
+	health.fd_temp = io_open( path, O_RDONLY );
+	snprintf( path, sizeof(path), "%s%s%s", dir, sub, proc_fan0 );
+	health.fd_fan[0] = io_open( path, O_RDONLY );
+	snprintf( path, sizeof(path), "%s%s%s", dir, sub, proc_fan1 );
+	health.fd_fan[1] = io_open( path, O_RDONLY );
+	health.fd_msp = io_open( mspdev, O_RDONLY );
+
+	if ( -1 == health.fd_temp || -1 == health.fd_fan[0] ||
+	     -1 == health.fd_fan[1] || -1 == health.fd_msp ) {
+
+		CSPI_ERR( "cannot open the health devices" );
+		health_close();
+		return CSPI_E_SYSTEM;
+	}
+	return CSPI_OK;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Closes the descriptors. Assume health.mutex has been locked by caller.
+ */
+static void health_close()
+{
+	if ( -1 != health.fd_temp ) io_close( health.fd_temp );
+	if ( -1 != health.fd_fan[0] ) io_close( health.fd_fan[0] );
+	if ( -1 != health.fd_fan[1] ) io_close( health.fd_fan[1] );
+	if ( -1 != health.fd_msp ) io_close( health.fd_msp );
+
+	health.fd_temp = health.fd_fan[0] = health.fd_fan[1] = health.fd_msp = -1;
+	health.rc = CSPI_E_SEQUENCE;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Reads an integer from the beginning of a sysfs attribute.
+ */
+static int health_read_int( int fd, int *value )
+{
+	char buf[32];
+
+	if ( -1 == fd ) return CSPI_E_SYSTEM;
+
+	ssize_t n = io_pread( fd, buf, sizeof(buf) - 1, 0 );
+	if ( n <= 0 ) return CSPI_E_SYSTEM;
+
+	buf[n] = 0;
+	*value = atoi( buf );
+
+	return CSPI_OK;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Reads all the health values from the open descriptors.
+ *  Does not need health.mutex, the descriptors are not closed while
+ *  the sampler thread is running.
+ */
+static int health_read( cspi_health_t *p )
+{
+	msp_atom_t msp_atom;
+	int rc;
+
+	// Temperature
+	rc = health_read_int( health.fd_temp, &p->temp );
+	if ( CSPI_OK != rc ) return rc;
+	p->temp /= 1000;
+
+	// Front and back fan
+	rc = health_read_int( health.fd_fan[0], &p->fan[0] );
+	if ( CSPI_OK != rc ) return rc;
+	rc = health_read_int( health.fd_fan[1], &p->fan[1] );
+	if ( CSPI_OK != rc ) return rc;
+
+	// PS voltages, every read of the MSP device starts a conversion
+	if ( -1 == health.fd_msp ) return CSPI_E_SYSTEM;
+	if ( sizeof(msp_atom_t) != io_pread( health.fd_msp, &msp_atom, sizeof(msp_atom_t), 0 ) )
+		return CSPI_E_SYSTEM;
+
+	memcpy( p->voltage, msp_atom.voltage, sizeof(p->voltage) );
+
+	return CSPI_OK;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Sampler thread, reads the health values every health.period ms.
+ */
+static void *health_thread( void *arg )
+{
+	VERIFY( 0 == pthread_mutex_lock( &health.mutex ) );
+	while ( !health.stop ) {
+
+		cspi_health_t sample;
+
+		// Read outside the lock, health_get never waits for the devices.
+		VERIFY( 0 == pthread_mutex_unlock( &health.mutex ) );
+		int rc = health_read( &sample );
+		VERIFY( 0 == pthread_mutex_lock( &health.mutex ) );
+
+		health.rc = rc;
+		if ( CSPI_OK == rc ) health.sample = sample;
+
+		struct timespec until;
+		clock_gettime( CLOCK_REALTIME, &until );
+		until.tv_sec += health.period / 1000;
+		until.tv_nsec += (health.period % 1000) * 1000000;
+		if ( until.tv_nsec >= 1000000000 ) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+		// Woken up early on stop or period change.
+		if ( !health.stop )
+			pthread_cond_timedwait( &health.cond, &health.mutex, &until );
+	}
+	VERIFY( 0 == pthread_mutex_unlock( &health.mutex ) );
+
+	return 0;
+}
+
+//--------------------------------------------------------------------------
+
+int health_start( unsigned int period )
+{
+	int rc;
+
+	VERIFY( 0 == pthread_mutex_lock( &health.mutex ) );
+
+	health.period = period;
+	rc = health_open();
+	if ( CSPI_OK == rc && period ) {
+
+		if ( health.running ) {
+			VERIFY( 0 == pthread_cond_signal( &health.cond ) );
+		}
+		else {
+			health.stop = 0;
+			if ( 0 == pthread_create( &health.thread, 0, health_thread, 0 ) )
+				health.running = 1;
+			else
+				rc = CSPI_E_SYSTEM;
+		}
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &health.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+void health_stop()
+{
+	VERIFY( 0 == pthread_mutex_lock( &health.mutex ) );
+
+	if ( health.running ) {
+
+		health.stop = 1;
+		VERIFY( 0 == pthread_cond_signal( &health.cond ) );
+		VERIFY( 0 == pthread_mutex_unlock( &health.mutex ) );
+
+		VERIFY( 0 == pthread_join( health.thread, 0 ) );
+
+		VERIFY( 0 == pthread_mutex_lock( &health.mutex ) );
+		health.running = 0;
+	}
+	health_close();
+
+	VERIFY( 0 == pthread_mutex_unlock( &health.mutex ) );
+}
+
+//--------------------------------------------------------------------------
+
+int health_get( cspi_health_t *p )
+{
+	int rc;
+
+	ASSERT(p);
+
+	VERIFY( 0 == pthread_mutex_lock( &health.mutex ) );
+
+	if ( health.running && CSPI_E_SEQUENCE != health.rc ) {
+
+		// Latest sample.
+		rc = health.rc;
+		if ( CSPI_OK == rc ) *p = health.sample;
+	}
+	else {
+		// No sampler (or no sample yet): read now.
+		rc = health_open();
+		if ( CSPI_OK == rc ) rc = health_read( p );
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &health.mutex ) );
+	return rc;
+}
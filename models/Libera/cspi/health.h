@@ -0,0 +1,45 @@
+//! \file health.h
+//! Declares the health (temperature, fans, PS voltages) sampler.
+
+#if !defined(_HEALTH_H)
+#define _HEALTH_H
+
+#if !defined(_CSPI_H)
+#error ERROR: Include cspi.h first!
+#endif	// _CSPI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default sampling period of the health sampler in milliseconds. */
+#define HEALTH_PERIOD	1000
+
+/** Private.
+ *  Opens the sysfs and MSP descriptors (once) and, if period is not 0,
+ *  starts the sampler thread reading them every period milliseconds.
+ *  If the sampler is already running, only the period is changed.
+ *  Returns CSPI_OK on success, or CSPI_E_SYSTEM.
+ *
+ *  @param period Sampling period in milliseconds, 0 to read on demand.
+ */
+int health_start( unsigned int period );
+
+/** Private.
+ *  Stops the sampler thread and closes the descriptors.
+ */
+void health_stop( void );
+
+/** Private.
+ *  Returns the latest sample taken by the sampler thread, or reads
+ *  the descriptors if the sampler is not running.
+ *  Returns CSPI_OK on success, or CSPI_E_SYSTEM.
+ *
+ *  @param p Pointer to the health structure to fill in.
+ */
+int health_get( cspi_health_t *p );
+
+#ifdef __cplusplus
+}
+#endif
+#endif	// _HEALTH_H
@@ -0,0 +1,123 @@
+//! \file io.c
+//! Implements the device I/O backend and the backend selection.
+
+/*
+CSPI - Control System Programming Interface
+Copyright (C) 2004-2008 Instrumentation Technologies
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+or visit http://www.gnu.org
+*/
+
+/* TAB = 4 spaces. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "cspi.h"
+#include "cspi_impl.h"
+#include "io.h"
+
+//--------------------------------------------------------------------------
+
+/** Private. open without a mode, device files are never created. */
+static int device_open( const char *pathname, int flags )
+{
+	return open( pathname, flags );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. ioctl with a pointer argument. */
+static int device_ioctl( int fd, unsigned long request, void *arg )
+{
+	return ioctl( fd, request, arg );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. fcntl with an integer argument. */
+static int device_fcntl( int fd, int cmd, long arg )
+{
+	return fcntl( fd, cmd, arg );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. poll on POLLIN of a single fd, restarted on signals. */
+static int device_poll( int fd, int timeout )
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	int rc;
+
+	do rc = poll( &pfd, 1, timeout ); while ( -1 == rc && EINTR == errno );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+const IO_backend io_device = {
+	"device",
+	device_open,
+	close,
+	read,
+	pread,
+	write,
+	lseek,
+	device_ioctl,
+	device_fcntl,
+	device_poll,
+	0,
+	0,
+	0,
+};
+
+const IO_backend *cspi_io = &io_device;
+
+//--------------------------------------------------------------------------
+
+int io_select( int backend )
+{
+	const char *name = getenv( "CSPI_BACKEND" );
+
+	if ( name ) {
+
+		if ( 0 == strcmp( name, io_sim.name ) ) backend = CSPI_BACKEND_SIM;
+		else if ( 0 == strcmp( name, io_device.name ) ) backend = CSPI_BACKEND_DEVICE;
+		else CSPI_ERR( "unknown CSPI_BACKEND %s", name );
+	}
+
+	switch ( backend ) {
+
+		case CSPI_BACKEND_DEVICE:
+			cspi_io = &io_device;
+			break;
+
+		case CSPI_BACKEND_SIM:
+			cspi_io = &io_sim;
+			break;
+
+		default:
+			return CSPI_E_INVALID_PARAM;
+	}
+	CSPI_LOG( "%s backend", cspi_io->name );
+
+	return CSPI_OK;
+}
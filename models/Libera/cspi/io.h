@@ -0,0 +1,144 @@
+//! \file io.h
+//! Declares the I/O backends CSPI accesses the Libera devices through.
+
+/*
+CSPI - Control System Programming Interface
+Copyright (C) 2004-2008 Instrumentation Technologies
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+or visit http://www.gnu.org
+*/
+
+#if !defined(_IO_H)
+#define _IO_H
+
+#include <sys/types.h>
+
+#if !defined(_CSPI_H)
+#error ERROR: Include cspi.h first!
+#endif	// _CSPI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Private.
+ *  I/O backend: the system calls on the Libera device files
+ *  (/dev/libera.*, /dev/msp0 and the health sysfs attributes) and the
+ *  requests to the Libera daemons. The system call members follow the
+ *  semantics of their POSIX counterparts, errors are reported in errno.
+ */
+typedef struct tagIO_backend {
+	/** Backend name, for logging. */
+	const char *name;
+
+	int (*open)( const char *pathname, int flags );
+	int (*close)( int fd );
+	ssize_t (*read)( int fd, void *buf, size_t count );
+	ssize_t (*pread)( int fd, void *buf, size_t count, off_t offset );
+	ssize_t (*write)( int fd, const void *buf, size_t count );
+	off_t (*lseek)( int fd, off_t offset, int whence );
+	int (*ioctl)( int fd, unsigned long request, void *arg );
+	int (*fcntl)( int fd, int cmd, long arg );
+	/** Waits up to timeout ms (forever if negative) for fd to be
+	 *  readable, as poll(2) on POLLIN. Returns 1 if readable, 0 if
+	 *  the timeout expired, -1 on error. */
+	int (*poll)( int fd, int timeout );
+
+	/** DSC daemon request, see ebpp_dsc_message.
+	 *  0 to send the request to the daemon FIFO. */
+	int (*dsc_message)( size_t msg_type, size_t size, void *msg_val );
+	/** LPLLD command, status is 0 for a set command, otherwise the
+	 *  pll_status_t to fill in. 0 to use the daemon FIFOs. */
+	int (*pll_message)( const char *cmd, void *status );
+	/** Event daemon (un)registration of a listener, a 0 mask unregisters.
+	 *  0 to send the request to the event daemon FIFO. */
+	int (*event_request)( pid_t pid, int uid, size_t mask );
+}
+IO_backend;
+
+/** Private. Libera device files and daemons. */
+extern const IO_backend io_device;
+
+/** Private. Simulated Libera, see sim.c. */
+extern const IO_backend io_sim;
+
+/** Private.
+ *  Backend in use, selected when the environment is allocated.
+ *  Defaults to io_device.
+ */
+extern const IO_backend *cspi_io;
+
+/** Private.
+ *  Selects the backend for the CSPI_BACKEND_xxx value, the CSPI_BACKEND
+ *  environment variable ("device" or "sim") takes precedence when set.
+ *  Assume no device is open.
+ *  Returns CSPI_OK on success, or CSPI_E_INVALID_PARAM.
+ *
+ *  @param backend One of the CSPI_BACKEND_xxx values.
+ */
+int io_select( int backend );
+
+//--------------------------------------------------------------------------
+
+static inline int io_open( const char *pathname, int flags )
+{
+	return cspi_io->open( pathname, flags );
+}
+
+static inline int io_close( int fd )
+{
+	return cspi_io->close( fd );
+}
+
+static inline ssize_t io_read( int fd, void *buf, size_t count )
+{
+	return cspi_io->read( fd, buf, count );
+}
+
+static inline ssize_t io_pread( int fd, void *buf, size_t count, off_t offset )
+{
+	return cspi_io->pread( fd, buf, count, offset );
+}
+
+static inline ssize_t io_write( int fd, const void *buf, size_t count )
+{
+	return cspi_io->write( fd, buf, count );
+}
+
+static inline off_t io_lseek( int fd, off_t offset, int whence )
+{
+	return cspi_io->lseek( fd, offset, whence );
+}
+
+static inline int io_ioctl( int fd, unsigned long request, void *arg )
+{
+	return cspi_io->ioctl( fd, request, arg );
+}
+
+static inline int io_fcntl( int fd, int cmd, long arg )
+{
+	return cspi_io->fcntl( fd, cmd, arg );
+}
+
+static inline int io_poll( int fd, int timeout )
+{
+	return cspi_io->poll( fd, timeout );
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif	// _IO_H
@@ -30,75 +30,222 @@ or visit http://www.gnu.org
 
 #include "pool.h"
 
-/** Private. Typedef representing a single byte. */
-typedef unsigned char byte;
-
 /* forward decl */
 typedef struct Pool_object_t Pool_object;
 
 /** Private.
- *  Represents a linked list of memory objects that constitute a pool.
+ *  Represents a free memory block, linked in a free list.
+ *  The size of the block is given by the free list it belongs to.
  */
 struct Pool_object_t {
 
-    /** A memory block to use for allocations. */
-	byte _unused[ CHUNK_SIZE ];
-
     /** A pointer to the next memory block. */
 	Pool_object *next;
 };
 
 /** Private.
- *  Represents a memory pool of fixed-size objects (blocks).
+ *  Represents the per thread cache of free blocks of each size class.
+ *  Accessed by the owning thread only, thus without locking.
+ */
+typedef struct {
+
+	/** Free blocks of each size class. */
+	Pool_object *head[ POOL_CLASSES ];
+
+	/** The number of blocks in each free list. */
+	size_t count[ POOL_CLASSES ];
+} Pool_cache;
+
+/** Private.
+ *  Represents a memory pool of power of two size classes.
  */
 typedef struct {
 
-	/** Protect from concurrent modifications. */
+	/** Protect the shared free lists from concurrent modifications. */
 	pthread_mutex_t mutex;
 
-	/** A pointer to the head of the free list. */
-	Pool_object *head;
+	/** Shared free lists, one for each size class. */
+	Pool_object *head[ POOL_CLASSES ];
+
+	/** Key of the per thread caches. */
+	pthread_key_t key;
+
+	/** Key initialization control. */
+	pthread_once_t once;
+
+	/** Statistics, updated with atomic operations, pooled under the mutex. */
+	POOL_STATS stats;
 } Pool;
 
 /** Instantiate one and only memory pool. */
-Pool pool = { PTHREAD_MUTEX_INITIALIZER, 0, };
+Pool pool = { PTHREAD_MUTEX_INITIALIZER, { 0 }, 0, PTHREAD_ONCE_INIT, };
 
 //--------------------------------------------------------------------------
 
-void* pool_malloc( size_t size )
+/** Private.
+ *  Returns the size class of size bytes or -1 if too large.
+ */
+static inline int pool_class( size_t size )
 {
-	if ( !size || size > CHUNK_SIZE ) return malloc( size );
+	int c = 0;
+	size_t csize = (size_t)1 << POOL_MIN_SHIFT;
+
+	while ( csize < size ) {
+
+		if ( ++c == POOL_CLASSES ) return -1;
+		csize <<= 1;
+	}
+	return c;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Returns the block size of the size class c.
+ */
+static inline size_t pool_classsize( int c )
+{
+	return (size_t)1 << (POOL_MIN_SHIFT + c);
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Puts obj on the shared free list of the size class c, or gives it
+ *  back to standard free beyond POOL_FREE_MAX. Call with the mutex held.
+ */
+static void pool_put( int c, Pool_object *obj )
+{
+	const size_t csize = pool_classsize( c );
+
+	if ( pool.stats.pooled + csize > POOL_FREE_MAX ) {
+
+		free( obj );
+		__sync_fetch_and_add( &pool.stats.released, 1 );
+		return;
+	}
+	obj->next = pool.head[c];
+	pool.head[c] = obj;
+	pool.stats.pooled += csize;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Thread exit handler. Gives cached blocks back to the shared pool.
+ */
+static void pool_cache_release( void *arg )
+{
+	Pool_cache *cache = (Pool_cache *) arg;
 
 	pthread_mutex_lock( &pool.mutex );
-	Pool_object *p = pool.head;
+	for ( int c=0; c < POOL_CACHE_CLASSES; ++c ) {
 
-	if ( p ) {
+		while ( cache->head[c] ) {
+
+			Pool_object *obj = cache->head[c];
+			cache->head[c] = obj->next;
+			pool_put( c, obj );
+		}
+	}
+	pthread_mutex_unlock( &pool.mutex );
+
+	free( cache );
+}
+
+//--------------------------------------------------------------------------
+
+static void pool_init_key()
+{
+	pthread_key_create( &pool.key, pool_cache_release );
+}
+
+//--------------------------------------------------------------------------
 
-		pool.head = p->next;
+/** Private.
+ *  Returns the cache of the calling thread, 0 if it cannot be allocated.
+ */
+static Pool_cache *pool_cache()
+{
+	pthread_once( &pool.once, pool_init_key );
+
+	Pool_cache *cache = (Pool_cache *) pthread_getspecific( pool.key );
+	if ( !cache ) {
+
+		cache = (Pool_cache *) calloc( 1, sizeof(Pool_cache) );
+		if ( cache && pthread_setspecific( pool.key, cache ) ) {
+
+			free( cache );
+			cache = 0;
+		}
+	}
+	return cache;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Adds size bytes to the bytes in use and updates the high-water mark.
+ */
+static inline void pool_account( size_t size )
+{
+	const size_t in_use = __sync_add_and_fetch( &pool.stats.in_use, size );
+	size_t hw = pool.stats.high_water;
+
+	while ( in_use > hw ) {
+
+		const size_t prev = __sync_val_compare_and_swap( &pool.stats.high_water, hw, in_use );
+		if ( prev == hw ) break;
+		hw = prev;
+	}
+}
+
+//--------------------------------------------------------------------------
+
+void* pool_malloc( size_t size )
+{
+	const int c = size ? pool_class( size ) : -1;
+
+	if ( c < 0 ) {
+
+		__sync_fetch_and_add( &pool.stats.oversize, 1 );
+		return malloc( size );
+	}
+
+	Pool_object *p = 0;
+	Pool_cache *cache = pool_cache();
+
+	// Thread cache first, no locking.
+	if ( cache && cache->head[c] ) {
+
+		p = cache->head[c];
+		cache->head[c] = p->next;
+		cache->count[c]--;
 	}
 	else {
 
-		// Allocate a block of memory to hold OBJECT_COUNT objects.
-		Pool_object *new =
-			(Pool_object *) malloc( OBJECT_COUNT * sizeof(Pool_object) );
+		pthread_mutex_lock( &pool.mutex );
+		p = pool.head[c];
+		if ( p ) {
 
-		p = new;
-		if ( !new ) goto cleanup;
+			pool.head[c] = p->next;
+			pool.stats.pooled -= pool_classsize( c );
+		}
+		pthread_mutex_unlock( &pool.mutex );
+	}
 
-		// Link objects together.
-		// Skip the first, because we will return that to the caller.
-		for (int i=1; i < OBJECT_COUNT-1; ++i) new[i].next = &new[i + 1];
+	if ( p ) {
 
-		// Terminate the linked list.
-		new[OBJECT_COUNT - 1].next = 0;
+		__sync_fetch_and_add( &pool.stats.hits, 1 );
+	}
+	else {
 
-		// First object is returned to the caller. Set the free list head
-		// to an object immediately following that one.
-		pool.head = &new[1];
+		p = (Pool_object *) malloc( pool_classsize( c ) );
+		if ( !p ) return 0;
+		__sync_fetch_and_add( &pool.stats.misses, 1 );
 	}
 
-cleanup:
-	pthread_mutex_unlock( &pool.mutex );
+	pool_account( pool_classsize( c ) );
 	return p;
 }
 
@@ -108,17 +255,58 @@ void pool_free( void *p, size_t size )
 {
 	if ( !p ) return;
 
-	if ( !size || size > CHUNK_SIZE ) {
+	const int c = size ? pool_class( size ) : -1;
+
+	if ( c < 0 ) {
 
 		free( p );
 		return;
 	}
 
+	__sync_fetch_and_sub( &pool.stats.in_use, pool_classsize( c ) );
+
 	Pool_object *obj =  (Pool_object *) p;
+	Pool_cache *cache = pool_cache();
+
+	if ( cache && c < POOL_CACHE_CLASSES && cache->count[c] < POOL_CACHE_DEPTH ) {
+
+		obj->next = cache->head[c];
+		cache->head[c] = obj;
+		cache->count[c]++;
+		return;
+	}
+
 	pthread_mutex_lock( &pool.mutex );
+	pool_put( c, obj );
+	pthread_mutex_unlock( &pool.mutex );
+}
 
-	obj->next = pool.head;
-	pool.head = obj;
+//--------------------------------------------------------------------------
 
+void pool_trim( size_t keep )
+{
+	pthread_mutex_lock( &pool.mutex );
+	for ( int c=POOL_CLASSES-1; c >= 0 && pool.stats.pooled > keep; --c ) {
+
+		while ( pool.head[c] && pool.stats.pooled > keep ) {
+
+			Pool_object *obj = pool.head[c];
+			pool.head[c] = obj->next;
+			pool.stats.pooled -= pool_classsize( c );
+			free( obj );
+			__sync_fetch_and_add( &pool.stats.released, 1 );
+		}
+	}
 	pthread_mutex_unlock( &pool.mutex );
 }
+
+//--------------------------------------------------------------------------
+
+void pool_getstats( POOL_STATS *s )
+{
+	if ( !s ) return;
+
+	// Each counter is consistent, the set is a snapshot.
+	__sync_synchronize();
+	*s = pool.stats;
+}
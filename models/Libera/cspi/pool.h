@@ -6,28 +6,64 @@
 #if !defined(_POOL_H)
 #define _POOL_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/** The number of memory blocks (objects) to allocate in advance.
- *  Memory will be allocated to accomodate OBJECT_COUNT requests
- *  with a single malloc call.
+/** The smallest block size (log2) in the memory pool.
+ *  Requests are rounded up to the next power of two size class.
+ */
+#define POOL_MIN_SHIFT	10	// 1 KB
+
+/** The number of size classes, from 1<<POOL_MIN_SHIFT up to
+ *  1<<(POOL_MIN_SHIFT+POOL_CLASSES-1) bytes. This is also the largest
+ *  block that can be allocated on the pool.
+ *  Requests of larger size are sent to standard malloc.
+ */
+#define POOL_CLASSES	12	// up to 2 MB: 64K DD samples, 32 bytes each
+
+/** The number of free blocks per size class that each thread keeps
+ *  in its own cache before returning them to the shared pool.
+ */
+#define POOL_CACHE_DEPTH	4
+
+/** The number of size classes, from the smallest, the thread caches
+ *  keep. Larger blocks are rare and go straight to the shared pool.
  */
-#define OBJECT_COUNT	4
+#define POOL_CACHE_CLASSES	7	// up to 64 KB
 
-/** The size of a block in the memory pool.
- *  This is also the largest block that can be allocated on the pool.
- *  Requests of 'wrong' size are sent to standard malloc.
+/** The bytes of free blocks the shared pool keeps, twice the largest
+ *  class: a pair of ping-pong buffers. Blocks freed beyond go back to
+ *  standard free, pool_trim releases the rest.
  */
-#define CHUNK_SIZE	( 10240 * 8 * 4 )	// 10K samples, 32 bytes each
+#define POOL_FREE_MAX	(2 << (POOL_MIN_SHIFT + POOL_CLASSES - 1))	// 4 MB
+
+/** Memory pool statistics, see pool_getstats. */
+typedef struct {
+	/** Requests served with a free block (thread cache or shared pool). */
+	unsigned long hits;
+	/** Requests that allocated a new block with malloc. */
+	unsigned long misses;
+	/** Requests larger than the largest size class. */
+	unsigned long oversize;
+	/** Bytes currently allocated to the callers. */
+	size_t in_use;
+	/** Highest value reached by in_use. */
+	size_t high_water;
+	/** Bytes of free blocks in the shared pool. */
+	size_t pooled;
+	/** Free blocks given back to standard free. */
+	unsigned long released;
+} POOL_STATS;
 
 //--------------------------------------------------------------------------
 // Public interface.
 
 /** Private.
- *  Allocates from a memory pool. Requests of size larger than CHUNK_SIZE
- *  are routed to standard malloc.
+ *  Allocates from a memory pool. Requests of size larger than the
+ *  largest size class are routed to standard malloc.
  *  Returns a pointer to allocated memory or 0 if request fails.
  *  @param size The Number of bytes to allocate.
  */
@@ -36,10 +72,23 @@ void* pool_malloc( size_t size );
 /** Private.
  *  Frees memory allocated with pool_malloc.
  *  @param p    A pointer to memory block allocated with pool_malloc.
- *  @param size The size of memory block in bytes.
+ *  @param size The size of memory block in bytes, as passed to pool_malloc.
  */
 void pool_free( void *p, size_t size );
 
+/** Private.
+ *  Gives the free blocks of the shared pool back to standard free,
+ *  largest first, until at most keep bytes are left.
+ *  @param keep The bytes of free blocks to keep.
+ */
+void pool_trim( size_t keep );
+
+/** Private.
+ *  Retrieves the memory pool statistics.
+ *  @param s Pointer to the POOL_STATS structure to fill in.
+ */
+void pool_getstats( POOL_STATS *s );
+
 #ifdef __cplusplus
 }
 #endif
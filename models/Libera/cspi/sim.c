@@ -0,0 +1,1018 @@
+//! \file sim.c
+//! Implements the simulated Libera I/O backend.
+
+/*
+CSPI - Control System Programming Interface
+Copyright (C) 2004-2008 Instrumentation Technologies
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA
+or visit http://www.gnu.org
+*/
+
+/*
+The simulated Libera serves the device files, the DSC and LPLL daemons
+and the event daemon from memory, so that CSPI and its clients run on
+any Linux box. The beam is a closed orbit with a betatron oscillation
+and noise, the data of a turn depends only on the turn number: reading
+the same machine time twice gives the same atoms.
+
+Rates are taken from the environment when the backend is first used:
+	CSPI_SIM_SA_HZ        SA atoms per second, 0 = as fast as read (10)
+	CSPI_SIM_TRIGGER_HZ   TRIGGET events per second, 0 = none (10)
+	CSPI_SIM_OVERFLOW     every Nth ADC read overflows, 0 = never (0)
+
+TAB = 4 spaces.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "cspi.h"
+#include "cspi_impl.h"
+#include "io.h"
+#include "dscd.h"
+#include "eventd.h"
+#include "msp.h"
+
+/** Private. First simulated file descriptor, far from the real ones. */
+#define SIM_FD_BASE		0x4000
+/** Private. Max simulated files open at the same time. */
+#define SIM_FD_MAX		64
+/** Private. Size of the CFG parameter table (coefficients included). */
+#define SIM_CFG_MAX		512
+/** Private. Size of the FA application memory. */
+#define SIM_FA_SIZE		4096
+/** Private. Max event listeners. */
+#define SIM_LISTENER_MAX	8
+
+/** Private. Revolution frequency (Hz) and harmonic number. */
+#define SIM_FREV		3072200.0
+#define SIM_HARMONIC	120
+/** Private. Machine time (ADC clock) ticks per turn. */
+#define SIM_MT_PER_TURN	38
+/** Private. DD decimation of the decimated DD data. */
+#define SIM_DEC			64
+
+/** Private. Beam: closed orbit, betatron amplitude and noise (nm). */
+#define SIM_X0			150000.0
+#define SIM_Y0			-80000.0
+#define SIM_BETA_AMP	40000.0
+#define SIM_NOISE		2000.0
+#define SIM_TUNE_X		0.1180
+#define SIM_TUNE_Y		0.1620
+/** Private. Amplitude of a DD button signal and of an ADC channel. */
+#define SIM_DD_AMP		8.0e6
+#define SIM_ADC_AMP		12000.0
+/** Private. ADC intermediate frequency over the sampling frequency. */
+#define SIM_ADC_IF		(31.0/38.0)
+
+/** Private. Simulated devices. */
+typedef enum {
+	SIM_NONE = 0,
+	SIM_CFG,
+	SIM_DD,
+	SIM_SA,
+	SIM_PM,
+	SIM_ADC,
+	SIM_FA,
+	SIM_EVENT,
+	SIM_TEMP,
+	SIM_FAN,
+	SIM_MSP,
+}
+SIM_DEVICE;
+
+/** Private. An open simulated file. */
+typedef struct {
+	int device;					//!< SIM_DEVICE, SIM_NONE if free.
+	int flags;					//!< open/fcntl flags.
+	long long pos;				//!< DD/PM turn, SA atom or FA offset.
+	CSPI_TIMESTAMP ts;			//!< DD/PM timestamp of the last read.
+}
+Sim_file;
+
+/** Private. An event daemon listener. */
+typedef struct {
+	pid_t pid;
+	int uid;
+	size_t mask;
+}
+Sim_listener;
+
+/** Private. Simulated Libera state. */
+static struct {
+	pthread_mutex_t mutex;
+	pthread_once_t once;
+
+	double sa_hz;
+	double trigger_hz;
+	unsigned int overflow;
+
+	struct timespec t0;			//!< Monotonic time of turn 0.
+	struct timespec st0;		//!< System time of turn 0.
+
+	Sim_file file[SIM_FD_MAX];
+	int cfg[SIM_CFG_MAX];
+	unsigned int dec;
+	int dsc[DSCD_LAST];
+	unsigned char fa[SIM_FA_SIZE];
+	unsigned long adc_reads;
+	int overflow_pending;
+
+	Sim_listener listener[SIM_LISTENER_MAX];
+	pthread_t thread;
+	int running;
+	int stop;
+}
+sim = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_ONCE_INIT,
+};
+
+//--------------------------------------------------------------------------
+
+/** Private. Returns the environment variable name as a number or def. */
+static double sim_getenv( const char *name, double def )
+{
+	const char *value = getenv( name );
+	return value ? atof( value ) : def;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Initializes the simulated Libera, once. */
+static void sim_init()
+{
+	sim.sa_hz = sim_getenv( "CSPI_SIM_SA_HZ", 10 );
+	sim.trigger_hz = sim_getenv( "CSPI_SIM_TRIGGER_HZ", 10 );
+	sim.overflow = (unsigned int)sim_getenv( "CSPI_SIM_OVERFLOW", 0 );
+
+	clock_gettime( CLOCK_MONOTONIC, &sim.t0 );
+	clock_gettime( CLOCK_REALTIME, &sim.st0 );
+
+	sim.cfg[LIBERA_CFG_FEATURE_ITECH] = LIBERA_TYPE_BRILLIANCE << 24;
+	sim.cfg[LIBERA_CFG_MCPLL] = 1;
+	sim.cfg[LIBERA_CFG_SCPLL] = 1;
+	sim.cfg[LIBERA_CFG_KX] = 10000000;
+	sim.cfg[LIBERA_CFG_KY] = 10000000;
+	sim.cfg[LIBERA_CFG_DEC_DDC] = SIM_DEC;
+	sim.cfg[LIBERA_CFG_MAX_ADC] = (int)SIM_ADC_AMP;
+	sim.cfg[LIBERA_CFG_AVERAGE_SUM] = (int)SIM_DD_AMP;
+	sim.cfg[LIBERA_CFG_SP_THRESHOLD] = 1000;
+	sim.cfg[LIBERA_CFG_SP_N_BEFORE] = 1;
+	sim.cfg[LIBERA_CFG_SP_N_AFTER] = 2;
+	sim.cfg[LIBERA_CFG_ILK_OVERFLOW_LIMIT] = 32000 << 16;
+	sim.cfg[LIBERA_CFG_ILK_GAIN_LIMIT] = -40 << 16;
+	sim.dec = 1;
+
+	sim.dsc[DSCD_GET_AGC] = CSPI_AGC_MANUAL;
+	sim.dsc[DSCD_GET_DSC] = CSPI_DSC_OFF;
+	sim.dsc[DSCD_GET_GAIN] = -40;
+	sim.dsc[DSCD_GET_SWITCH] = CSPI_SWITCH_AUTO;
+
+	CSPI_LOG( "simulated Libera, SA %g Hz, trigger %g Hz",
+	          sim.sa_hz, sim.trigger_hz );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Returns the seconds elapsed since turn 0. */
+static double sim_elapsed()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return (now.tv_sec - sim.t0.tv_sec) + 1e-9 * (now.tv_nsec - sim.t0.tv_nsec);
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Returns the last turn of the beam. */
+static long long sim_turn()
+{
+	return (long long)( sim_elapsed() * SIM_FREV );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Returns the turn of the last trigger. */
+static long long sim_trigger_turn()
+{
+	if ( sim.trigger_hz <= 0 ) return 0;
+
+	const double t = floor( sim_elapsed() * sim.trigger_hz ) / sim.trigger_hz;
+	return (long long)( t * SIM_FREV );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Fills in the timestamp of turn. */
+static void sim_timestamp( long long turn, CSPI_TIMESTAMP *ts )
+{
+	const double t = turn / SIM_FREV;
+	long long ns = sim.st0.tv_nsec + (long long)( (t - floor(t)) * 1e9 );
+
+	ts->st.tv_sec = sim.st0.tv_sec + (time_t)floor(t) + ns / 1000000000;
+	ts->st.tv_nsec = ns % 1000000000;
+	ts->mt = (libera_hw_time_t)turn * SIM_MT_PER_TURN;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Returns a pseudo random number in [-1,1) depending on n only. */
+static double sim_noise( unsigned long long n )
+{
+	// splitmix64
+	n += 0x9e3779b97f4a7c15ULL;
+	n = (n ^ (n >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	n = (n ^ (n >> 27)) * 0x94d049bb133111ebULL;
+	n ^= n >> 31;
+
+	return (double)(n >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Returns the button amplitudes (relative to 1) for the beam position
+ *  of turn, betatron is the fraction of the oscillation to include.
+ */
+static void sim_buttons( long long turn, double betatron, double v[4] )
+{
+	const double x = SIM_X0 +
+		betatron * SIM_BETA_AMP * sin( 2 * M_PI * SIM_TUNE_X * turn ) +
+		SIM_NOISE * sim_noise( 2*turn );
+	const double y = SIM_Y0 +
+		betatron * SIM_BETA_AMP * cos( 2 * M_PI * SIM_TUNE_Y * turn ) +
+		SIM_NOISE * sim_noise( 2*turn + 1 );
+
+	// Inverse of the delta over sum, see ebpp_dd_position.
+	const double u = x / (sim.cfg[LIBERA_CFG_KX] ? sim.cfg[LIBERA_CFG_KX] : 1);
+	const double w = y / (sim.cfg[LIBERA_CFG_KY] ? sim.cfg[LIBERA_CFG_KY] : 1);
+
+	v[0] = 1 + u + w;
+	v[1] = 1 - u + w;
+	v[2] = 1 - u - w;
+	v[3] = 1 + u - w;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Generates count raw DD atoms from turn, step turns apart. */
+static void sim_dd( long long turn, long long step, CSPI_DD_RAWATOM *p, size_t count )
+{
+	size_t i;
+	int ch;
+
+	for ( i=0; i<count; i++, turn += step ) {
+
+		double v[4];
+		sim_buttons( turn, step > 1 ? 0.1 : 1.0, v );
+
+		int *iq = (int *)(p + i);
+		const double phase = 0.01 * turn;
+		for ( ch=0; ch<4; ch++ ) {
+
+			// Raw I/Q are twice the amplitude, see ebpp_transform_dd_single.
+			const double a = 2 * SIM_DD_AMP * v[ch];
+			iq[2*ch]   = (int)( a * cos( phase ) );
+			iq[2*ch+1] = (int)( a * sin( phase ) );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Generates count SA atoms from atom n. */
+static void sim_sa( long long n, CSPI_SA_ATOM *p, size_t count )
+{
+	size_t i;
+
+	memset( p, 0, count * sizeof(CSPI_SA_ATOM) );
+	for ( i=0; i<count; i++, n++ ) {
+
+		// Averaged over many turns, the oscillation is gone.
+		const long long turn = sim.sa_hz > 0 ? (long long)( n * SIM_FREV / sim.sa_hz ) : n;
+		double v[4];
+		sim_buttons( turn, 0, v );
+
+		const double S = v[0] + v[1] + v[2] + v[3];
+		p[i].Va = (int)( SIM_DD_AMP * v[0] );
+		p[i].Vb = (int)( SIM_DD_AMP * v[1] );
+		p[i].Vc = (int)( SIM_DD_AMP * v[2] );
+		p[i].Vd = (int)( SIM_DD_AMP * v[3] );
+		p[i].Sum = p[i].Va + p[i].Vb + p[i].Vc + p[i].Vd;
+		p[i].X = (int)( sim.cfg[LIBERA_CFG_KX] * (v[0] + v[3] - v[1] - v[2]) / S ) -
+		         sim.cfg[LIBERA_CFG_XOFFSET];
+		p[i].Y = (int)( sim.cfg[LIBERA_CFG_KY] * (v[0] + v[1] - v[2] - v[3]) / S ) -
+		         sim.cfg[LIBERA_CFG_YOFFSET];
+		p[i].Q = (int)( sim.cfg[LIBERA_CFG_KX] * (v[0] + v[2] - v[1] - v[3]) / S ) -
+		         sim.cfg[LIBERA_CFG_QOFFSET];
+	}
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Generates an ADC burst of count samples, clipped to the ADC range.
+ *  Returns nonzero if the burst overflows.
+ */
+static int sim_adc( long long turn, CSPI_ADC_ATOM *p, size_t count, int overflow )
+{
+	const double gain = overflow ? 4.0 : 1.0;
+	double v[4];
+	size_t i;
+	int ch;
+
+	sim_buttons( turn, 1.0, v );
+	for ( i=0; i<count; i++ ) {
+
+		const double s = sin( 2 * M_PI * SIM_ADC_IF * i );
+		short *q = (short *)(p + i);
+
+		// CSPI_ADC_ATOM is chD, chC, chB, chA.
+		for ( ch=0; ch<4; ch++ ) {
+
+			double a = gain * SIM_ADC_AMP * v[3-ch] * s +
+			           20 * sim_noise( 4*(turn + i) + ch );
+			if ( a > 32767 ) a = 32767;
+			if ( a < -32768 ) a = -32768;
+			q[ch] = (short)a;
+		}
+	}
+	return overflow;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Returns the open simulated file fd, or 0 with errno set. */
+static Sim_file *sim_file( int fd )
+{
+	const int i = fd - SIM_FD_BASE;
+
+	if ( i < 0 || i >= SIM_FD_MAX || SIM_NONE == sim.file[i].device ) {
+		errno = EBADF;
+		return 0;
+	}
+	return sim.file + i;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Returns the simulated device of pathname. */
+static int sim_device( const char *pathname )
+{
+	static const struct {
+		const char *name;
+		int device;
+	}
+	devices[] = {
+		{ "/dev/libera.cfg", SIM_CFG },
+		{ "/dev/libera.dd", SIM_DD },
+		{ "/dev/libera.sa", SIM_SA },
+		{ "/dev/libera.pm", SIM_PM },
+		{ "/dev/libera.adc", SIM_ADC },
+		{ "/dev/libera.fa", SIM_FA },
+		{ LIBERA_EVENT_FIFO_PATHNAME, SIM_EVENT },
+		{ "/dev/msp0", SIM_MSP },
+	};
+	size_t i;
+
+	for ( i=0; i<sizeof(devices)/sizeof(devices[0]); i++ )
+		if ( 0 == strcmp( pathname, devices[i].name ) ) return devices[i].device;
+
+	// health sysfs attributes
+	if ( strstr( pathname, "temp1_input" ) ) return SIM_TEMP;
+	if ( strstr( pathname, "fan1_input" ) ) return SIM_FAN;
+
+	return SIM_NONE;
+}
+
+//--------------------------------------------------------------------------
+
+static int sim_open( const char *pathname, int flags )
+{
+	pthread_once( &sim.once, sim_init );
+
+	const int device = sim_device( pathname );
+	if ( SIM_NONE == device ) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	int i, fd = -1;
+	for ( i=0; i<SIM_FD_MAX; i++ ) {
+
+		Sim_file *f = sim.file + i;
+		if ( SIM_NONE == f->device ) {
+
+			memset( f, 0, sizeof(Sim_file) );
+			f->device = device;
+			f->flags = flags;
+			// SA starts with the next atom.
+			if ( SIM_SA == device && sim.sa_hz > 0 )
+				f->pos = (long long)ceil( sim_elapsed() * sim.sa_hz );
+			fd = SIM_FD_BASE + i;
+			break;
+		}
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+
+	if ( -1 == fd ) errno = EMFILE;
+	return fd;
+}
+
+//--------------------------------------------------------------------------
+
+static int sim_close( int fd )
+{
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f ) f->device = SIM_NONE;
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return f ? 0 : -1;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  Reads SA atoms: as many as due at sim.sa_hz, waiting for the next
+ *  one unless O_NONBLOCK. The lock is released while waiting, then f
+ *  is looked up again by fd as it may have been closed meanwhile.
+ */
+static ssize_t sim_read_sa( int fd, Sim_file *f, void *buf, size_t count )
+{
+	size_t n = count / sizeof(CSPI_SA_ATOM);
+	if ( !n ) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ( sim.sa_hz > 0 ) {
+
+		double due = sim_elapsed() * sim.sa_hz - f->pos;
+		if ( due < 1 ) {
+
+			if ( f->flags & O_NONBLOCK ) {
+				errno = EAGAIN;
+				return -1;
+			}
+			// Sleep outside the lock until the next atom.
+			const double wait = (1 - due) / sim.sa_hz;
+			struct timespec ts = { (time_t)wait, (long)( (wait - floor(wait)) * 1e9 ) };
+
+			VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+			nanosleep( &ts, 0 );
+			VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+			// closed, or closed and reopened, while sleeping?
+			f = sim_file( fd );
+			if ( !f || SIM_SA != f->device ) {
+				errno = EBADF;
+				return -1;
+			}
+			due = 1;
+		}
+		if ( n > (size_t)due ) n = (size_t)due;
+	}
+
+	sim_sa( f->pos, (CSPI_SA_ATOM *)buf, n );
+	f->pos += n;
+
+	return n * sizeof(CSPI_SA_ATOM);
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Reads the health attributes as the sysfs and MSP drivers do. */
+static ssize_t sim_read_health( Sim_file *f, void *buf, size_t count )
+{
+	char value[16];
+	int n;
+
+	switch ( f->device ) {
+
+		case SIM_TEMP:
+			n = snprintf( value, sizeof(value), "%d\n",
+			              42000 + (int)( 500 * sim_noise( sim_turn() ) ) );
+			break;
+
+		case SIM_FAN:
+			n = snprintf( value, sizeof(value), "%d\n", 4800 );
+			break;
+
+		default: {
+			static const int voltage[8] = { 1500, 1800, 2500, 3300, 5000, 12000, -12000, 3300 };
+			msp_atom_t msp;
+
+			if ( count < sizeof(msp) ) {
+				errno = EINVAL;
+				return -1;
+			}
+			memcpy( msp.voltage, voltage, sizeof(voltage) );
+			memcpy( buf, &msp, sizeof(msp) );
+			return sizeof(msp);
+		}
+	}
+	if ( (size_t)n > count ) n = count;
+	memcpy( buf, value, n );
+
+	return n;
+}
+
+//--------------------------------------------------------------------------
+
+static ssize_t sim_read( int fd, void *buf, size_t count )
+{
+	ssize_t rc = -1;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f ) switch ( f->device ) {
+
+		case SIM_DD:
+		case SIM_PM: {
+			const size_t n = count / sizeof(CSPI_DD_RAWATOM);
+			const long long step = sim.dec > 1 ? SIM_DEC : 1;
+
+			sim_dd( f->pos, step, (CSPI_DD_RAWATOM *)buf, n );
+			sim_timestamp( f->pos, &f->ts );
+			f->pos += n * step;
+			rc = n * sizeof(CSPI_DD_RAWATOM);
+			break;
+		}
+		case SIM_SA:
+			rc = sim_read_sa( fd, f, buf, count );
+			break;
+
+		case SIM_ADC: {
+			const size_t n = count / sizeof(CSPI_ADC_ATOM);
+			const int overflow = sim.overflow && 0 == (++sim.adc_reads % sim.overflow);
+
+			if ( sim_adc( sim_turn(), (CSPI_ADC_ATOM *)buf, n, overflow ) )
+				sim.overflow_pending = 1;
+			rc = n * sizeof(CSPI_ADC_ATOM);
+			break;
+		}
+		case SIM_FA:
+			if ( f->pos + count > SIM_FA_SIZE ) {
+				errno = EINVAL;
+				break;
+			}
+			memcpy( buf, sim.fa + f->pos, count );
+			f->pos += count;
+			rc = count;
+			break;
+
+		case SIM_TEMP:
+		case SIM_FAN:
+		case SIM_MSP:
+			rc = sim_read_health( f, buf, count );
+			break;
+
+		default:
+			errno = EINVAL;
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+static ssize_t sim_pread( int fd, void *buf, size_t count, off_t offset )
+{
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f ) f->pos = offset;
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return f ? sim_read( fd, buf, count ) : -1;
+}
+
+//--------------------------------------------------------------------------
+
+static ssize_t sim_write( int fd, const void *buf, size_t count )
+{
+	ssize_t rc = -1;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f ) {
+
+		if ( SIM_FA != f->device || f->pos + count > SIM_FA_SIZE ) {
+			errno = EINVAL;
+		}
+		else {
+			memcpy( sim.fa + f->pos, buf, count );
+			f->pos += count;
+			rc = count;
+		}
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+static off_t sim_lseek( int fd, off_t offset, int whence )
+{
+	off_t rc = -1;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f ) switch ( f->device ) {
+
+		case SIM_DD:
+		case SIM_PM:
+			// As the offset of cspi_seek, 0 MT or ST is the latest data.
+			if ( CSPI_SEEK_TR == whence )
+				f->pos = sim_trigger_turn() + offset;
+			else if ( CSPI_SEEK_MT == whence && offset )
+				f->pos = offset / SIM_MT_PER_TURN;
+			else
+				f->pos = sim_turn();
+			if ( f->pos < 0 ) f->pos = 0;
+			rc = 0;
+			break;
+
+		case SIM_FA:
+			if ( SEEK_SET == whence && offset >= 0 && offset <= SIM_FA_SIZE ) {
+				f->pos = offset;
+				rc = offset;
+			}
+			else {
+				errno = EINVAL;
+			}
+			break;
+
+		default:
+			errno = ESPIPE;
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+static int sim_ioctl( int fd, unsigned long request, void *arg )
+{
+	int rc = -1;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f && !arg ) {
+		errno = EFAULT;
+	}
+	else if ( f ) switch ( (unsigned int)request ) {
+
+		// As in the kernel, a request passed as a (negative) int
+		// matches on its low 32 bits.
+		case LIBERA_IOC_GET_MAGIC:
+			*(int *)arg = LIBERA_MAGIC;
+			rc = 0;
+			break;
+
+		case LIBERA_IOC_GET_CFG:
+		case LIBERA_IOC_SET_CFG: {
+			libera_cfg_request_t *req = (libera_cfg_request_t *)arg;
+
+			if ( SIM_CFG != f->device || req->idx >= SIM_CFG_MAX ) {
+				errno = EINVAL;
+			}
+			else if ( LIBERA_IOC_GET_CFG == request ) {
+				req->val = sim.cfg[req->idx];
+				rc = 0;
+			}
+			else if ( O_RDWR != (f->flags & O_ACCMODE) ) {
+				errno = EPERM;
+			}
+			else {
+				sim.cfg[req->idx] = req->val;
+				rc = 0;
+			}
+			break;
+		}
+		case LIBERA_IOC_GET_DEC:
+			*(libera_U32_t *)arg = sim.dec;
+			rc = 0;
+			break;
+
+		case LIBERA_IOC_SET_DEC:
+			sim.dec = *(libera_U32_t *)arg;
+			rc = 0;
+			break;
+
+		case LIBERA_IOC_GET_DD_TSTAMP:
+		case LIBERA_IOC_GET_PM_TSTAMP:
+			memcpy( arg, &f->ts, sizeof(CSPI_TIMESTAMP) );
+			rc = 0;
+			break;
+
+		case LIBERA_EVENT_SET_MT:
+		case LIBERA_EVENT_SET_ST:
+			// Accepted, the simulated clocks are not adjustable.
+			rc = SIM_EVENT == f->device ? 0 : -1;
+			if ( rc ) errno = EINVAL;
+			break;
+
+		default:
+			errno = ENOTTY;
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+static int sim_fcntl( int fd, int cmd, long arg )
+{
+	int rc = -1;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f ) switch ( cmd ) {
+
+		case F_GETFL:
+			rc = f->flags;
+			break;
+
+		case F_SETFL:
+			f->flags = (f->flags & O_ACCMODE) | (arg & ~O_ACCMODE);
+			rc = 0;
+			break;
+
+		default:
+			errno = EINVAL;
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private.
+ *  SA is readable once the next atom is due, the other devices always.
+ *  Sleeps outside the lock, up to the timeout.
+ */
+static int sim_poll( int fd, int timeout )
+{
+	int rc = -1;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	Sim_file *f = sim_file( fd );
+	if ( f ) {
+
+		rc = 1;
+		if ( SIM_SA == f->device && sim.sa_hz > 0 ) {
+
+			const double due = sim_elapsed() * sim.sa_hz - f->pos;
+			if ( due < 1 ) {
+
+				double wait = (1 - due) / sim.sa_hz;
+				if ( timeout >= 0 && wait > timeout * 1e-3 ) {
+					wait = timeout * 1e-3;
+					rc = 0;
+				}
+				struct timespec ts = { (time_t)wait, (long)( (wait - floor(wait)) * 1e9 ) };
+
+				VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+				nanosleep( &ts, 0 );
+				VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+				// closed while sleeping?
+				if ( !sim_file( fd ) ) rc = -1;
+			}
+		}
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. DSC daemon: keeps the values set, FREV from SIM_FREV. */
+static int sim_dsc_message( size_t msg_type, size_t size, void *msg_val )
+{
+	pthread_once( &sim.once, sim_init );
+
+	if ( msg_type <= DSCD_FIRST || msg_type >= DSCD_LAST ) return CSPI_E_DSCPROTO;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	switch ( msg_type ) {
+
+		case DSCD_SET_AGC:
+		case DSCD_SET_DSC:
+		case DSCD_SET_GAIN:
+		case DSCD_SET_SWITCH:
+			// Each GET follows its SET.
+			if ( msg_val ) sim.dsc[msg_type + 1] = *(int *)msg_val;
+			break;
+
+		case DSCD_GET_FREV:
+			if ( msg_val ) *(double *)msg_val = SIM_FREV;
+			break;
+
+		case DSCD_APPLY_SETTINGS:
+			break;
+
+		default:
+			if ( msg_val ) *(int *)msg_val = sim.dsc[msg_type];
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return CSPI_OK;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. LPLL daemon: commands are accepted, both PLLs are locked. */
+static int sim_pll_message( const char *cmd, void *status )
+{
+	pll_status_t *p = (pll_status_t *)status;
+
+	if ( p ) {
+
+		memset( p, 0, sizeof(pll_status_t) );
+		p->report_stseqn = (unsigned long)sim_turn();
+		p->mt_stat.frequency = (unsigned long)( 10.0 * SIM_FREV * SIM_HARMONIC );
+		p->mt_stat.harmonic = SIM_HARMONIC;
+		p->mt_stat.locked_status = 1;
+		p->mt_stat.unlock_threshold = 100;
+		p->st_stat.locked_status = 1;
+		p->st_stat.unlock_threshold = 100;
+	}
+	return CSPI_OK;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Writes an event to the FIFO of the listener process. */
+static void sim_send_event( pid_t pid, int id, int param )
+{
+	char fifo_name[32];
+	const CSPI_EVENTHDR event = { id, param };
+
+	sprintf( fifo_name, EVENT_FIFO_PID_NAME, pid );
+
+	// Not open while the reader is not there (ENXIO).
+	int fd = open( fifo_name, O_WRONLY | O_NONBLOCK );
+	if ( -1 == fd ) return;
+
+	if ( sizeof(event) != write( fd, &event, sizeof(event) ) )
+		CSPI_ERR( "event %d to %d lost, errno: %d", id, pid, errno );
+	close( fd );
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Event daemon thread, TRIGGET at sim.trigger_hz and OVERFLOW. */
+static void *sim_event_thread( void *arg )
+{
+	// A write to a FIFO just closed by the reader must fail, not kill.
+	sigset_t set;
+	sigemptyset( &set );
+	sigaddset( &set, SIGPIPE );
+	pthread_sigmask( SIG_BLOCK, &set, 0 );
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+	while ( !sim.stop ) {
+
+		// Sleep until the next trigger (or 100 ms without triggers).
+		const double period = sim.trigger_hz > 0 ? 1 / sim.trigger_hz : 0.1;
+		const double t = sim_elapsed();
+		const double wait = period * (floor( t / period ) + 1) - t;
+		struct timespec ts = { (time_t)wait, (long)( (wait - floor(wait)) * 1e9 ) };
+
+		VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+		nanosleep( &ts, 0 );
+		VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+		const int overflow = sim.overflow_pending;
+		sim.overflow_pending = 0;
+
+		size_t i;
+		for ( i=0; i<SIM_LISTENER_MAX; i++ ) {
+
+			const Sim_listener *l = sim.listener + i;
+			if ( !l->mask ) continue;
+
+			if ( sim.trigger_hz > 0 && (l->mask & CSPI_EVENT_TRIGGET) )
+				sim_send_event( l->pid, CSPI_EVENT_TRIGGET, 0 );
+			if ( overflow && (l->mask & CSPI_EVENT_OVERFLOW) )
+				sim_send_event( l->pid, CSPI_EVENT_OVERFLOW, CSPI_OVERFLOW_DD_FPGA );
+		}
+	}
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+
+	return 0;
+}
+
+//--------------------------------------------------------------------------
+
+/** Private. Event daemon: (un)registers a listener. */
+static int sim_event_request( pid_t pid, int uid, size_t mask )
+{
+	pthread_once( &sim.once, sim_init );
+
+	int rc = CSPI_OK;
+	size_t i, any = 0;
+	Sim_listener *free_slot = 0, *slot = 0;
+
+	VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+
+	for ( i=0; i<SIM_LISTENER_MAX; i++ ) {
+
+		Sim_listener *l = sim.listener + i;
+		if ( l->mask && l->pid == pid && l->uid == uid ) slot = l;
+		if ( !l->mask && !free_slot ) free_slot = l;
+	}
+	if ( !slot ) slot = free_slot;
+
+	if ( slot ) {
+		slot->pid = pid;
+		slot->uid = uid;
+		slot->mask = mask;
+	}
+	else if ( mask ) {
+		rc = -1;
+	}
+
+	for ( i=0; i<SIM_LISTENER_MAX; i++ ) any |= sim.listener[i].mask;
+
+	if ( any && !sim.running ) {
+
+		sim.stop = 0;
+		if ( 0 == pthread_create( &sim.thread, 0, sim_event_thread, 0 ) )
+			sim.running = 1;
+		else
+			rc = -1;
+	}
+	else if ( !any && sim.running ) {
+
+		sim.stop = 1;
+		VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+		VERIFY( 0 == pthread_join( sim.thread, 0 ) );
+		VERIFY( 0 == pthread_mutex_lock( &sim.mutex ) );
+		sim.running = 0;
+	}
+
+	VERIFY( 0 == pthread_mutex_unlock( &sim.mutex ) );
+	return rc;
+}
+
+//--------------------------------------------------------------------------
+
+const IO_backend io_sim = {
+	"sim",
+	sim_open,
+	sim_close,
+	sim_read,
+	sim_pread,
+	sim_write,
+	sim_lseek,
+	sim_ioctl,
+	sim_fcntl,
+	sim_poll,
+	sim_dsc_message,
+	sim_pll_message,
+	sim_event_request,
+};
@@ -20,6 +20,11 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
 
 #include <chaos/ui_toolkit/ChaosUIToolkit.h>
 #include <chaos/ui_toolkit/LowLevelApi/LLRpcApi.h>
@@ -49,11 +54,113 @@ void print_data(T data,int ts_enable,int samples,uint64_t tstamp,std::ofstream &
                fout<<tstamp<<",";
                LDBG_<<tstamp<<",";
             }
-            fout<<data[cnt]<<flush;
+            fout<<data[cnt];
             LDBG_<<data[cnt];
     }
 
 }
+// with --packed the attribute key holds a libera_pack buffer: unpack it into buf, count gets the atoms
+template <typename T>
+T* unpack_data(CDataWrapper* wrapped_data,const char* key,T* data,std::vector<char>& buf,int& count){
+    uint32_t size=0;
+    libera_pack_header_t h;
+    // the header is trusted only within the received bytes
+    if((wrapped_data->getBinaryValue(key,size)==NULL) || (size<sizeof(h))){
+        throw CException(2, "Error decoding", "packed data");
+    }
+    memcpy(&h,data,sizeof(h));
+    if(libera_pack_header(data,size)==NULL || (h.atom_size!=sizeof(T))){
+        throw CException(2, "Error decoding", "packed data");
+    }
+    buf.resize((h.count+1)*sizeof(T));
+    if((count=libera_unpack(data,size,&buf[0],buf.size()))<0){
+        throw CException(2, "Error decoding", "packed data");
+    }
+    return (T*)&buf[0];
+}
+
+// binary recording (LIBERA_REC_xx), buffered in user space and written in large chunks
+class libera_recorder {
+    int fd;
+    std::vector<char> buf;
+    size_t used;
+    uint64_t blocks;
+
+    void write_all(const char* p,size_t size){
+        while(size){
+            ssize_t ret=::write(fd,p,size);
+            if(ret<0){
+                if(errno==EINTR)
+                    continue;
+                throw CException(errno, "Error writing", "recording");
+            }
+            p+=ret;
+            size-=ret;
+        }
+    }
+    void flush(){
+        write_all(&buf[0],used);
+        used=0;
+    }
+    void put(const void* p,size_t size){
+        if(used+size>buf.size()){
+            flush();
+        }
+        if(size>=buf.size()){
+            write_all((const char*)p,size);
+        } else {
+            memcpy(&buf[used],p,size);
+            used+=size;
+        }
+    }
+public:
+    libera_recorder():fd(-1),used(0),blocks(0){}
+    ~libera_recorder(){
+        if(fd>=0)
+            ::close(fd);
+    }
+    bool is_open() const {return fd>=0;}
+    uint64_t recorded() const {return blocks;}
+    void open(const std::string& name,int atom_type,size_t atom_size,int samples,uint32_t flags,size_t buffer_size){
+        libera_rec_header_t h;
+        if((fd=::open(name.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644))<0){
+            throw CException(errno, "Cannot open", name);
+        }
+        buf.resize(buffer_size);
+        memset(&h,0,sizeof(h));
+        h.magic=LIBERA_REC_MAGIC;
+        h.version=LIBERA_REC_VERSION;
+        h.atom_type=atom_type;
+        h.atom_size=atom_size;
+        h.samples=samples;
+        h.flags=flags;
+        put(&h,sizeof(h));
+    }
+    void add(libera_rec_block_t blk,const void* atoms,int count,size_t atom_size){
+        blk.count=count;
+        put(&blk,sizeof(blk));
+        put(atoms,count*atom_size);
+        blocks++;
+    }
+    void close(){
+        if(fd<0)
+            return;
+        flush();
+        ::close(fd);
+        fd=-1;
+    }
+};
+
+// an acquisition of count atoms: recorded if a recording is open, dumped as csv otherwise
+template <typename T>
+void dump_data(T* data,int ts_enable,int count,uint64_t tstamp,std::ofstream &fout,libera_recorder& rec,const libera_rec_block_t& blk){
+    if(rec.is_open()){
+        rec.add(blk,data,count,sizeof(T));
+    } else {
+        print_data(data,ts_enable,count,tstamp,fout);
+    }
+}
+
 void print_state(CUStateKey::ControlUnitState state) {
   switch (state) {
     case CUStateKey::INIT:
@@ -75,11 +182,11 @@ void print_state(CUStateKey::ControlUnitState state) {
 int main (int argc, char* argv[] ) {
   int err = 0;
   int mode=0,offset=0,sched=0;
-  bool triggered=false,decimated=false,timestamp=false;
-  int samples=1,loops=1,max_acquire_time;
+  bool triggered=false,decimated=false,timestamp=false,soa=false,sa=false,packed=false,binary=false;
+  int samples=1,loops=1,max_acquire_time,sp_separation,sw_decimation,sw_filter,binary_buffer;
   std::string attribute_value_tmp_str;
   std::string ofile;
-  std::ofstream ofs_out;
+  std::ofstream ofs_out,ofs_sa;
   CUStateKey::ControlUnitState device_state;
   std::string device_name;
   uint64_t old_acquisition=0;
@@ -88,11 +195,19 @@ int main (int argc, char* argv[] ) {
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("acquire", po::value<int>(&mode)->default_value(0), "acquire [0=OFF,1=DD,2=SA,3=ADC_SP,4=ADC_CW]");
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("triggered", po::value<bool>(&triggered)->default_value(false), "trigger on/off");
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("samples", po::value<int>(&samples)->default_value(1), "acquires samples");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("sp_separation", po::value<int>(&sp_separation)->default_value(0), "in ADC_SP min ADC samples between two shots, one line per shot (0 first shot only)");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("sw_decimation", po::value<int>(&sw_decimation)->default_value(1), "in DD software decimation factor, samples are the decimated atoms");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("sw_filter", po::value<int>(&sw_filter)->default_value(LIBERA_DEC_BOXCAR), "in DD software decimation filter [1=boxcar,2=CIC,3=FIR]");
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("offset", po::value<int>(&offset)->default_value(0), "in DD ofset of acquisition");
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("ofile", po::value<std::string>(&ofile)->default_value("libera.out"), "output on file");
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("loops", po::value<int>(&loops)->default_value(1), "acquires loops <0 for continuous acquisition, SA is continuos");
 
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("decimated", po::value<bool>(&decimated)->default_value(false), "decimated data on/off");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("soa", po::value<bool>(&soa)->default_value(false), "DD column major (one array per quantity) on/off");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("packed", po::value<bool>(&packed)->default_value(false), "waveforms published packed (delta, zigzag, bit packing) and unpacked here on/off");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("sa", po::value<bool>(&sa)->default_value(false), "stream SA along with DD, dumped on <ofile>.sa");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("binary", po::value<bool>(&binary)->default_value(false), "record <ofile> in binary (libera_rec_header_t, then a libera_rec_block_t and the atoms per acquisition), see daqLiberaRecToCsv");
+    ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("binary_buffer", po::value<int>(&binary_buffer)->default_value(8), "binary recording write buffer [MB]");
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("timestamp", po::value<bool>(&timestamp)->default_value(false), "dump timestamp");
     ChaosUIToolkit::getInstance()->getGlobalConfigurationInstance()->addOption("max_acquire_time", po::value<int>(&max_acquire_time)->default_value(0), "max acquire time in seconds 0=continuos ");
 
@@ -175,6 +290,12 @@ int main (int argc, char* argv[] ) {
 
        case 1:
            mode_dev|=LIBERA_IOP_MODE_DD;
+           if(soa){
+               mode_dev|=LIBERA_IOP_MODE_SOA;
+           }
+           if(sa){
+               mode_dev|=LIBERA_IOP_MODE_SA;
+           }
             break;
         case 2:
            mode_dev|=LIBERA_IOP_MODE_SA;
@@ -188,11 +309,21 @@ int main (int argc, char* argv[] ) {
             break;
 
 
+    }
+    if(packed && mode_dev){
+        mode_dev|=LIBERA_IOP_MODE_PACKED;
     }
     param_mode.addInt32Value("mode",mode_dev);
     if(mode_dev && (samples>=0)){
         param_mode.addInt32Value("samples",samples);
     }
+    if(mode_dev&LIBERA_IOP_MODE_SINGLEPASS){
+        param_mode.addInt32Value("sp_separation",sp_separation);
+    }
+    if(mode_dev&LIBERA_IOP_MODE_DD){
+        param_mode.addInt32Value("sw_decimation",sw_decimation);
+        param_mode.addInt32Value("sw_filter",sw_filter);
+    }
     param_mode.addInt32Value("duration",max_acquire_time);
     param_mode.addInt32Value("loops",loops);
 
@@ -224,8 +355,29 @@ int main (int argc, char* argv[] ) {
 
         return 0;
     }
+    libera_recorder rec,rec_sa;
     //print all dataset
-    if(!ofile.empty()){
+    if(!ofile.empty() && binary){
+        const size_t buffer_size=(size_t)std::max(binary_buffer,1)*1024*1024;
+        LAPP_<<"recording on "<<ofile;
+        switch(mode){
+            case 1:
+                rec.open(ofile,LIBERA_REC_DD,sizeof(libera_dd_t),samples,soa?LIBERA_REC_FLAG_SOA:0,buffer_size);
+                if(sa){
+                    rec_sa.open(ofile+".sa",LIBERA_REC_SA,sizeof(libera_sa_t),samples,0,buffer_size);
+                }
+                break;
+            case 2:
+                rec.open(ofile,LIBERA_REC_SA,sizeof(libera_sa_t),samples,0,buffer_size);
+                break;
+            case 3:
+                rec.open(ofile,LIBERA_REC_ADC_SP,sizeof(libera_sp_t),samples,0,buffer_size);
+                break;
+            case 4:
+                rec.open(ofile,LIBERA_REC_ADC_CW,sizeof(libera_cw_t),samples,0,buffer_size);
+                break;
+        }
+    } else if(!ofile.empty()){
            LAPP_<<"opening "<<ofile;
 
            ofs_out.open(ofile.c_str(),std::ofstream::out );
@@ -234,6 +386,14 @@ int main (int argc, char* argv[] ) {
                 return -3;
            }
            LAPP_<<"opening "<<ofile << " for writing.";
+           if(sa && (mode==1)){
+               std::string sa_file=ofile+".sa";
+               ofs_sa.open(sa_file.c_str(),std::ofstream::out );
+               if(ofs_sa.good()==false){
+                   LERR_<<" cannot open :"<<sa_file <<" for write";
+                   return -3;
+               }
+           }
 
       }
     LAPP_<<"dumping:"<<mode << " samples:"<<samples;
@@ -246,7 +406,9 @@ int main (int argc, char* argv[] ) {
     libera_cw_t* data3;
     libera_sp_t* data4;
     libera_avg_t* data5;
-    uint64_t counter=0;
+    uint64_t counter=0,skipped=0;
+    std::vector<char> unpacked,sa_unpacked;
+    libera_rec_block_t blk;
     do {
     controller->fetchCurrentDeviceValue();
 
@@ -282,41 +444,107 @@ int main (int argc, char* argv[] ) {
 
     }
 
+    if(old_acquisition && (*acquisition>old_acquisition+1)){
+       // updates published while fetching the previous one
+       skipped+=*acquisition-old_acquisition-1;
+    }
+    memset(&blk,0,sizeof(blk));
+    blk.acquisition=*acquisition;
+    blk.mt=wrapped_data->getRawValuePtr("MT")?*(uint64_t*)wrapped_data->getRawValuePtr("MT"):0;
+    blk.st=wrapped_data->getRawValuePtr("ST")?*(uint64_t*)wrapped_data->getRawValuePtr("ST"):0;
+    blk.ts=tstamp;
+
       switch(mode){
 
        case 1:
-           if(counter==0){
+           if((counter==0) && !binary){
                print_header<libera_dd_desc_t> (timestamp,ofs_out);
            }
-           print_data(data1,timestamp,samples,tstamp,ofs_out);
+           if(soa && rec.is_open()){
+               // recorded column major (LIBERA_REC_FLAG_SOA)
+               rec.add(blk,data1,wrapped_data->hasKey("COUNT")?wrapped_data->getInt32Value("COUNT"):samples,sizeof(libera_dd_t));
+           } else if(soa){
+               // COUNT atoms, one column per quantity: print them back as rows
+               int count=wrapped_data->hasKey("COUNT")?wrapped_data->getInt32Value("COUNT"):samples;
+               for(int cnt=0;cnt<count;cnt++){
+                   if(timestamp){
+                       ofs_out<<tstamp<<",";
+                   }
+                   for(int col=0;col<LIBERA_DD_SOA_COLUMNS;col++){
+                       ofs_out<<libera_dd_soa_column(data1,count,col)[cnt]<<((col<LIBERA_DD_SOA_COLUMNS-1)?",":"\n");
+                   }
+               }
+               ofs_out<<flush;
+           } else if(packed){
+               int count;
+               data1=unpack_data(wrapped_data,"DD",data1,unpacked,count);
+               dump_data(data1,timestamp,count,tstamp,ofs_out,rec,blk);
+           } else {
+               dump_data(data1,timestamp,samples,tstamp,ofs_out,rec,blk);
+           }
+           if(sa && (ofs_sa.is_open() || rec_sa.is_open())){
+               // SA atoms streamed since the previous update
+               int count=wrapped_data->hasKey("SA_COUNT")?wrapped_data->getInt32Value("SA_COUNT"):0;
+               if((counter==0) && !binary){
+                   print_header<libera_sa_desc_t> (timestamp,ofs_sa);
+               }
+               if(packed && (count>0)){
+                   data2=unpack_data(wrapped_data,"SA",data2,sa_unpacked,count);
+               }
+               dump_data(data2,timestamp,count,tstamp,ofs_sa,rec_sa,blk);
+           }
 
 
        break;
 
          case 2:
-         if(counter==0){
+         if((counter==0) && !binary){
                print_header<libera_sa_desc_t> (timestamp,ofs_out);
            }
-           print_data(data2,timestamp,samples,tstamp,ofs_out);
+           {
+               // only SA_COUNT atoms of the SA array are valid
+               int count=wrapped_data->hasKey("SA_COUNT")?wrapped_data->getInt32Value("SA_COUNT"):1;
+               if(packed && (count>0)){
+                   data2=unpack_data(wrapped_data,"SA",data2,sa_unpacked,count);
+               }
+               dump_data(data2,timestamp,count,tstamp,ofs_out,rec,blk);
+           }
 
         break;
         case 3:
-         if(counter==0){
-               print_header<libera_cw_desc_t> (timestamp,ofs_out);
+        if((counter==0) && !binary){
+               print_header<libera_sp_desc_t> (timestamp,ofs_out);
+           }
+           {
+               // one atom per shot
+               int count=wrapped_data->hasKey("COUNT")?wrapped_data->getInt32Value("COUNT"):1;
+               if(packed){
+                   data4=unpack_data(wrapped_data,"ADC_SP",data4,unpacked,count);
+               }
+               dump_data(data4,timestamp,count,tstamp,ofs_out,rec,blk);
            }
-           print_data(data3,timestamp,samples,tstamp,ofs_out);
 
        break;
        case 4:
-        if(counter==0){
-               print_header<libera_sp_desc_t> (timestamp,ofs_out);
+         if((counter==0) && !binary){
+               print_header<libera_cw_desc_t> (timestamp,ofs_out);
+           }
+           {
+               int count=samples;
+               if(packed){
+                   // nothing packed before the first atoms
+                   if(wrapped_data->getInt32Value("COUNT")==0){
+                       break;
+                   }
+                   data3=unpack_data(wrapped_data,"ADC_CW",data3,unpacked,count);
+               }
+               dump_data(data3,timestamp,count,tstamp,ofs_out,rec,blk);
            }
-           print_data(data4,timestamp,samples,tstamp,ofs_out);
 
        break;
 
          case 5:
-             if(counter==0){
+             if((counter==0) && !binary){
                print_header<libera_avg_desc_t> (timestamp,ofs_out);
            }
            print_data(data5,timestamp,samples,tstamp,ofs_out);
@@ -331,7 +559,9 @@ int main (int argc, char* argv[] ) {
      // std::cout << controller->getCurrentDatasetForDomain((DatasetDomain)0)->getJSONString() <<std::endl;
 
           ofs_out.close();
-
+          rec.close();
+          rec_sa.close();
+          LAPP_<<"acquisitions dumped:"<<counter<<" recorded:"<<rec.recorded()<<" not fetched:"<<skipped;
 
 
   } catch(CException& e) {
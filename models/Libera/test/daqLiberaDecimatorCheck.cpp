@@ -0,0 +1,173 @@
+/*
+ *	daqLiberaDecimatorCheck.cpp
+ *	!CHAOS
+ *
+ *	Checks the DD software decimator (libera_decimator) against direct
+ *	implementations: boxcar means, the CIC as the convolution with its
+ *	impulse response and the FIR as a plain convolution, on beam-like
+ *	atoms with the edges replicated. Also checks the unity DC gain of
+ *	the three filters and the FIR stop band.
+ *
+ *	usage: daqLiberaDecimatorCheck
+ *	Returns 0 if all the decimated atoms match.
+ *
+ *    	Copyright 2015 INFN, National Institute of Nuclear Physics
+ *
+ *    	Licensed under the Apache License, Version 2.0 (the "License");
+ *    	you may not use this file except in compliance with the License.
+ *    	You may obtain a copy of the License at
+ *
+ *    	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    	Unless required by applicable law or agreed to in writing, software
+ *    	distributed under the License is distributed on an "AS IS" BASIS,
+ *    	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    	See the License for the specific language governing permissions and
+ *    	limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "models/Libera/LiberaData.h"
+
+#define ATOMS 20000
+#define FIELDS 8
+
+static const int factors[] = { 2, 3, 7, 16, 64, 1000 };
+static const int counts[] = { 1, 15, 64, 1001, ATOMS };
+
+static inline int32_t div_round(int64_t n,int64_t d){
+    return (int32_t)((n>=0)?(n+d/2)/d:-((-n+d/2)/d));
+}
+
+static int32_t field(const std::vector<libera_dd_t>& in,int64_t i,int f){
+    i = std::min(std::max(i,(int64_t)0),(int64_t)in.size()-1);
+    return ((const int32_t*)&in[i])[f];
+}
+
+// reference output atom m, in holds the count input atoms
+static void reference(const libera_decimator& dec,const std::vector<libera_dd_t>& in,size_t m,int32_t* out){
+    const int64_t r = dec.cfg.factor;
+    for(int f=0;f<FIELDS;f++){
+        int64_t acc=0;
+        if(dec.cfg.filter==LIBERA_DEC_BOXCAR){
+            for(int64_t k=0;k<r;k++) acc+=field(in,m*r+k,f);
+            out[f]=div_round(acc,r);
+        } else if(dec.cfg.filter==LIBERA_DEC_CIC){
+            // impulse response: a box of r convolved LIBERA_DEC_CIC_STAGES times
+            std::vector<int64_t> w(1,1);
+            for(int s=0;s<LIBERA_DEC_CIC_STAGES;s++){
+                std::vector<int64_t> c(w.size()+r-1,0);
+                for(size_t i=0;i<w.size();i++) for(int64_t k=0;k<r;k++) c[i+k]+=w[i];
+                w=c;
+            }
+            const int64_t end = (int64_t)(m+2)*r-1;	// end of block m+1
+            for(size_t k=0;k<w.size();k++) acc+=w[k]*field(in,end-(int64_t)k,f);
+            out[f]=div_round(acc,r*r*r);
+        } else {
+            const int64_t n = dec.taps.size();
+            const int64_t start = (int64_t)m*r + r/2 - n/2;
+            for(int64_t k=0;k<n;k++) acc+=(int64_t)dec.taps[k]*field(in,start+k,f);
+            out[f]=div_round(acc,65536);
+        }
+    }
+}
+
+static void generate(std::vector<libera_dd_t>& in){
+    srand(1);
+    for(size_t i=0;i<in.size();i++){
+        int32_t* p=(int32_t*)&in[i];
+        const double beam = 1e6*(1.0+0.5*sin(i*2e-3));
+        for(int f=0;f<FIELDS;f++){
+            // amplitudes, then positions in nm around the center
+            p[f] = (int32_t)((f<4)?beam*(1.0+0.01*rand()/RAND_MAX):2e5*sin(i*0.05+f)+(rand()%2001)-1000);
+        }
+    }
+    // full scale at the edges
+    ((int32_t*)&in[0])[4]=2147483647;
+    ((int32_t*)&in[in.size()-1])[5]=-2147483647;
+}
+
+int main(int argc,char* argv[]){
+    const int filters[] = {LIBERA_DEC_BOXCAR,LIBERA_DEC_CIC,LIBERA_DEC_FIR};
+    const char* names[] = {"","boxcar","cic","fir"};
+    std::vector<libera_dd_t> all(ATOMS),out(ATOMS),cst(4096);
+    libera_decimator dec;
+    libera_decimation_t cfg;
+    int failed=0;
+
+    generate(all);
+    for(size_t i=0;i<cst.size();i++){
+        for(int f=0;f<FIELDS;f++) ((int32_t*)&cst[i])[f]=-123456+f;
+    }
+
+    for(size_t t=0;t<sizeof(filters)/sizeof(filters[0]);t++){
+        for(size_t r=0;r<sizeof(factors)/sizeof(factors[0]);r++){
+            size_t mismatch=0,outputs=0;
+            cfg.filter=filters[t];
+            cfg.factor=factors[r];
+            if(dec.set(cfg)!=0){
+                printf("%s factor %d: rejected\n",names[filters[t]],factors[r]);
+                failed=1;
+                continue;
+            }
+            for(size_t c=0;c<sizeof(counts)/sizeof(counts[0]);c++){
+                std::vector<libera_dd_t> in(all.begin(),all.begin()+counts[c]);
+                const size_t n=dec.run(&in[0],&out[0],in.size());
+                if(n!=in.size()/factors[r]){
+                    printf("%s factor %d count %d: %lu atoms\n",names[filters[t]],factors[r],counts[c],(unsigned long)n);
+                    mismatch++;
+                }
+                for(size_t m=0;m<n;m++){
+                    int32_t ref[FIELDS];
+                    reference(dec,in,m,ref);
+                    if(memcmp(ref,&out[m],sizeof(ref))){
+                        if(!mismatch){
+                            printf("%s factor %d count %d: atom %lu differs: X %d/%d Va %d/%d\n",names[filters[t]],factors[r],counts[c],
+                                   (unsigned long)m,ref[4],out[m].X,ref[0],out[m].Va);
+                        }
+                        mismatch++;
+                    }
+                }
+                outputs+=n;
+            }
+            // unity DC gain
+            const size_t n=dec.run(&cst[0],&out[0],cst.size());
+            for(size_t m=0;m<n;m++){
+                if(memcmp(&cst[0],&out[m],sizeof(libera_dd_t))) mismatch++;
+            }
+            printf("%-6s factor %4d: %lu atoms, %lu mismatches\n",names[filters[t]],factors[r],(unsigned long)outputs,(unsigned long)mismatch);
+            if(mismatch) failed=1;
+        }
+    }
+
+    // FIR stop band: a tone at 2.5 times the decimated Nyquist frequency
+    cfg.filter=LIBERA_DEC_FIR;
+    cfg.factor=16;
+    dec.set(cfg);
+    std::vector<libera_dd_t> tone(ATOMS);
+    for(size_t i=0;i<tone.size();i++){
+        tone[i].X=(int32_t)(1e6*sin(2*M_PI*2.5/(2*cfg.factor)*i));
+    }
+    const size_t n=dec.run(&tone[0],&out[0],tone.size());
+    int32_t peak=0;
+    for(size_t m=LIBERA_DEC_FIR_SPAN;m+LIBERA_DEC_FIR_SPAN<n;m++) peak=std::max(peak,abs(out[m].X));
+    const double att=20*log10(1e6/std::max(peak,1));
+    printf("fir stop band attenuation %.1f dB\n",att);
+    if(att<40) failed=1;
+
+    // invalid configurations
+    cfg.filter=LIBERA_DEC_CIC;
+    cfg.factor=LIBERA_DEC_MAX_FACTOR+1;
+    if(dec.set(cfg)==0) failed=1;
+    cfg.filter=99;
+    cfg.factor=2;
+    if(dec.set(cfg)==0) failed=1;
+
+    return failed;
+}
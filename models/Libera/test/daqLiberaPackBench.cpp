@@ -0,0 +1,171 @@
+/*
+ *	daqLiberaPackBench.cpp
+ *	!CHAOS
+ *
+ *	Checks that the packed encoding of the DD, SA, ADC_CW and ADC_SP
+ *	atoms (libera_pack) unpacks to the original atoms, on beam-like
+ *	data, full scale noise and truncated buffers, then times it and
+ *	reports one line per atom type:
+ *
+ *	<type> <atoms> atoms <ratio> ratio <pack> MB/s pack <unpack> MB/s unpack
+ *
+ *	the rates are in raw (unpacked) bytes per second.
+ *
+ *	usage: daqLiberaPackBench
+ *	Returns 0 if all the buffers round trip.
+ *
+ *    	Copyright 2015 INFN, National Institute of Nuclear Physics
+ *
+ *    	Licensed under the Apache License, Version 2.0 (the "License");
+ *    	you may not use this file except in compliance with the License.
+ *    	You may obtain a copy of the License at
+ *
+ *    	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    	Unless required by applicable law or agreed to in writing, software
+ *    	distributed under the License is distributed on an "AS IS" BASIS,
+ *    	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    	See the License for the specific language governing permissions and
+ *    	limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#include "models/Libera/LiberaData.h"
+
+#define ATOMS 64000
+// timed runs per type, the fastest is reported
+#define RUNS 5
+
+static const int counts[] = { 0, 1, 2, 128, 129, 130, 1000, ATOMS };
+
+typedef struct bench_type {
+    const char* name;
+    const libera_pack_layout_t* layout;
+} bench_type_t;
+
+static const bench_type_t types[] = {
+    {"DD",&libera_dd_pack},
+    {"SA",&libera_sa_pack},
+    {"ADC_CW",&libera_cw_pack},
+    {"ADC_SP",&libera_sp_pack}
+};
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static void store(char* atom,const libera_pack_field_t& f,int64_t v){
+    int16_t s=v;
+    int32_t i=v;
+    switch(f.size){
+        case 2: memcpy(atom+f.offset,&s,2); break;
+        case 4: memcpy(atom+f.offset,&i,4); break;
+        default: memcpy(atom+f.offset,&v,8); break;
+    }
+}
+
+// slowly varying fields with a few counts of noise, padding zeroed
+static void generate_beam(const libera_pack_layout_t& l,std::vector<char>& buf,size_t count){
+    buf.assign(count*l.atom_size,0);
+    for(size_t i=0;i<count;i++){
+        for(int f=0;f<l.size;f++){
+            const double v=((f&1)?1e6:2e5)*sin(i*2e-3+f)+(rand()%201)-100;
+            store(&buf[i*l.atom_size],l.fields[f],(l.fields[f].size==2)?(int64_t)(v/64):(int64_t)v);
+        }
+    }
+}
+
+// every bit of every field random, deltas as wide as the fields
+static void generate_noise(const libera_pack_layout_t& l,std::vector<char>& buf,size_t count){
+    buf.assign(count*l.atom_size,0);
+    for(size_t i=0;i<count;i++){
+        for(int f=0;f<l.size;f++){
+            const uint64_t u=((uint64_t)rand()<<40)^((uint64_t)rand()<<20)^(uint64_t)rand()^((i&1)?(1ULL<<63):0);
+            const int64_t v=(int64_t)u;
+            store(&buf[i*l.atom_size],l.fields[f],v);
+        }
+    }
+}
+
+static int round_trip(const char* name,const char* data,const libera_pack_layout_t& l,const std::vector<char>& in,size_t count){
+    std::vector<char> packed(libera_pack_bound(l,count));
+    std::vector<char> out(count*l.atom_size+1,0x5a);
+    const size_t size=libera_pack(l,in.empty()?NULL:&in[0],count,&packed[0]);
+    if(size>packed.size()){
+        printf("%s %s count %lu: packed %lu bytes over the bound %lu\n",name,data,(unsigned long)count,(unsigned long)size,(unsigned long)packed.size());
+        return 1;
+    }
+    const int n=libera_unpack(&packed[0],size,&out[0],out.size());
+    if((n!=(int)count) || (count && memcmp(&in[0],&out[0],in.size()))){
+        printf("%s %s count %lu: unpacked %d atoms, differ\n",name,data,(unsigned long)count,n);
+        return 1;
+    }
+    // truncated or too small destination
+    if(count>1){
+        if(libera_unpack(&packed[0],size-1,&out[0],out.size())!=-1){
+            printf("%s %s count %lu: truncated buffer accepted\n",name,data,(unsigned long)count);
+            return 1;
+        }
+        libera_pack_header_t* h=(libera_pack_header_t*)&packed[0];
+        h->size--;
+        if(libera_unpack(&packed[0],size,&out[0],out.size())!=-1){
+            printf("%s %s count %lu: short stream accepted\n",name,data,(unsigned long)count);
+            return 1;
+        }
+        h->size++;
+        if(libera_unpack(&packed[0],size,&out[0],in.size()-1)!=-1){
+            printf("%s %s count %lu: small destination accepted\n",name,data,(unsigned long)count);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc,char* argv[]){
+    int failed=0;
+    std::vector<char> in;
+
+    srand(1);
+    for(size_t t=0;t<sizeof(types)/sizeof(types[0]);t++){
+        const libera_pack_layout_t& l=*types[t].layout;
+        for(size_t c=0;c<sizeof(counts)/sizeof(counts[0]);c++){
+            generate_beam(l,in,counts[c]);
+            failed|=round_trip(types[t].name,"beam",l,in,counts[c]);
+            generate_noise(l,in,counts[c]);
+            failed|=round_trip(types[t].name,"noise",l,in,counts[c]);
+        }
+    }
+    if(libera_pack_header("not packed",11)!=NULL){
+        printf("raw buffer taken as packed\n");
+        failed=1;
+    }
+
+    for(size_t t=0;t<sizeof(types)/sizeof(types[0]);t++){
+        const libera_pack_layout_t& l=*types[t].layout;
+        std::vector<char> packed(libera_pack_bound(l,ATOMS)),out(ATOMS*l.atom_size);
+        double best_pack=1e9,best_unpack=1e9;
+        size_t size=0;
+        generate_beam(l,in,ATOMS);
+        for(int r=0;r<RUNS;r++){
+            double t0=now();
+            size=libera_pack(l,&in[0],ATOMS,&packed[0]);
+            double t1=now();
+            libera_unpack(&packed[0],size,&out[0],out.size());
+            double t2=now();
+            best_pack=std::min(best_pack,t1-t0);
+            best_unpack=std::min(best_unpack,t2-t1);
+        }
+        printf("%-6s %d atoms %.2f ratio %.0f MB/s pack %.0f MB/s unpack\n",types[t].name,ATOMS,(double)in.size()/size,
+               in.size()/best_pack/1e6,in.size()/best_unpack/1e6);
+    }
+    return failed;
+}
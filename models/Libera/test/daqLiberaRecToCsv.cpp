@@ -0,0 +1,163 @@
+/*
+ *	daqLiberaRecToCsv.cpp
+ *	!CHAOS
+ *
+ *	Converts a binary recording of daqLiberaClient (--binary) to csv, one
+ *	line per atom prefixed by the acquisition number, the machine time and
+ *	the system time of its acquisition:
+ *
+ *	ACQUISITION,MT,ST,<atom fields>
+ *
+ *	column major DD blocks (LIBERA_REC_FLAG_SOA) are written back as rows.
+ *	The acquisitions missing in the recording are reported on stderr.
+ *
+ *	usage: daqLiberaRecToCsv <recording> [csv file, stdout if not given]
+ *	Returns 0 if the whole recording has been converted.
+ *
+ *    	Copyright 2015 INFN, National Institute of Nuclear Physics
+ *
+ *    	Licensed under the Apache License, Version 2.0 (the "License");
+ *    	you may not use this file except in compliance with the License.
+ *    	You may obtain a copy of the License at
+ *
+ *    	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    	Unless required by applicable law or agreed to in writing, software
+ *    	distributed under the License is distributed on an "AS IS" BASIS,
+ *    	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    	See the License for the specific language governing permissions and
+ *    	limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <vector>
+
+#include "models/Libera/LiberaData.h"
+
+// stdio buffers of the recording and of the csv
+#define IO_BUFFER (4*1024*1024)
+
+static uint64_t blocks=0,atoms=0,missing=0;
+
+static void row(std::ostream& out,const libera_rec_block_t& blk){
+    out<<blk.acquisition<<","<<blk.mt<<","<<blk.st<<",";
+}
+
+template <typename T,typename D>
+static int convert(FILE* in,std::ostream& out){
+    libera_rec_block_t blk;
+    std::vector<T> data;
+    uint64_t last=0;
+    out<<"ACQUISITION,MT,ST,"<<D();
+    while(fread(&blk,sizeof(blk),1,in)==1){
+        data.resize(blk.count+1);
+        if(fread(&data[0],sizeof(T),blk.count,in)!=blk.count){
+            fprintf(stderr,"## truncated block of acquisition %llu\n",(unsigned long long)blk.acquisition);
+            return 1;
+        }
+        if(blocks && (blk.acquisition>last+1)){
+            missing+=blk.acquisition-last-1;
+        }
+        last=blk.acquisition;
+        for(uint32_t i=0;i<blk.count;i++){
+            row(out,blk);
+            out<<data[i];
+        }
+        blocks++;
+        atoms+=blk.count;
+    }
+    return ferror(in)?1:0;
+}
+
+// DD recorded column major
+static int convert_soa(FILE* in,std::ostream& out){
+    libera_rec_block_t blk;
+    std::vector<libera_dd_t> data;
+    uint64_t last=0;
+    out<<"ACQUISITION,MT,ST,"<<libera_dd_desc_t();
+    while(fread(&blk,sizeof(blk),1,in)==1){
+        data.resize(blk.count+1);
+        if(fread(&data[0],sizeof(libera_dd_t),blk.count,in)!=blk.count){
+            fprintf(stderr,"## truncated block of acquisition %llu\n",(unsigned long long)blk.acquisition);
+            return 1;
+        }
+        if(blocks && (blk.acquisition>last+1)){
+            missing+=blk.acquisition-last-1;
+        }
+        last=blk.acquisition;
+        for(uint32_t i=0;i<blk.count;i++){
+            row(out,blk);
+            for(int col=0;col<LIBERA_DD_SOA_COLUMNS;col++){
+                out<<libera_dd_soa_column(&data[0],blk.count,col)[i]<<((col<LIBERA_DD_SOA_COLUMNS-1)?",":"\n");
+            }
+        }
+        blocks++;
+        atoms+=blk.count;
+    }
+    return ferror(in)?1:0;
+}
+
+int main(int argc,char* argv[]){
+    libera_rec_header_t h;
+    std::ofstream fout;
+    std::vector<char> out_buf(IO_BUFFER);
+    int ret=-1;
+
+    if(argc<2){
+        fprintf(stderr,"usage: %s <recording> [csv file]\n",argv[0]);
+        return 1;
+    }
+    FILE* in=fopen(argv[1],"rb");
+    if(in==NULL){
+        fprintf(stderr,"## cannot open %s\n",argv[1]);
+        return 1;
+    }
+    setvbuf(in,NULL,_IOFBF,IO_BUFFER);
+    if(argc>2){
+        fout.rdbuf()->pubsetbuf(&out_buf[0],out_buf.size());
+        fout.open(argv[2],std::ofstream::out);
+        if(!fout.good()){
+            fprintf(stderr,"## cannot open %s for write\n",argv[2]);
+            return 1;
+        }
+    }
+    std::ostream& out=(argc>2)?fout:std::cout;
+    if((fread(&h,sizeof(h),1,in)!=1) || (h.magic!=LIBERA_REC_MAGIC) || (h.version!=LIBERA_REC_VERSION)){
+        fprintf(stderr,"## %s is not a libera recording\n",argv[1]);
+        return 1;
+    }
+    switch(h.atom_type){
+        case LIBERA_REC_DD:
+            if(h.atom_size!=sizeof(libera_dd_t)) break;
+            ret=(h.flags&LIBERA_REC_FLAG_SOA)?convert_soa(in,out):convert<libera_dd_t,libera_dd_desc_t>(in,out);
+            break;
+        case LIBERA_REC_SA:
+            if(h.atom_size!=sizeof(libera_sa_t)) break;
+            ret=convert<libera_sa_t,libera_sa_desc_t>(in,out);
+            break;
+        case LIBERA_REC_ADC_SP:
+            if(h.atom_size!=sizeof(libera_sp_t)) break;
+            ret=convert<libera_sp_t,libera_sp_desc_t>(in,out);
+            break;
+        case LIBERA_REC_ADC_CW:
+            if(h.atom_size!=sizeof(libera_cw_t)) break;
+            ret=convert<libera_cw_t,libera_cw_desc_t>(in,out);
+            break;
+    }
+    if(ret<0){
+        fprintf(stderr,"## unsupported atom type %d (%u bytes)\n",h.atom_type,h.atom_size);
+        return 1;
+    }
+    out.flush();
+    fclose(in);
+    if(!out.good()){
+        fprintf(stderr,"## error writing the csv\n");
+        ret=1;
+    }
+    fprintf(stderr,"%llu acquisitions, %llu atoms, %llu acquisitions missing\n",
+            (unsigned long long)blocks,(unsigned long long)atoms,(unsigned long long)missing);
+    return ret;
+}
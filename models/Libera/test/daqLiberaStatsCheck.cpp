@@ -0,0 +1,194 @@
+/*
+ *	daqLiberaStatsCheck.cpp
+ *	!CHAOS
+ *
+ *	Checks the one pass statistics (libera_dd_stats, libera_sa_stats)
+ *	against a two pass computation in long double: mean, then the RMS
+ *	of the deviations from it. The atoms are beam-like, with Sum around
+ *	2e9 and small noise (where a plain sum of squares cancels), with the
+ *	first atom far from the mean and at the int32 full scale.
+ *
+ *	usage: daqLiberaStatsCheck
+ *	Returns 0 if all the statistics match.
+ *
+ *    	Copyright 2015 INFN, National Institute of Nuclear Physics
+ *
+ *    	Licensed under the Apache License, Version 2.0 (the "License");
+ *    	you may not use this file except in compliance with the License.
+ *    	You may obtain a copy of the License at
+ *
+ *    	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    	Unless required by applicable law or agreed to in writing, software
+ *    	distributed under the License is distributed on an "AS IS" BASIS,
+ *    	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    	See the License for the specific language governing permissions and
+ *    	limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "models/Libera/LiberaData.h"
+
+#define ATOMS 100000
+// tolerance of the means, relative to the largest value of the quantity
+#define TOLERANCE 1e-9
+// tolerance of the RMS, relative to the RMS: a sum of squares cancels to 1e-3 with Sum around 2e9
+#define RMS_TOLERANCE 1e-6
+
+static const int counts[] = { 1, 2, 17, 1000, ATOMS };
+
+enum { BEAM=0, HIGH_SUM, OUTLIER, FULL_SCALE, CONSTANT, SETS };
+static const char* sets[SETS] = { "beam", "sum 2e9", "outlier", "full scale", "constant" };
+
+template <typename T>
+static void get(const T& a,int32_t* v){
+    v[LIBERA_STATS_X]=a.X;
+    v[LIBERA_STATS_Y]=a.Y;
+    v[LIBERA_STATS_Q]=a.Q;
+    v[LIBERA_STATS_SUM]=a.Sum;
+}
+
+template <typename T>
+static void set(T& a,const int32_t* v){
+    a.X=v[LIBERA_STATS_X];
+    a.Y=v[LIBERA_STATS_Y];
+    a.Q=v[LIBERA_STATS_Q];
+    a.Sum=v[LIBERA_STATS_SUM];
+}
+
+template <typename T>
+static void generate(std::vector<T>& in,int s){
+    srand(1+s);
+    memset(&in[0],0,in.size()*sizeof(T));
+    for(size_t i=0;i<in.size();i++){
+        int32_t v[LIBERA_STATS_FIELDS];
+        const int noise=(rand()%2001)-1000;
+        switch(s){
+        case BEAM:
+            v[LIBERA_STATS_X]=(int32_t)(2e5*sin(i*0.05))+noise;
+            v[LIBERA_STATS_Y]=(int32_t)(1e5*cos(i*0.03))-noise;
+            v[LIBERA_STATS_Q]=noise;
+            v[LIBERA_STATS_SUM]=(int32_t)(1e6*(1.0+0.5*sin(i*2e-3)))+noise;
+            break;
+        case HIGH_SUM:
+        case OUTLIER:
+            // large means, small deviations
+            v[LIBERA_STATS_X]=2000000000+noise;
+            v[LIBERA_STATS_Y]=-2000000000+noise/10;
+            v[LIBERA_STATS_Q]=1999999000+(noise&1);
+            v[LIBERA_STATS_SUM]=2000000000+noise+(int32_t)(i%7);
+            break;
+        case FULL_SCALE:
+            // swings between the int32 limits
+            v[LIBERA_STATS_X]=(i&1)?2147483647:-2147483647-1;
+            v[LIBERA_STATS_Y]=(int32_t)(2147483647.0*sin(i*0.001));
+            v[LIBERA_STATS_Q]=(i%3)?-2147483647-1:2147483647;
+            v[LIBERA_STATS_SUM]=2147483647-(int32_t)(i%1000);
+            break;
+        default:
+            v[LIBERA_STATS_X]=-123456;
+            v[LIBERA_STATS_Y]=654321;
+            v[LIBERA_STATS_Q]=0;
+            v[LIBERA_STATS_SUM]=2000000000;
+        }
+        set(in[i],v);
+    }
+    if(s==OUTLIER){
+        // the first atom, the offset of the one pass sums, far from the others
+        const int32_t v[LIBERA_STATS_FIELDS]={-2147483647-1,2147483647,-2147483647-1,0};
+        set(in[0],v);
+    }
+}
+
+static bool differ(double v,long double ref,long double scale){
+    return fabsl(v-ref)>TOLERANCE*std::max(scale,(long double)1);
+}
+
+// mismatches of the statistics of count atoms of in against the two pass reference
+template <typename T>
+static size_t check(const char* type,const char* set_name,const T* in,size_t count,const libera_stats_t& st){
+    long double mean[LIBERA_STATS_FIELDS]={0,0,0,0},rms[LIBERA_STATS_FIELDS]={0,0,0,0},scale[LIBERA_STATS_FIELDS]={0,0,0,0};
+    int32_t mn[LIBERA_STATS_FIELDS],mx[LIBERA_STATS_FIELDS];
+    long double wx=0,wy=0,w=0;
+    size_t mismatch=0;
+
+    get(in[0],mn);
+    get(in[0],mx);
+    for(size_t i=0;i<count;i++){
+        int32_t v[LIBERA_STATS_FIELDS];
+        get(in[i],v);
+        for(int f=0;f<LIBERA_STATS_FIELDS;f++){
+            mean[f]+=v[f];
+            scale[f]=std::max(scale[f],fabsl(v[f]));
+            mn[f]=std::min(mn[f],v[f]);
+            mx[f]=std::max(mx[f],v[f]);
+        }
+        wx+=(long double)v[LIBERA_STATS_X]*v[LIBERA_STATS_SUM];
+        wy+=(long double)v[LIBERA_STATS_Y]*v[LIBERA_STATS_SUM];
+        w+=v[LIBERA_STATS_SUM];
+    }
+    for(int f=0;f<LIBERA_STATS_FIELDS;f++) mean[f]/=count;
+    for(size_t i=0;i<count;i++){
+        int32_t v[LIBERA_STATS_FIELDS];
+        get(in[i],v);
+        for(int f=0;f<LIBERA_STATS_FIELDS;f++) rms[f]+=(v[f]-mean[f])*(v[f]-mean[f]);
+    }
+
+    if(st.count!=count){
+        printf("%s %s count %lu: stats count %u\n",type,set_name,(unsigned long)count,st.count);
+        mismatch++;
+    }
+    for(int f=0;f<LIBERA_STATS_FIELDS;f++){
+        rms[f]=sqrtl(rms[f]/count);
+        if(differ(st.mean[f],mean[f],scale[f]) || (fabsl(st.rms[f]-rms[f])>RMS_TOLERANCE*std::max(rms[f],(long double)1)) ||
+           (st.min[f]!=mn[f]) || (st.max[f]!=mx[f])){
+            printf("%s %s count %lu: %s mean %.6f/%.6Lf rms %.6f/%.6Lf min %d/%d max %d/%d\n",type,set_name,(unsigned long)count,
+                   libera_stats_fields[f],st.mean[f],mean[f],st.rms[f],rms[f],st.min[f],mn[f],st.max[f],mx[f]);
+            mismatch++;
+        }
+    }
+    const long double xw=(w!=0)?wx/w:mean[LIBERA_STATS_X];
+    const long double yw=(w!=0)?wy/w:mean[LIBERA_STATS_Y];
+    if(differ(st.x_wmean,xw,scale[LIBERA_STATS_X]) || differ(st.y_wmean,yw,scale[LIBERA_STATS_Y])){
+        printf("%s %s count %lu: weighted X %.6f/%.6Lf Y %.6f/%.6Lf\n",type,set_name,(unsigned long)count,st.x_wmean,xw,st.y_wmean,yw);
+        mismatch++;
+    }
+    return mismatch;
+}
+
+int main(int argc,char* argv[]){
+    std::vector<libera_dd_t> dd(ATOMS);
+    std::vector<libera_sa_t> sa(ATOMS);
+    libera_stats_t st;
+    int failed=0;
+
+    for(int s=0;s<SETS;s++){
+        size_t mismatch=0;
+        generate(dd,s);
+        generate(sa,s);
+        for(size_t c=0;c<sizeof(counts)/sizeof(counts[0]);c++){
+            libera_dd_stats(&dd[0],counts[c],&st);
+            mismatch+=check("dd",sets[s],&dd[0],counts[c],st);
+            libera_sa_stats(&sa[0],counts[c],&st);
+            mismatch+=check("sa",sets[s],&sa[0],counts[c],st);
+        }
+        printf("%-10s %d atoms, %lu mismatches\n",sets[s],ATOMS,(unsigned long)mismatch);
+        if(mismatch) failed=1;
+    }
+
+    // no atoms, no statistics
+    memset(&st,0xff,sizeof(st));
+    libera_dd_stats(&dd[0],0,&st);
+    if(st.count!=0){
+        printf("dd count 0: stats count %u\n",st.count);
+        failed=1;
+    }
+
+    return failed;
+}
@@ -0,0 +1,297 @@
+/*
+ *	daqLiberaTransformBench.c
+ *	!CHAOS
+ *
+ *	Times the CORDIC and the cspi data transforms over buffers of 1 to
+ *	64k atoms and reports ns/atom and atoms/s, one line per transform
+ *	and size:
+ *
+ *	<transform> <atoms> atoms <ns> ns/atom <rate> atoms/s
+ *
+ *	usage: daqLiberaTransformBench [-r raw DD file] [-b baseline] [-t tolerance %]
+ *	-r the raw file is a sequence of CSPI_DD_RAWATOM as read from
+ *	   /dev/libera.dd, when not given beam-like atoms are generated.
+ *	-b a previous output of the benchmark: returns 1 if a transform is
+ *	   slower than its baseline by more than the tolerance (default 10%).
+ *
+ *    	Copyright 2015 INFN, National Institute of Nuclear Physics
+ *
+ *    	Licensed under the Apache License, Version 2.0 (the "License");
+ *    	you may not use this file except in compliance with the License.
+ *    	You may obtain a copy of the License at
+ *
+ *    	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    	Unless required by applicable law or agreed to in writing, software
+ *    	distributed under the License is distributed on an "AS IS" BASIS,
+ *    	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    	See the License for the specific language governing permissions and
+ *    	limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "cspi.h"
+#include "cordic.h"
+#include "ebpp_transform.h"
+
+#define MAX_ATOMS (64*1024)
+// atoms transformed per timed run, at least
+#define RUN_ATOMS (1024*1024)
+// timed runs per transform and size, the fastest is reported
+#define RUNS 5
+// switching period of the DD fixture (trigger bit of cosVa)
+#define SWITCH_HALF_PERIOD 20
+
+typedef int (*transform_t)( const void *in, void *out, size_t count );
+
+typedef enum { IN_IQ, IN_DD, IN_DD_SWITCH, IN_ADC } input_t;
+
+// I/Q pairs for the CORDIC, 4 per DD atom
+static int I[4*MAX_ATOMS], Q[4*MAX_ATOMS];
+
+// in points into I, Q is at the same index
+static int bench_cordic_amp( const void *in, void *out, size_t count )
+{
+	const size_t first = (const int *)in - I;
+	int *a = (int *)out;
+	size_t i;
+
+	for ( i=0; i<count; i++ ) a[i] = cordic_amp( I[first+i], Q[first+i] );
+	return 0;
+}
+
+static int bench_cordic_amp_batch( const void *in, void *out, size_t count )
+{
+	const size_t first = (const int *)in - I;
+
+	cordic_amp_batch( I + first, Q + first, (int *)out, count );
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	transform_t fn;
+	input_t input;
+} transforms[] = {
+	{ "cordic_amp", bench_cordic_amp, IN_IQ },
+	{ "cordic_amp_batch", bench_cordic_amp_batch, IN_IQ },
+	{ "dd", ebpp_transform_dd, IN_DD },
+	{ "dd_batch", ebpp_transform_dd_batch, IN_DD },
+	{ "dd_rcp", ebpp_transform_dd_rcp, IN_DD },
+	{ "dd_remove_spikes", ebpp_transform_dd_remove_spikes, IN_DD_SWITCH },
+	{ "dd_remove_spikes_ref", ebpp_transform_dd_remove_spikes_ref, IN_DD_SWITCH },
+	{ "adc_cw", ebpp_transform_adc_cw, IN_ADC },
+	{ "adc_sp", ebpp_transform_adc_sp, IN_ADC },
+	{ "adc_sp_rot", ebpp_transform_adc_sp_rot, IN_ADC },
+};
+
+static const size_t sizes[] = { 1, 16, 256, 4096, MAX_ATOMS };
+
+static CSPI_DD_RAWATOM dd[MAX_ATOMS], dd_switch[MAX_ATOMS];
+static CSPI_ADC_ATOM adc[MAX_ATOMS];
+// large enough for any output atom
+static CSPI_ADC_CW_ATOM out[MAX_ATOMS];
+
+static size_t load_raw( const char *fname )
+{
+	FILE *f = fopen( fname, "rb" );
+	size_t count, i;
+
+	if ( !f ) {
+		perror( fname );
+		return 0;
+	}
+	count = fread( dd, sizeof(CSPI_DD_RAWATOM), MAX_ATOMS, f );
+	fclose( f );
+
+	// repeat a short recording up to MAX_ATOMS
+	for ( i=count; count && i<MAX_ATOMS; i++ ) dd[i] = dd[i % count];
+
+	return count;
+}
+
+// Beam-like atoms: a beam of slowly varying intensity near the center,
+// random phase per channel.
+static void generate_raw()
+{
+	size_t i;
+	int ch;
+
+	srand( 1 );
+	for ( i=0; i<MAX_ATOMS; i++ ) {
+
+		int *p = (int *)&dd[i];
+		const double sum = (1 << 24) * (1.0 + 0.5 * sin( i * 1e-3 ));
+
+		for ( ch=0; ch<4; ch++ ) {
+
+			const double amp = sum * (1.0 + 0.02 * rand() / RAND_MAX);
+			const double phase = 2.0 * M_PI * rand() / RAND_MAX;
+
+			p[2*ch]   = (int)( amp * cos( phase ) );
+			p[2*ch+1] = (int)( amp * sin( phase ) );
+		}
+	}
+}
+
+// Derived fixtures: the CORDIC inputs, the DD atoms with the switching
+// trigger bit and an ADC burst with the single pass beam at the very end,
+// so that the threshold scan goes through the whole buffer.
+static void generate_fixtures()
+{
+	size_t i;
+
+	for ( i=0; i<MAX_ATOMS; i++ ) {
+
+		const int *p = (const int *)&dd[i];
+		int ch;
+
+		for ( ch=0; ch<4; ch++ ) {
+			I[4*i+ch] = p[2*ch+1] >> 1;
+			Q[4*i+ch] = p[2*ch] >> 1;
+		}
+
+		dd_switch[i] = dd[i];
+		dd_switch[i].cosVa = (dd[i].cosVa & ~1) | ((i / SWITCH_HALF_PERIOD) & 1);
+	}
+
+	for ( i=0; i<MAX_ATOMS; i++ ) {
+
+		const double s = sin( 2.0 * M_PI * 0.2113 * i );
+		const double amp = i == MAX_ATOMS - 8 ? 8000.0 : 400.0;
+
+		adc[i].chA = (short)( amp * s + rand() % 16 );
+		adc[i].chB = (short)( 0.9 * amp * s + rand() % 16 );
+		adc[i].chC = (short)( 1.1 * amp * s + rand() % 16 );
+		adc[i].chD = (short)( amp * s + rand() % 16 );
+	}
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Returns the best ns/atom of RUNS runs of fn over count atoms of size
+// bytes. Each call transforms the next count atoms of the fixture, as
+// the same few atoms over and over would be learnt by the branch
+// predictor and give unrealistic timings for the small buffers.
+static double bench( transform_t fn, const void *in, size_t size, size_t count )
+{
+	const size_t loops = (RUN_ATOMS + count - 1) / count;
+	const size_t windows = MAX_ATOMS / count;
+	double best = 0;
+	size_t r, l;
+
+	fn( in, out, count );	// warm up
+
+	for ( r=0; r<RUNS; r++ ) {
+
+		const double t0 = now();
+		for ( l=0; l<loops; l++ )
+			fn( (const char *)in + (l % windows) * count * size, out, count );
+		const double ns = (now() - t0) / ((double)loops * count);
+
+		if ( !r || ns < best ) best = ns;
+	}
+	return best;
+}
+
+// Returns the baseline ns/atom of name and count, 0 if not found.
+static double baseline( const char *fname, const char *name, size_t count )
+{
+	FILE *f = fopen( fname, "r" );
+	char line[256], bname[64];
+	unsigned long bcount;
+	double ns, found = 0;
+
+	if ( !f ) return 0;
+	while ( fgets( line, sizeof(line), f ) ) {
+
+		if ( 3 == sscanf( line, "%63s %lu atoms %lf ns/atom", bname, &bcount, &ns ) &&
+		     !strcmp( bname, name ) && bcount == count )
+			found = ns;
+	}
+	fclose( f );
+
+	return found;
+}
+
+int main( int argc, char *argv[] )
+{
+	const char *raw = 0, *base = 0;
+	double tolerance = 10;
+	size_t t, s;
+	int opt, failed = 0;
+
+	while ( (opt = getopt( argc, argv, "r:b:t:" )) != -1 ) {
+		switch ( opt ) {
+			case 'r': raw = optarg; break;
+			case 'b': base = optarg; break;
+			case 't': tolerance = atof( optarg ); break;
+			default:
+				fprintf( stderr, "usage: %s [-r raw DD file] [-b baseline] [-t tolerance %%]\n", argv[0] );
+				return 1;
+		}
+	}
+
+	if ( raw ) {
+		if ( !load_raw( raw ) ) {
+			fprintf( stderr, "no atoms in %s\n", raw );
+			return 1;
+		}
+	}
+	else {
+		generate_raw();
+	}
+	generate_fixtures();
+
+	// Kx, Ky = 10 mm, Libera Brilliance at 499.654 MHz, harmonic 416
+	ebpp_setcache_position( 10000000, 10000000, 0, 0, 0 );
+	ebpp_setcache_sp( 4000, 2, 4 );
+	ebpp_setcache_sr( -1, 8, -2, 8 );
+	ebpp_setcache_cw( 1171125000, 416, 1201091.0 );
+
+	for ( t=0; t < sizeof(transforms)/sizeof(transforms[0]); t++ ) {
+
+		const void *in = I;
+		size_t size = sizeof(int);
+
+		switch ( transforms[t].input ) {
+			case IN_DD: in = dd; size = sizeof(dd[0]); break;
+			case IN_DD_SWITCH: in = dd_switch; size = sizeof(dd[0]); break;
+			case IN_ADC: in = adc; size = sizeof(adc[0]); break;
+			default: break;
+		}
+
+		for ( s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++ ) {
+
+			const double ns = bench( transforms[t].fn, in, size, sizes[s] );
+
+			printf( "%-20s %6lu atoms %10.2f ns/atom %12.0f atoms/s",
+				transforms[t].name, (unsigned long)sizes[s], ns, 1e9 / ns );
+
+			const double ref = base ? baseline( base, transforms[t].name, sizes[s] ) : 0;
+			if ( ref > 0 ) {
+
+				const double change = 100.0 * (ns - ref) / ref;
+				printf( " %+6.1f%%", change );
+				if ( change > tolerance ) {
+					printf( " SLOWER" );
+					failed = 1;
+				}
+			}
+			printf( "\n" );
+		}
+	}
+
+	return failed;
+}
@@ -0,0 +1,323 @@
+/*
+ *	daqLiberaTransformCheck.c
+ *	!CHAOS
+ *
+ *	Checks that the optimized DD transforms give the same atoms as the
+ *	reference ebpp_transform_dd (CORDIC + three 64-bit divisions), and
+ *	the spike removal the same atoms as ebpp_transform_dd_remove_spikes_ref
+ *	for several switching periods and CSPI_ENV_SR parameters. The single
+ *	pass shots found by ebpp_transform_adc_shots are checked against a
+ *	scan atom by atom of a train of bunches.
+ *
+ *	usage: daqLiberaTransformCheck [raw DD file]
+ *	the raw file is a sequence of CSPI_DD_RAWATOM as read from
+ *	/dev/libera.dd, when not given random atoms are generated.
+ *	Returns 0 if all the transforms match the reference.
+ *
+ *    	Copyright 2015 INFN, National Institute of Nuclear Physics
+ *
+ *    	Licensed under the Apache License, Version 2.0 (the "License");
+ *    	you may not use this file except in compliance with the License.
+ *    	You may obtain a copy of the License at
+ *
+ *    	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    	Unless required by applicable law or agreed to in writing, software
+ *    	distributed under the License is distributed on an "AS IS" BASIS,
+ *    	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    	See the License for the specific language governing permissions and
+ *    	limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "cspi.h"
+#include "ebpp_transform.h"
+
+#define RANDOM_ATOMS (1024*1024)
+
+typedef int (*transform_t)( const void *in, void *out, size_t count );
+
+static const struct {
+	const char *name;
+	transform_t fn;
+} transforms[] = {
+	{ "batch", ebpp_transform_dd_batch },
+	{ "rcp", ebpp_transform_dd_rcp },
+};
+
+// Kx, Ky, Xoffset, Yoffset, Qoffset
+static const int calibrations[][5] = {
+	{ 10000000, 10000000, 0, 0, 0 },
+	{ 14142000, 13550000, 120000, -75000, 3 },
+	{ 1, 1, -1, 1, 0 },
+	{ 2147483647, 2147483647, 0, 0, 0 },
+};
+
+// averaging_stop, average_window, start, window
+static const int spike_removals[][4] = {
+	{ -1, 8, -2, 8 },
+	{ -4, 4, -6, 2 },
+	{ 2, 2, 0, 4 },		// average over the hold window
+	{ -1, 1, 0, 127 },	// hold windows longer than the period
+	{ -16, 16, 15, 1 },
+	{ 0, 3, 0, 1 },		// not a power of 2
+};
+
+// half periods of the DSC switching, in atoms
+static const size_t switch_half_periods[] = { 1, 3, 20, 41, 1000 };
+
+// counts of the spike removal checks, the whole data for 0
+static const size_t spike_counts[] = { 1, 2, 5, 100, 4097, 0 };
+
+#define SPIKE_ATOMS (64*1024)
+
+#define SP_ATOMS 4096
+
+// single pass thresholds and shot separations (sp_separation)
+static const int sp_thresholds[] = { -32769, -1, 500, 1000, 4000, 32767 };
+static const int sp_separations[] = { 0, 1, 7, 100, 5000 };
+
+static size_t load_raw( const char *fname, CSPI_DD_RAWATOM **raw )
+{
+	FILE *f = fopen( fname, "rb" );
+	long size;
+
+	if ( !f ) {
+		perror( fname );
+		return 0;
+	}
+	fseek( f, 0, SEEK_END );
+	size = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	*raw = (CSPI_DD_RAWATOM *)malloc( size );
+	size = fread( *raw, 1, size, f );
+	fclose( f );
+
+	return size / sizeof(CSPI_DD_RAWATOM);
+}
+
+// Random beam-like atoms: random amplitude and phase per channel,
+// with some small and centered beams.
+static size_t generate_raw( CSPI_DD_RAWATOM **raw )
+{
+	size_t i;
+	int ch;
+
+	*raw = (CSPI_DD_RAWATOM *)malloc( RANDOM_ATOMS * sizeof(CSPI_DD_RAWATOM) );
+	srand( 1 );
+	for ( i=0; i<RANDOM_ATOMS; i++ ) {
+
+		int *p = (int *)&(*raw)[i];
+		const int shift = 3 + rand() % 24;	// amplitudes below 2^28
+		const int base = 4 + (rand() >> shift);	// nonzero sum
+
+		for ( ch=0; ch<4; ch++ ) {
+
+			const double amp = (i & 1) ? base : 4 + (rand() >> shift);
+			const double phase = 2.0 * M_PI * rand() / RAND_MAX;
+
+			p[2*ch]   = (int)( amp * cos( phase ) );
+			p[2*ch+1] = (int)( amp * sin( phase ) );
+		}
+	}
+	return RANDOM_ATOMS;
+}
+
+// Compares ebpp_transform_dd_remove_spikes to the reference on raw with
+// the trigger bit toggled every half period atoms. Returns the mismatches.
+static size_t check_spikes( CSPI_DD_RAWATOM *raw, size_t count,
+                            CSPI_DD_ATOM *ref, CSPI_DD_ATOM *out )
+{
+	size_t h, r, n, i, failed = 0;
+
+	if ( count > SPIKE_ATOMS ) count = SPIKE_ATOMS;
+
+	for ( h=0; h < sizeof(switch_half_periods)/sizeof(switch_half_periods[0]); h++ ) {
+
+		for ( i=0; i<count; i++ )
+			raw[i].cosVa = (raw[i].cosVa & ~1) | ((i / switch_half_periods[h]) & 1);
+
+		for ( r=0; r < sizeof(spike_removals)/sizeof(spike_removals[0]); r++ ) {
+
+			const int *sr = spike_removals[r];
+			ebpp_setcache_sr( sr[0], sr[1], sr[2], sr[3] );
+
+			for ( n=0; n < sizeof(spike_counts)/sizeof(spike_counts[0]); n++ ) {
+
+				const size_t c = spike_counts[n] && spike_counts[n] < count ? spike_counts[n] : count;
+				size_t mismatch = 0;
+
+				const int rc_ref = ebpp_transform_dd_remove_spikes_ref( raw, ref, c );
+				memcpy( out, raw, c * sizeof(CSPI_DD_ATOM) );
+				const int rc = ebpp_transform_dd_remove_spikes( out, out, c );
+
+				for ( i=0; i<c; i++ ) {
+
+					if ( memcmp( &ref[i], &out[i], sizeof(CSPI_DD_ATOM) ) ) {
+
+						if ( !mismatch ) {
+							printf( "spikes: period %lu sr %d,%d,%d,%d count %lu: atom %lu differs: Va %d/%d X %d/%d\n",
+								(unsigned long)switch_half_periods[h], sr[0], sr[1], sr[2], sr[3],
+								(unsigned long)c, (unsigned long)i,
+								ref[i].Va, out[i].Va, ref[i].X, out[i].X );
+						}
+						mismatch++;
+					}
+				}
+				if ( rc != rc_ref ) {
+					printf( "spikes: period %lu sr %d,%d,%d,%d count %lu: returned %d/%d\n",
+						(unsigned long)switch_half_periods[h], sr[0], sr[1], sr[2], sr[3],
+						(unsigned long)c, rc_ref, rc );
+					mismatch++;
+				}
+				failed += mismatch;
+			}
+		}
+	}
+	printf( "spikes %lu atoms, %lu mismatches\n", (unsigned long)count, (unsigned long)failed );
+
+	return failed;
+}
+
+// Returns the index of the first atom from first on with a channel above
+// threshold, count if none.
+static size_t sp_scan( const CSPI_ADC_ATOM *adc, size_t first, size_t count, int threshold )
+{
+	for ( ; first < count; first++ ) {
+		if ( adc[first].chA > threshold || adc[first].chB > threshold ||
+		     adc[first].chC > threshold || adc[first].chD > threshold )
+			break;
+	}
+	return first;
+}
+
+// Compares the shots of ebpp_transform_adc_shots to sp_scan on noise with
+// a train of bunches of growing intensity on one channel at a time.
+// Returns the mismatches.
+static size_t check_sp()
+{
+	CSPI_ADC_ATOM *adc = (CSPI_ADC_ATOM *)malloc( SP_ATOMS * sizeof(CSPI_ADC_ATOM) );
+	CSPI_ADC_SP_ATOM *sp = (CSPI_ADC_SP_ATOM *)malloc( SP_ATOMS * sizeof(CSPI_ADC_SP_ATOM) );
+	size_t t, s, c, i, failed = 0;
+
+	srand( 2 );
+	for ( i=0; i<SP_ATOMS; i++ ) {
+
+		short *ch = (short *)&adc[i];
+		int k;
+
+		for ( k=0; k<4; k++ ) ch[k] = (short)( rand() % 801 - 400 );
+		if ( i % 97 == 13 ) ch[i % 4] = (short)( 600 + 8 * i );	// bunch
+	}
+	adc[SP_ATOMS-1].chA = 32767;
+
+	const size_t counts[] = { 1, 15, 17, 100, SP_ATOMS };
+
+	for ( t=0; t < sizeof(sp_thresholds)/sizeof(sp_thresholds[0]); t++ ) {
+
+		ebpp_setcache_sp( sp_thresholds[t], 2, 4 );
+
+		for ( s=0; s < sizeof(sp_separations)/sizeof(sp_separations[0]); s++ ) {
+
+			const size_t separation = sp_separations[s];
+
+			for ( c=0; c < sizeof(counts)/sizeof(counts[0]); c++ ) {
+
+				const size_t count = counts[c];
+				const size_t n = ebpp_transform_adc_shots( adc, sp, count, separation, 0 );
+				size_t trigger = sp_scan( adc, 0, count, sp_thresholds[t] );
+				size_t m = 0, mismatch = 0;
+
+				if ( !separation ) {
+					// first crossing only, count if none
+					mismatch = n != 1 || sp[0].trigger != trigger;
+				}
+				else {
+					for ( ; trigger < count; m++ ) {
+						if ( m >= n || sp[m].trigger != trigger ) mismatch++;
+						trigger = sp_scan( adc, trigger + separation, count, sp_thresholds[t] );
+					}
+					if ( m != n ) mismatch++;
+				}
+
+				if ( mismatch ) {
+					printf( "sp: threshold %d separation %lu count %lu: %lu shots, expected %lu\n",
+						sp_thresholds[t], (unsigned long)separation, (unsigned long)count,
+						(unsigned long)n, (unsigned long)(separation ? m : 1) );
+				}
+				failed += mismatch;
+			}
+		}
+	}
+	printf( "sp %d atoms, %lu mismatches\n", SP_ATOMS, (unsigned long)failed );
+
+	free( adc );
+	free( sp );
+
+	return failed;
+}
+
+int main( int argc, char *argv[] )
+{
+	CSPI_DD_RAWATOM *raw = 0;
+	CSPI_DD_ATOM *ref, *out;
+	size_t count, i, c, t;
+	int failed = 0;
+
+	count = (argc > 1) ? load_raw( argv[1], &raw ) : generate_raw( &raw );
+	if ( !count ) {
+		fprintf( stderr, "no atoms to check\n" );
+		return 1;
+	}
+
+	ref = (CSPI_DD_ATOM *)malloc( count * sizeof(CSPI_DD_ATOM) );
+	out = (CSPI_DD_ATOM *)malloc( count * sizeof(CSPI_DD_ATOM) );
+
+	for ( c=0; c < sizeof(calibrations)/sizeof(calibrations[0]); c++ ) {
+
+		const int *k = calibrations[c];
+		ebpp_setcache_position( k[0], k[1], k[2], k[3], k[4] );
+
+		ebpp_transform_dd( raw, ref, count );
+
+		for ( t=0; t < sizeof(transforms)/sizeof(transforms[0]); t++ ) {
+
+			size_t mismatch = 0;
+
+			// transform in place, as cspi_read does
+			memcpy( out, raw, count * sizeof(CSPI_DD_ATOM) );
+			transforms[t].fn( out, out, count );
+
+			for ( i=0; i<count; i++ ) {
+
+				if ( memcmp( &ref[i], &out[i], sizeof(CSPI_DD_ATOM) ) ) {
+
+					if ( !mismatch ) {
+						printf( "%s: atom %lu differs: X %d/%d Y %d/%d Q %d/%d\n",
+							transforms[t].name, (unsigned long)i,
+							ref[i].X, out[i].X, ref[i].Y, out[i].Y, ref[i].Q, out[i].Q );
+					}
+					mismatch++;
+				}
+			}
+			printf( "%-6s Kx=%d Ky=%d: %lu atoms, %lu mismatches\n",
+				transforms[t].name, k[0], k[1],
+				(unsigned long)count, (unsigned long)mismatch );
+			if ( mismatch ) failed = 1;
+		}
+	}
+
+	ebpp_setcache_position( 10000000, 10000000, 0, 0, 0 );
+	if ( check_spikes( raw, count, ref, out ) ) failed = 1;
+	if ( check_sp() ) failed = 1;
+
+	free( raw );
+	free( ref );
+	free( out );
+
+	return failed;
+}